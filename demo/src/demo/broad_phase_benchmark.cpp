@@ -0,0 +1,172 @@
+#include "demo.h"
+#include "game.h"
+#include "window.h"
+
+namespace muli
+{
+
+class BroadPhaseBenchmark : public Demo
+{
+    static inline int32 type = 0;
+    static inline int32 count = 2000;
+    static inline float cellSize = 1.0f;
+
+    static constexpr int32 type_count = 3;
+    static constexpr const char* type_names[type_count] = { "AABB tree", "Sweep and prune", "Uniform grid" };
+
+    static constexpr int32 bench_steps = 300;
+    static constexpr int32 bench_queries = 10000;
+
+    struct Result
+    {
+        double build;
+        double step;
+        double query;
+        double rayCast;
+    };
+
+    static inline Result results[type_count];
+    static inline bool measured = false;
+
+public:
+    BroadPhaseBenchmark(Game& game)
+        : Demo(game)
+    {
+        // The broad phase is chosen when the world is created
+        delete world;
+        settings.broad_phase_type = BroadPhaseType(type);
+        settings.grid_cell_size = cellSize;
+        settings.apply_gravity = false;
+        world = new World(settings);
+
+        CreateScene(world, count);
+
+        camera.position.SetZero();
+        camera.scale.Set(3.0f);
+    }
+
+    // Same sized circles bouncing in a box, the kind of scene the grid broad phase is made for
+    static void CreateScene(World* w, int32 n)
+    {
+        float size = Sqrt(float(n)) * 0.5f;
+        float halfSize = size / 2.0f;
+        float wallRadius = 0.2f;
+
+        w->CreateCapsule(Vec2{ -halfSize, -halfSize }, Vec2{ halfSize, -halfSize }, wallRadius, RigidBody::Type::static_body);
+        w->CreateCapsule(Vec2{ halfSize, -halfSize }, Vec2{ halfSize, halfSize }, wallRadius, RigidBody::Type::static_body);
+        w->CreateCapsule(Vec2{ halfSize, halfSize }, Vec2{ -halfSize, halfSize }, wallRadius, RigidBody::Type::static_body);
+        w->CreateCapsule(Vec2{ -halfSize, halfSize }, Vec2{ -halfSize, -halfSize }, wallRadius, RigidBody::Type::static_body);
+
+        int32 columns = int32(Sqrt(float(n)));
+        float spacing = (size - 1.0f) / columns;
+
+        for (int32 i = 0; i < n; ++i)
+        {
+            RigidBody* b = w->CreateCircle(0.15f);
+            b->SetPosition(-halfSize + 0.5f + (i % columns) * spacing, -halfSize + 0.5f + (i / columns) * spacing);
+
+            // Deterministic velocities so every broad phase simulates the same scene
+            b->SetLinearVelocity(Vec2{ float((i * 37) % 11) - 5.0f, float((i * 17) % 13) - 6.0f });
+        }
+    }
+
+    static double Elapsed(std::chrono::steady_clock::time_point begin)
+    {
+        std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - begin;
+        return duration.count();
+    }
+
+    static void Measure()
+    {
+        for (int32 t = 0; t < type_count; ++t)
+        {
+            WorldSettings s;
+            s.broad_phase_type = BroadPhaseType(t);
+            s.grid_cell_size = cellSize;
+            s.apply_gravity = false;
+
+            Result& r = results[t];
+
+            auto begin = std::chrono::steady_clock::now();
+            World* w = new World(s);
+            CreateScene(w, count);
+            r.build = Elapsed(begin);
+
+            begin = std::chrono::steady_clock::now();
+            for (int32 i = 0; i < bench_steps; ++i)
+            {
+                w->Step(1.0f / 60.0f);
+            }
+            r.step = Elapsed(begin) / bench_steps;
+
+            float halfSize = Sqrt(float(count)) * 0.25f;
+
+            begin = std::chrono::steady_clock::now();
+            for (int32 i = 0; i < bench_queries; ++i)
+            {
+                Vec2 p{ halfSize * ((i * 7919) % 1000 / 500.0f - 1.0f), halfSize * ((i * 104729) % 1000 / 500.0f - 1.0f) };
+                w->Query(AABB{ p - Vec2{ 0.5f }, p + Vec2{ 0.5f } }, [](Collider*) -> bool { return true; });
+            }
+            r.query = Elapsed(begin) * 1000.0 / bench_queries;
+
+            begin = std::chrono::steady_clock::now();
+            for (int32 i = 0; i < bench_queries; ++i)
+            {
+                Vec2 p{ halfSize * ((i * 7919) % 1000 / 500.0f - 1.0f), halfSize * ((i * 104729) % 1000 / 500.0f - 1.0f) };
+                Vec2 d{ Cos(float(i)), Sin(float(i)) };
+                w->RayCastClosest(p, p + d * halfSize, 0.0f, [](Collider*, const Vec2&, const Vec2&, float) {});
+            }
+            r.rayCast = Elapsed(begin) * 1000.0 / bench_queries;
+
+            delete w;
+        }
+
+        measured = true;
+    }
+
+    void UpdateUI() override
+    {
+        ImGui::SetNextWindowPos({ Window::Get().GetWindowSize().x - 5, 5 }, ImGuiCond_Once, { 1.0f, 0.0f });
+
+        if (ImGui::Begin("Broad phase benchmark", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+        {
+            if (ImGui::Combo("Broad phase", &type, type_names, type_count))
+            {
+                game.RestartDemo();
+            }
+            ImGui::SliderInt("Circles", &count, 100, 10000);
+            ImGui::SliderFloat("Grid cell size", &cellSize, 0.25f, 4.0f, "%.2f m");
+            if (ImGui::Button("Restart"))
+            {
+                game.RestartDemo();
+            }
+
+            ImGui::Separator();
+            if (ImGui::Button("Run benchmark"))
+            {
+                Measure();
+            }
+
+            if (measured)
+            {
+                for (int32 t = 0; t < type_count; ++t)
+                {
+                    const Result& r = results[t];
+                    ImGui::Text("%s", type_names[t]);
+                    ImGui::Text("  build %.2f ms, step %.3f ms", r.build, r.step);
+                    ImGui::Text("  aabb query %.3f us, closest ray cast %.3f us", r.query, r.rayCast);
+                }
+            }
+        }
+        ImGui::End();
+    }
+
+    static Demo* Create(Game& game)
+    {
+        return new BroadPhaseBenchmark(game);
+    }
+};
+
+static int index = register_demo("Broad phase benchmark", BroadPhaseBenchmark::Create, 53);
+
+} // namespace muli
@@ -56,7 +56,10 @@ public:
 
         if (ImGui::Begin("Dynamic AABB tree", NULL, ImGuiWindowFlags_AlwaysAutoResize))
         {
-            ImGui::Text("Tree cost: %.4f", world->GetDynamicTree().ComputeTreeCost());
+            if (const AABBTree* tree = world->GetDynamicTree())
+            {
+                ImGui::Text("Tree cost: %.4f", tree->ComputeTreeCost());
+            }
             ImGui::InputText("Seed", seed, 20);
             ImGui::Separator();
             if (ImGui::Button("Generate"))
@@ -70,7 +73,7 @@ public:
 
                 game.RestartDemo();
             }
-            if (ImGui::Button("Rebuild bottom up"))
+            if (ImGui::Button("Rebuild"))
             {
                 world->RebuildDynamicTree();
             }
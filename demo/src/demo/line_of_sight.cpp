@@ -10,6 +10,9 @@ class LineOfSight : public Demo
 public:
     int32 count = 100;
 
+    std::vector<RayCastInput> rays;
+    std::vector<RayCastHit> hits;
+
     LineOfSight(Game& game)
         : Demo(game)
     {
@@ -59,18 +62,29 @@ public:
     {
         Demo::Step();
 
+        rays.resize(count);
+        hits.resize(count);
+
         float angleDelta = pi * 2.0f / count;
-        for (float angle = 0.0f; angle < pi * 2.0f; angle += angleDelta)
+        for (int32 i = 0; i < count; ++i)
         {
-            Vec2 to = cursorPos + Vec2{ Cos(angle), Sin(angle) } * 3.0f;
+            float angle = i * angleDelta;
+            rays[i] = RayCastInput{ cursorPos, cursorPos + Vec2{ Cos(angle), Sin(angle) } * 3.0f, 1.0f, 0.0f };
+        }
+
+        // Cast all the rays of the fan at once
+        world->RayCastClosest(rays, hits);
 
-            if (!world->RayCastClosest(cursorPos, to, 0.0f,
-                                       [&](Collider* collider, const Vec2& point, const Vec2& normal, float fraction) -> void {
-                                           renderer.DrawPoint(point);
-                                           renderer.DrawLine(cursorPos, point);
-                                       }))
+        for (int32 i = 0; i < count; ++i)
+        {
+            if (hits[i].collider)
+            {
+                renderer.DrawPoint(hits[i].point);
+                renderer.DrawLine(cursorPos, hits[i].point);
+            }
+            else
             {
-                renderer.DrawLine(cursorPos, to);
+                renderer.DrawLine(cursorPos, rays[i].to);
             }
         }
     }
@@ -141,13 +141,29 @@ void Game::UpdateUI()
                         world.Awake();
                     }
 
+                    bool softStep = settings.solver_type == SolverType::soft_step;
+                    if (ImGui::Checkbox("Soft step solver", &softStep))
+                    {
+                        settings.solver_type = softStep ? SolverType::soft_step : SolverType::sequential_impulse;
+                    }
+
                     ImGui::Text("Constraint solve iterations");
                     {
                         ImGui::SetNextItemWidth(120);
                         ImGui::SliderInt("Velocity", &settings.step.velocity_iterations, 0, 50);
 
                         ImGui::SetNextItemWidth(120);
-                        ImGui::SliderInt("Position", &settings.step.position_iterations, 0, 50);
+                        ImGui::SliderFloat("Velocity tolerance", &settings.step.velocity_tolerance, 0.0f, 0.01f, "%.4f");
+
+                        ImGui::SetNextItemWidth(120);
+                        if (softStep)
+                        {
+                            ImGui::SliderInt("Sub steps", &settings.step.sub_steps, 1, 16);
+                        }
+                        else
+                        {
+                            ImGui::SliderInt("Position", &settings.step.position_iterations, 0, 50);
+                        }
                     }
                     ImGui::Checkbox("Contact block solve", &block_solve);
                     ImGui::Checkbox("Warm starting", &settings.step.warm_starting);
@@ -162,6 +178,8 @@ void Game::UpdateUI()
                 ImGui::Text("Sleeping dynamic bodies: %d", world.GetSleepingBodyCount());
                 // ImGui::Text("Awake island count: %d", world.GetIslandCount());
                 ImGui::Text("Broad phase contacts: %d", world.GetContactCount());
+                ImGui::Text("Velocity iterations: %d (max %d per island)", world.GetStepStats().velocityIterations,
+                            world.GetStepStats().maxVelocityIterations);
                 ImGui::EndTabItem();
             }
 
@@ -397,17 +415,19 @@ void Game::Render()
         }
     }
 
-    if (options.show_bvh || options.show_aabb)
+    if ((options.show_bvh || options.show_aabb) && world.GetDynamicTree())
     {
-        const AABBTree& tree = world.GetDynamicTree();
-        tree.Traverse([&](const AABBTree::Node* n) -> void {
+        auto drawNode = [&](const AABBTree::Node* n) -> void {
             if (options.show_bvh == false && n->IsLeaf() == false)
             {
                 return;
             }
 
             renderer.DrawAABB(n->aabb);
-        });
+        };
+
+        world.GetStaticTree()->Traverse(drawNode);
+        world.GetDynamicTree()->Traverse(drawNode);
     }
 
     if (options.show_contact_point || options.show_contact_normal)
@@ -5,6 +5,10 @@
 #include "collision.h"
 #include "growable_array.h"
 #include "settings.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <bit>
 
 namespace muli
 {
@@ -26,8 +30,12 @@ class AABBTree
 {
 public:
     static constexpr inline int32 nullNode = -1;
+    static constexpr inline int32 query_packet_size = 64;
+    static constexpr inline int32 ray_packet_size = 32;
 
-    struct Node
+    // Only the data read by the traversals lives in the node, so a node never straddles a cache line
+    // The rest of the node is stored in the parallel arrays indexed by the same proxy
+    struct alignas(32) Node
     {
         bool IsLeaf() const
         {
@@ -36,17 +44,12 @@ public:
 
         AABB aabb;
 
-        NodeProxy parent;
         NodeProxy child1;
         NodeProxy child2;
-
-        NodeProxy next;
-        bool moved;
-
-        Data* data; // user data
     };
 
-    AABBTree();
+    // Leaves are fattened by the margin so that small movements don't move the nodes
+    AABBTree(const Vec2& margin = aabb_margin);
     ~AABBTree() noexcept;
 
     AABBTree(const AABBTree&) = delete;
@@ -58,9 +61,26 @@ public:
     void Reset();
 
     NodeProxy CreateNode(Data* data, const AABB& aabb);
+
+    // Insert the nodes at once, the new node of data[i] is written to outNodes[i]
+    // Large batches are built into a linear bvh from the morton codes of all the leaves, optionally refined with rotations
+    void CreateNodes(std::span<Data*> data, std::span<const AABB> aabbs, NodeProxy* outNodes, bool refine = true);
+
     bool MoveNode(NodeProxy node, AABB aabb, const Vec2& displacement, bool forceMove);
     void RemoveNode(NodeProxy node);
 
+    // Remove the nodes at once, the remaining leaves are rebuilt into a new tree if most of the leaves are removed
+    // Large trees are built in parallel if the thread pool is given
+    void RemoveNodes(std::span<const NodeProxy> removedNodes, ThreadPool* threadPool = nullptr);
+
+    // Same as MoveNode(), but the leaf keeps its place in the tree and its ancestors are only enlarged
+    // Call Refit() once all the nodes of the step are moved to tighten the ancestors
+    bool RefitNode(NodeProxy node, AABB aabb, const Vec2& displacement, bool forceMove);
+
+    // Tighten the ancestors of the refitted leaves bottom up, visiting each of them once
+    // Returns the lowest node containing all the refitted leaves, nullNode if no leaf was refitted
+    NodeProxy Refit();
+
     bool TestOverlap(NodeProxy nodeA, NodeProxy nodeB) const;
     const AABB& GetAABB(NodeProxy node) const;
     void ClearMoved(NodeProxy node) const;
@@ -76,31 +96,105 @@ public:
     template <typename T>
     void AABBCast(const AABBCastInput& input, T* callback) const;
 
+    // Query the boxes in packets of query_packet_size consecutive boxes, each packet traverses the tree once
+    // and a node is tested only against the boxes of the packet that overlap its parent
+    // The callback gets the index of the box in the span: bool QueryCallback(int32 queryIndex, NodeProxy node, Data* data)
+    // Nearby boxes should be next to each other in the span, see SortQueries()
+    template <typename T>
+    void Query(std::span<const AABB> aabbs, T* callback) const;
+
+    // Cast the rays in packets of up to ray_packet_size consecutive rays heading into the same quadrant
+    // The rays of a packet share one traversal stack and each node is slab tested against the live rays, simd_width at a time
+    // The callback gets the index of the ray in the span and returns the new max fraction of the ray like in AABBCast():
+    // float AABBCastCallback(int32 rayIndex, const AABBCastInput& subInput, Data* data)
+    // Nearby rays should be next to each other in the span, see SortRays()
+    template <typename T>
+    void AABBCast(std::span<const AABBCastInput> inputs, T* callback) const;
+
     void Traverse(std::function<void(const Node*)> callback) const;
     void Query(const Vec2& point, std::function<bool(NodeProxy, Data*)> callback) const;
     void Query(const AABB& aabb, std::function<bool(NodeProxy, Data*)> callback) const;
+    void Query(std::span<const AABB> aabbs, std::function<bool(int32, NodeProxy, Data*)> callback) const;
+    void AABBCast(std::span<const AABBCastInput> inputs,
+                  std::function<float(int32, const AABBCastInput& input, Data* data)> callback) const;
     void AABBCast(const AABBCastInput& input, std::function<float(const AABBCastInput& input, Data* data)> callback) const;
 
+    int32 GetNodeCount() const;
+
+    // Change whenever the bounds or the structure of the tree change, see WideTree
+    uint32 GetVersion() const;
+    uint32 GetStructureVersion() const;
+
+    // Write the order of the boxes along the morton curve of their centers to outOrder
+    // Consecutive boxes of the order are close to each other, so they make tight packets for the batched Query()
+    static void SortQueries(std::span<const AABB> aabbs, int32* outOrder);
+
+    // Write the order of the rays grouped by quadrant and along the morton curve of their midpoints to outOrder
+    // Consecutive rays of the order head the same way through the same region, so they make coherent packets for AABBCast()
+    static void SortRays(std::span<const AABBCastInput> inputs, int32* outOrder);
+
+    // Sum of the surface areas of all the nodes
     float ComputeTreeCost() const;
-    void Rebuild();
+    // Sum of the surface areas of the nodes under the node
+    float ComputeTreeCost(NodeProxy node) const;
+
+    // Reinsert up to budget leaves that add the most to the tree cost, returns the number of reinserted leaves
+    // Each call ranks the leaves in the next window of the node array by the surface area of their parent, which the leaf
+    // costs the tree, so repeated calls sweep the whole tree and keep its quality steady without a full Rebuild()
+    // Call it after Refit() if leaves were refitted
+    int32 Optimize(int32 budget);
+
+    // Rebuild the tree from the leaves with the binned surface area heuristic in O(n log n)
+    // Large trees are built in parallel if the thread pool is given
+    void Rebuild(ThreadPool* threadPool = nullptr);
+
+    // Rebuild only the subtree under the node, the rest of the tree is left untouched
+    // Returns the root of the new subtree, which takes the place of the node
+    NodeProxy RebuildSubtree(NodeProxy node, ThreadPool* threadPool = nullptr);
 
 private:
+    friend class WideTree;
+
     NodeProxy root;
+    Vec2 margin;
+    uint32 version;
+    uint32 structureVersion;
 
     Node* nodes;
+    NodeProxy* parents;
+    NodeProxy* nextFree;
+    bool* moved;
+    bool* refitted; // Refitted leaves and their ancestors waiting for Refit()
+    Data** userData;
     int32 nodeCapacity;
     int32 nodeCount;
 
     NodeProxy freeList;
+    NodeProxy optimizeCursor; // Next node ranked by Optimize()
+
+    void ResizeNodes(int32 capacity);
+    void FreeNodes();
 
     NodeProxy AllocateNode();
     void FreeNode(NodeProxy node);
 
+    // Free all the internal nodes and collect the leaves, returns the leaf count
+    int32 ReleaseInternalNodes(NodeProxy* leaves);
+    NodeProxy* AllocateInternalNodes(int32 leafCount);
+
+    // Build a binned SAH tree over the detached leaves and return its root
+    NodeProxy BuildTree(const NodeProxy* leafNodes, int32 count, ThreadPool* threadPool);
+
+    AABB FattenAABB(AABB aabb, const Vec2& displacement) const;
+
     NodeProxy InsertLeaf(NodeProxy leaf);
     void RemoveLeaf(NodeProxy leaf);
 
     void Rotate(NodeProxy node);
     void Swap(NodeProxy node1, NodeProxy node2);
+
+    // Signs of the ray direction, the rays of a packet share them so the near and far slab planes are picked once
+    static uint32 GetRayQuadrant(const AABBCastInput& input);
 };
 
 inline bool AABBTree::TestOverlap(NodeProxy nodeA, NodeProxy nodeB) const
@@ -122,30 +216,42 @@ inline void AABBTree::ClearMoved(NodeProxy node) const
 {
     muliAssert(0 <= node && node < nodeCapacity);
 
-    nodes[node].moved = false;
+    moved[node] = false;
 }
 
 inline bool AABBTree::WasMoved(NodeProxy node) const
 {
     muliAssert(0 <= node && node < nodeCapacity);
 
-    return nodes[node].moved;
+    return moved[node];
 }
 
 inline Data* AABBTree::GetData(NodeProxy node) const
 {
     muliAssert(0 <= node && node < nodeCapacity);
 
-    return nodes[node].data;
+    return userData[node];
 }
 
-inline float AABBTree::ComputeTreeCost() const
+inline int32 AABBTree::GetNodeCount() const
 {
-    float cost = 0.0f;
+    return nodeCount;
+}
+
+inline uint32 AABBTree::GetVersion() const
+{
+    return version;
+}
 
-    Traverse([&cost](const Node* node) -> void { cost += SurfaceArea(node->aabb); });
+inline uint32 AABBTree::GetStructureVersion() const
+{
+    return structureVersion;
+}
 
-    return cost;
+inline uint32 AABBTree::GetRayQuadrant(const AABBCastInput& input)
+{
+    Vec2 d = input.to - input.from;
+    return uint32(1.0f / d.x < 0.0f) | (uint32(1.0f / d.y < 0.0f) << 1);
 }
 
 template <typename T>
@@ -196,7 +302,7 @@ void AABBTree::Query(const Vec2& point, T* callback) const
 
         if (nodes[current].IsLeaf())
         {
-            bool proceed = callback->QueryCallback(current, nodes[current].data);
+            bool proceed = callback->QueryCallback(current, userData[current]);
             if (proceed == false)
             {
                 return;
@@ -232,7 +338,7 @@ void AABBTree::Query(const AABB& aabb, T* callback) const
 
         if (nodes[current].IsLeaf())
         {
-            bool proceed = callback->QueryCallback(current, nodes[current].data);
+            bool proceed = callback->QueryCallback(current, userData[current]);
             if (proceed == false)
             {
                 return;
@@ -246,6 +352,102 @@ void AABBTree::Query(const AABB& aabb, T* callback) const
     }
 }
 
+template <typename T>
+void AABBTree::Query(std::span<const AABB> aabbs, T* callback) const
+{
+    if (root == nullNode)
+    {
+        return;
+    }
+
+    // Boxes of the packet in SoA layout, so a node is tested against simd_width boxes at once
+    float minX[query_packet_size];
+    float minY[query_packet_size];
+    float maxX[query_packet_size];
+    float maxY[query_packet_size];
+
+    // Bit i of the mask is set if the box i of the packet overlaps the parent of the node
+    struct Entry
+    {
+        NodeProxy node;
+        uint64 mask;
+    };
+
+    GrowableArray<Entry, 256> stack;
+
+    int32 queryCount = int32(aabbs.size());
+    for (int32 begin = 0; begin < queryCount; begin += query_packet_size)
+    {
+        int32 count = Min(query_packet_size, queryCount - begin);
+        int32 paddedCount = (count + simd_width - 1) & ~(simd_width - 1);
+
+        for (int32 i = 0; i < paddedCount; ++i)
+        {
+            const AABB& aabb = i < count ? aabbs[begin + i] : aabbs[begin];
+            minX[i] = aabb.min.x;
+            minY[i] = aabb.min.y;
+            maxX[i] = aabb.max.x;
+            maxY[i] = aabb.max.y;
+        }
+
+        uint64 packetMask = count == query_packet_size ? ~uint64(0) : (uint64(1) << count) - 1;
+        stack.EmplaceBack(root, packetMask);
+
+        while (stack.Count() != 0)
+        {
+            Entry entry = stack.PopBack();
+            const Node& node = nodes[entry.node];
+
+            const FloatW nodeMinX = SplatW(node.aabb.min.x);
+            const FloatW nodeMinY = SplatW(node.aabb.min.y);
+            const FloatW nodeMaxX = SplatW(node.aabb.max.x);
+            const FloatW nodeMaxY = SplatW(node.aabb.max.y);
+
+            // Test only the groups of simd_width boxes having a live box
+            uint64 overlaps = 0;
+            uint64 groups = entry.mask;
+
+            while (groups != 0)
+            {
+                int32 i = std::countr_zero(groups) & ~(simd_width - 1);
+                groups &= ~(uint64((1 << simd_width) - 1) << i);
+
+                // Same comparisons as AABB::TestOverlap()
+                MaskW overlap = LessEqualW(nodeMinX, LoadW(maxX + i)) & LessEqualW(LoadW(minX + i), nodeMaxX) &
+                                LessEqualW(nodeMinY, LoadW(maxY + i)) & LessEqualW(LoadW(minY + i), nodeMaxY);
+
+                overlaps |= uint64(MoveMaskW(overlap)) << i;
+            }
+
+            overlaps &= entry.mask;
+            if (overlaps == 0)
+            {
+                continue;
+            }
+
+            if (node.IsLeaf())
+            {
+                while (overlaps != 0)
+                {
+                    int32 i = std::countr_zero(overlaps);
+                    overlaps &= overlaps - 1;
+
+                    bool proceed = callback->QueryCallback(begin + i, entry.node, userData[entry.node]);
+                    if (proceed == false)
+                    {
+                        return;
+                    }
+                }
+            }
+            else
+            {
+                stack.EmplaceBack(node.child1, overlaps);
+                stack.EmplaceBack(node.child2, overlaps);
+            }
+        }
+    }
+}
+
 template <typename T>
 void AABBTree::AABBCast(const AABBCastInput& input, T* callback) const
 {
@@ -283,7 +485,7 @@ void AABBTree::AABBCast(const AABBCastInput& input, T* callback) const
             subInput.maxFraction = maxFraction;
             subInput.halfExtents = halfExtents;
 
-            float newFraction = callback->AABBCastCallback(subInput, node->data);
+            float newFraction = callback->AABBCastCallback(subInput, userData[current]);
             if (newFraction == 0.0f)
             {
                 return;
@@ -326,4 +528,167 @@ void AABBTree::AABBCast(const AABBCastInput& input, T* callback) const
     }
 }
 
+template <typename T>
+void AABBTree::AABBCast(std::span<const AABBCastInput> inputs, T* callback) const
+{
+    if (root == nullNode)
+    {
+        return;
+    }
+
+    // Rays of the packet in SoA layout
+    float originX[ray_packet_size];
+    float originY[ray_packet_size];
+    float invX[ray_packet_size];
+    float invY[ray_packet_size];
+    float marginX[ray_packet_size];
+    float marginY[ray_packet_size];
+    float maxFractions[ray_packet_size];
+
+    // Bit i of the mask is set if the ray i of the packet hit the parent of the node
+    struct Entry
+    {
+        NodeProxy node;
+        uint32 mask;
+    };
+
+    GrowableArray<Entry, 256> stack;
+
+    const FloatW zero = SplatW(0.0f);
+
+    int32 rayCount = int32(inputs.size());
+    for (int32 begin = 0; begin < rayCount;)
+    {
+        uint32 quadrant = GetRayQuadrant(inputs[begin]);
+
+        // Packets never cross a multiple of ray_packet_size, so splitting the span there doesn't change the packets
+        int32 maxCount = Min(ray_packet_size - begin % ray_packet_size, rayCount - begin);
+
+        int32 count = 1;
+        while (count < maxCount && GetRayQuadrant(inputs[begin + count]) == quadrant)
+        {
+            ++count;
+        }
+
+        int32 paddedCount = (count + simd_width - 1) & ~(simd_width - 1);
+
+        uint32 packetMask = 0;
+        Vec2 packetDir = Vec2::zero;
+
+        for (int32 i = 0; i < paddedCount; ++i)
+        {
+            const AABBCastInput& input = inputs[begin + (i < count ? i : 0)];
+            Vec2 d = input.to - input.from;
+
+            originX[i] = input.from.x;
+            originY[i] = input.from.y;
+            invX[i] = 1.0f / d.x;
+            invY[i] = 1.0f / d.y;
+            marginX[i] = input.halfExtents.x;
+            marginY[i] = input.halfExtents.y;
+            maxFractions[i] = input.maxFraction;
+
+            if (i < count && d.NormalizeSafe() != 0.0f)
+            {
+                packetMask |= 1u << i;
+                packetDir += d;
+            }
+        }
+
+        bool flipX = (quadrant & 1) != 0;
+        bool flipY = (quadrant & 2) != 0;
+
+        if (packetMask != 0)
+        {
+            stack.EmplaceBack(root, packetMask);
+        }
+
+        while (stack.Count() > 0)
+        {
+            Entry entry = stack.PopBack();
+            const Node& node = nodes[entry.node];
+
+            const FloatW nodeMinX = SplatW(node.aabb.min.x);
+            const FloatW nodeMinY = SplatW(node.aabb.min.y);
+            const FloatW nodeMaxX = SplatW(node.aabb.max.x);
+            const FloatW nodeMaxY = SplatW(node.aabb.max.y);
+
+            // Test only the groups of simd_width rays having a live ray
+            uint32 hits = 0;
+            uint32 groups = entry.mask;
+
+            while (groups != 0)
+            {
+                int32 i = std::countr_zero(groups) & ~(simd_width - 1);
+                groups &= ~(uint32((1 << simd_width) - 1) << i);
+
+                FloatW minX = nodeMinX - LoadW(marginX + i);
+                FloatW maxX = nodeMaxX + LoadW(marginX + i);
+                FloatW minY = nodeMinY - LoadW(marginY + i);
+                FloatW maxY = nodeMaxY + LoadW(marginY + i);
+
+                // Same slab test as AABB::RayCast()
+                FloatW tx0 = ((flipX ? maxX : minX) - LoadW(originX + i)) * LoadW(invX + i);
+                FloatW tx1 = ((flipX ? minX : maxX) - LoadW(originX + i)) * LoadW(invX + i);
+                FloatW ty0 = ((flipY ? maxY : minY) - LoadW(originY + i)) * LoadW(invY + i);
+                FloatW ty1 = ((flipY ? minY : maxY) - LoadW(originY + i)) * LoadW(invY + i);
+
+                FloatW tMin = MaxW(tx0, zero);
+                FloatW tMax = MinW(tx1, LoadW(maxFractions + i));
+                tMin = MaxW(ty0, tMin);
+                tMax = MinW(ty1, tMax);
+
+                hits |= uint32(MoveMaskW(LessW(tMin, tMax))) << i;
+            }
+
+            hits &= entry.mask;
+            if (hits == 0)
+            {
+                continue;
+            }
+
+            if (node.IsLeaf())
+            {
+                while (hits != 0)
+                {
+                    int32 i = std::countr_zero(hits);
+                    hits &= hits - 1;
+
+                    const AABBCastInput& input = inputs[begin + i];
+
+                    AABBCastInput subInput;
+                    subInput.from = input.from;
+                    subInput.to = input.to;
+                    subInput.maxFraction = maxFractions[i];
+                    subInput.halfExtents = input.halfExtents;
+
+                    // Zero ends the ray, since no box is hit within a zero fraction
+                    float newFraction = callback->AABBCastCallback(begin + i, subInput, userData[entry.node]);
+                    if (newFraction >= 0.0f)
+                    {
+                        // Shorten the ray
+                        maxFractions[i] = newFraction;
+                    }
+                }
+            }
+            else
+            {
+                // Visit the child nearer along the packet direction first
+                NodeProxy child1 = node.child1;
+                NodeProxy child2 = node.child2;
+
+                if (Dot(nodes[child1].aabb.GetCenter() - nodes[child2].aabb.GetCenter(), packetDir) > 0.0f)
+                {
+                    std::swap(child1, child2);
+                }
+
+                stack.EmplaceBack(child2, hits);
+                stack.EmplaceBack(child1, hits);
+            }
+        }
+
+        begin += count;
+    }
+}
+
 } // namespace muli
\ No newline at end of file
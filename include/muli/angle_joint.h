@@ -11,8 +11,9 @@ class AngleJoint : public Joint
 public:
     AngleJoint(RigidBody* bodyA, RigidBody* bodyB, float frequency = 10.0f, float dampingRatio = 1.0f, float jointMass = -1.0f);
 
-    virtual void Prepare(const Timestep& step) override;
-    virtual void SolveVelocityConstraints(const Timestep& step) override;
+    virtual void Prepare(const Timestep& step, const SolverBodies& bodies) override;
+    virtual void WarmStart(SolverBodies& bodies) override;
+    virtual void SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies) override;
 
     float GetAngleOffset() const;
 
@@ -24,7 +25,7 @@ private:
     float bias;
     float impulseSum;
 
-    void ApplyImpulse(float lambda);
+    void ApplyImpulse(SolverBodies& bodies, float lambda);
 };
 
 inline float AngleJoint::GetAngleOffset() const
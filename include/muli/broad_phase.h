@@ -3,51 +3,109 @@
 #include "aabb.h"
 #include "aabb_tree.h"
 #include "common.h"
+#include "growable_array.h"
 
 namespace muli
 {
 class ContactManager;
 
+// Pair of overlapping proxy keys found by the broad phase (proxyA < proxyB)
+struct ProxyPair
+{
+    NodeProxy proxyA;
+    NodeProxy proxyB;
+};
+
+typedef GrowableArray<ProxyPair, 64> PairBuffer;
+
+// Collider overlapping a box of a batched query, queryIndex is the position of the box in the queried span
+struct QueryHit
+{
+    int32 queryIndex;
+    Collider* collider;
+};
+
+typedef GrowableArray<QueryHit, 64> QueryHitBuffer;
+
+// Interface of the broad phase backends, see BroadPhaseType
+// The backend owns the proxies of the colliders and reports the newly overlapping proxy pairs
 class BroadPhase
 {
 public:
     BroadPhase(World* world, ContactManager* contactManager);
-    ~BroadPhase();
+    virtual ~BroadPhase() noexcept = default;
 
-    void FindNewContacts();
-    bool TestOverlap(Collider* colliderA, Collider* colliderB) const;
+    BroadPhase(const BroadPhase&) noexcept = delete;
+    BroadPhase& operator=(const BroadPhase&) noexcept = delete;
 
-    void Add(Collider* collider, const AABB& aabb);
-    void Remove(Collider* collider);
-    void Update(Collider* collider, const AABB& aabb, const Vec2& displacement);
-    void Refresh(Collider* collider);
+    virtual void FindNewContacts() = 0;
+    virtual bool TestOverlap(Collider* colliderA, Collider* colliderB) const = 0;
 
-    bool QueryCallback(NodeProxy node, Collider* collider);
+    virtual void Add(Collider* collider, const AABB& aabb) = 0;
 
-protected:
-    friend class World;
+    // Add the colliders at once, backends able to build their structure in bulk override this
+    virtual void BulkAdd(std::span<Collider*> colliders, std::span<const AABB> aabbs);
+    virtual void Remove(Collider* collider) = 0;
+
+    // Remove the colliders at once, backends able to remove in bulk override this
+    virtual void BulkRemove(std::span<Collider*> colliders);
+    virtual void Update(Collider* collider, const AABB& aabb, const Vec2& displacement) = 0;
+    virtual void Refresh(Collider* collider) = 0;
+
+    virtual void Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const = 0;
+    virtual void Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const = 0;
+    virtual void AABBCast(const AABBCastInput& input,
+                          const std::function<float(const AABBCastInput&, Collider*)>& callback) const = 0;
 
+    // Append a hit to the buffer for each proxy overlapping each box, backends able to share the traversals override this
+    // Safe to call from several threads at once with different buffers
+    virtual void Query(std::span<const AABB> aabbs, QueryHitBuffer& hits) const;
+
+    // Cast the rays at once, the callback gets the index of the ray in the span
+    // Backends able to share the traversals between the nearby rays override this
+    virtual void AABBCast(std::span<const AABBCastInput> inputs,
+                          const std::function<float(int32, const AABBCastInput&, Collider*)>& callback) const;
+
+    // The callback interface is the same as the one of AABBTree
+    template <typename T>
+    void Query(const Vec2& point, T* callback) const;
+    template <typename T>
+    void Query(const AABB& aabb, T* callback) const;
+    template <typename T>
+    void AABBCast(const AABBCastInput& input, T* callback) const;
+
+protected:
     World* world;
     ContactManager* contactManager;
-    AABBTree tree;
 
-private:
-    NodeProxy* moveBuffer;
-    int32 moveCapacity;
-    int32 moveCount;
+    virtual Collider* GetCollider(NodeProxy proxy) const = 0;
 
-    NodeProxy nodeA;
-    RigidBody* bodyA;
-    Collider* colliderA;
-    Shape::Type typeA;
+    // Sort the pairs so the result doesn't depend on the reporting order, then create the contacts
+    // Duplicated pairs are skipped and the buffer is cleared
+    void CreateContacts(PairBuffer& pairs);
 
-    void BufferMove(NodeProxy node);
-    void UnBufferMove(NodeProxy node);
+    // Shrink the fat aabb once the body comes to rest
+    bool HasJustRested(const Collider* collider) const;
 };
 
-inline bool BroadPhase::TestOverlap(Collider* _colliderA, Collider* _colliderB) const
+template <typename T>
+void BroadPhase::Query(const Vec2& point, T* callback) const
+{
+    Query(point, [callback](NodeProxy node, Collider* collider) -> bool { return callback->QueryCallback(node, collider); });
+}
+
+template <typename T>
+void BroadPhase::Query(const AABB& aabb, T* callback) const
+{
+    Query(aabb, [callback](NodeProxy node, Collider* collider) -> bool { return callback->QueryCallback(node, collider); });
+}
+
+template <typename T>
+void BroadPhase::AABBCast(const AABBCastInput& input, T* callback) const
 {
-    return tree.TestOverlap(_colliderA->node, _colliderB->node);
+    AABBCast(input, [callback](const AABBCastInput& subInput, Collider* collider) -> float {
+        return callback->AABBCastCallback(subInput, collider);
+    });
 }
 
-} // namespace muli
\ No newline at end of file
+} // namespace muli
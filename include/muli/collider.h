@@ -66,10 +66,12 @@ private:
     friend class RigidBody;
     friend class AABBTree;
     friend class BroadPhase;
+    friend class TreeBroadPhase;
+    friend class SAPBroadPhase;
+    friend class GridBroadPhase;
     friend class Contact;
     friend class ContactManager;
     friend class World;
-    friend class ContactSolver;
 
     Collider();
     ~Collider();
@@ -87,7 +89,8 @@ private:
     Material material;
     CollisionFilter filter;
 
-    NodeProxy node;
+    // Broad phase proxy key
+    NodeProxy proxy;
 
     bool enabled;
 };
@@ -4,11 +4,13 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <concepts>
 #include <cstring>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <new>
 #include <numeric>
 #include <span>
 #include <string>
@@ -36,4 +38,14 @@ inline void Free(void* mem)
     std::free(mem);
 }
 
+inline void* AlignedAlloc(int32 size, int32 alignment)
+{
+    return ::operator new(size, std::align_val_t(alignment));
+}
+
+inline void AlignedFree(void* mem, int32 alignment)
+{
+    ::operator delete(mem, std::align_val_t(alignment));
+}
+
 } // namespace muli
\ No newline at end of file
@@ -8,6 +8,41 @@ namespace muli
 
 struct Timestep;
 
+// Packed velocity state of the bodies being solved, built per island
+// Constraints access the arrays through their solver indices (indexA, indexB)
+struct SolverBodies
+{
+    Vec2* linearVelocity;
+    float* angularVelocity;
+    float* invMass;
+    float* invInertia;
+};
+
+// Soft constraint coefficients for a given stiffness and time step, used by the soft step solver
+// λ = -massScale · M · (Jv + biasRate·C) - impulseScale · λ'
+// https://box2d.org/posts/2024/02/solver2d/
+struct Softness
+{
+    float biasRate;
+    float massScale;
+    float impulseScale;
+};
+
+inline Softness MakeSoft(float hertz, float dampingRatio, float h)
+{
+    if (hertz == 0.0f)
+    {
+        return Softness{ 0.0f, 1.0f, 0.0f };
+    }
+
+    float omega = 2.0f * pi * hertz;
+    float a1 = 2.0f * dampingRatio + h * omega;
+    float a2 = h * omega * a1;
+    float a3 = 1.0f / (1.0f + a2);
+
+    return Softness{ omega / a1, a2 * a3, a3 };
+}
+
 class Constraint
 {
 public:
@@ -25,7 +60,11 @@ public:
      * Compute Jacobian J and effective mass M
      * M = K^-1 = (J · M^-1 · J^t)^-1
      */
-    virtual void Prepare(const Timestep& step) = 0;
+    virtual void Prepare(const Timestep& step, const SolverBodies& bodies) = 0;
+
+    // Apply the impulses accumulated in the previous step
+    // Prepare() doesn't touch the body velocities, so the constraints can be prepared in parallel
+    virtual void WarmStart(SolverBodies& bodies) = 0;
 
     /*
      * Solve velocity constraint, calculate corrective impulse for current iteration
@@ -41,7 +80,7 @@ public:
      * More reading:
      * https://pybullet.org/Bullet/phpBB3/viewtopic.php?f=4&t=1354
      */
-    virtual void SolveVelocityConstraints(const Timestep& step) = 0;
+    virtual void SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies) = 0;
     virtual bool SolvePositionConstraints(const Timestep& step) = 0;
 
     RigidBody* GetBodyA() const;
@@ -51,6 +90,10 @@ protected:
     RigidBody* bodyA;
     RigidBody* bodyB;
 
+    // Indices into the solver body arrays, assigned by the island before solving
+    int32 indexA;
+    int32 indexB;
+
     float beta;
     float gamma;
 };
@@ -1,16 +1,15 @@
 #pragma once
 
-#include "block_solver.h"
 #include "collision.h"
 #include "constraint.h"
-#include "contact_solver.h"
-#include "position_solver.h"
+#include "wide_contact_solver.h"
 
 namespace muli
 {
 
 class RigidBody;
 class Contact;
+struct PersistentIsland;
 
 struct ContactEdge
 {
@@ -20,6 +19,45 @@ struct ContactEdge
     ContactEdge* next;
 };
 
+// Packed solver data of a contact manifold
+// Holds the normal, tangent and position constraints of the contact points and the 2-contact block solver
+struct ContactConstraint
+{
+    struct Point
+    {
+        // Angular part of the jacobians. The linear part is [-dir, dir]
+        float normalWa;  // -ra × normal
+        float normalWb;  //  rb × normal
+        float tangentWa; // -ra × tangent
+        float tangentWb; //  rb × tangent
+
+        // Effective masses
+        float normalMass;
+        float tangentMass;
+
+        float normalBias; // Restitution
+
+        float normalImpulse = 0.0f;
+        float tangentImpulse = 0.0f;
+        float normalImpulseSave = 0.0f;
+        float tangentImpulseSave = 0.0f;
+
+        // Penetration point in the incident body frame
+        Vec2 localClipPoint;
+    };
+
+    Point points[max_contact_point_count];
+
+    // Reference plane in the reference body frame
+    Vec2 localPlanePoint;
+    Vec2 localNormal;
+
+    // Block solver
+    Mat2 k;
+    Mat2 m;
+    bool blockSolve;
+};
+
 class Contact : Constraint
 {
 public:
@@ -53,10 +91,12 @@ private:
     friend class World;
     friend class Island;
     friend class ContactManager;
+    friend class IslandManager;
     friend class BroadPhase;
-    friend class ContactSolver;
-    friend class BlockSolver;
-    friend class PositionSolver;
+    friend class TreeBroadPhase;
+    friend class SAPBroadPhase;
+    friend class GridBroadPhase;
+    friend class WideContactSolver;
 
     enum
     {
@@ -66,10 +106,17 @@ private:
         flag_toi = 1 << 3,
     };
 
-    virtual void Prepare(const Timestep& step) override;
-    virtual void SolveVelocityConstraints(const Timestep& step) override;
+    virtual void Prepare(const Timestep& step, const SolverBodies& bodies) override;
+    virtual void WarmStart(SolverBodies& bodies) override;
+    virtual void SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies) override;
     virtual bool SolvePositionConstraints(const Timestep& step) override;
     bool SolveTOIPositionConstraints();
+    bool SolvePositionConstraints(float correction, float maxCorrection, float threshold, bool toi);
+    void SolveBlockConstraints(SolverBodies& bodies, const Vec2& bias, float massScale = 1.0f, float impulseScale = 0.0f);
+
+    // Soft step solver
+    void SolveSoftConstraints(const Timestep& step, SolverBodies& bodies, const Softness& softness, bool useBias);
+    void ApplyRestitution(SolverBodies& bodies);
 
     void Update();
 
@@ -81,6 +128,10 @@ private:
     RigidBody* b1; // Reference body
     RigidBody* b2; // Incident body
 
+    // Solver indices of the reference and incident body
+    int32 index1;
+    int32 index2;
+
     Collider* colliderA;
     Collider* colliderB;
 
@@ -90,6 +141,11 @@ private:
     ContactEdge nodeA;
     ContactEdge nodeB;
 
+    // Persistent island of the contact while it's touching
+    PersistentIsland* island;
+    Contact* islandPrev;
+    Contact* islandNext;
+
     float friction;
     float restitution;
     float restitutionThreshold;
@@ -97,21 +153,15 @@ private:
 
     ContactManifold manifold;
 
-    // TODO: Integrate decoupled solvers into SolveVelocityConstraints() and SolvePositionConstraints() for optimization
-    ContactSolver normalSolvers[max_contact_point_count];
-    ContactSolver tangentSolvers[max_contact_point_count];
-    PositionSolver positionSolvers[max_contact_point_count];
-    BlockSolver blockSolver;
-
-    // Impulse buffer for position correction
-    // prefix 'c' stands for corrective
-    Vec2 cLinearImpulseA, cLinearImpulseB;
-    float cAngularImpulseA, cAngularImpulseB;
+    ContactConstraint constraint;
 
     uint16 flag;
 
     int32 toiCount;
     float toi;
+
+    // Index into the awake contact array of the contact manager, -1 while both bodies are sleeping
+    int32 awakeIndex;
 };
 
 inline Collider* Contact::GetColliderA() const
@@ -162,13 +212,13 @@ inline int32 Contact::GetContactCount() const
 inline float Contact::GetNormalImpulse(int32 index) const
 {
     muliAssert(index == 0 || index == 1);
-    return normalSolvers[index].impulse;
+    return constraint.points[index].normalImpulse;
 }
 
 inline float Contact::GetTangentImpulse(int32 index) const
 {
     muliAssert(index == 0 || index == 1);
-    return tangentSolvers[index].impulse;
+    return constraint.points[index].tangentImpulse;
 }
 
 inline float Contact::GetFriction() const
@@ -212,10 +262,11 @@ inline void Contact::SaveImpulses()
 {
     for (int32 i = 0; i < manifold.contactCount; ++i)
     {
-        normalSolvers[i].impulseSave = normalSolvers[i].impulse;
-        tangentSolvers[i].impulseSave = tangentSolvers[i].impulse;
-        normalSolvers[i].impulse = 0.0f;
-        tangentSolvers[i].impulse = 0.0f;
+        ContactConstraint::Point& cp = constraint.points[i];
+        cp.normalImpulseSave = cp.normalImpulse;
+        cp.tangentImpulseSave = cp.tangentImpulse;
+        cp.normalImpulse = 0.0f;
+        cp.tangentImpulse = 0.0f;
     }
 }
 
@@ -223,8 +274,9 @@ inline void Contact::RestoreImpulses()
 {
     for (int32 i = 0; i < manifold.contactCount; ++i)
     {
-        normalSolvers[i].impulse = normalSolvers[i].impulseSave;
-        tangentSolvers[i].impulse = tangentSolvers[i].impulseSave;
+        ContactConstraint::Point& cp = constraint.points[i];
+        cp.normalImpulse = cp.normalImpulseSave;
+        cp.tangentImpulse = cp.tangentImpulseSave;
     }
 }
 
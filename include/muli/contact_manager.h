@@ -1,7 +1,11 @@
 #pragma once
 
 #include "broad_phase.h"
+#include "grid_broad_phase.h"
+#include "sap_broad_phase.h"
+#include "tree_broad_phase.h"
 #include "contact.h"
+#include "pair_set.h"
 
 namespace muli
 {
@@ -23,29 +27,62 @@ protected:
 
     void AddCollider(Collider* collider);
     void RemoveCollider(Collider* collider);
+
+    // Take the colliders out of the broad phase at once, RemoveCollider() only destroys their contacts until EndBulkRemove()
+    void BeginBulkRemove(std::span<Collider*> colliders);
+    void EndBulkRemove();
+
+    void InsertPendingColliders();
     void UpdateCollider(Collider* collider, const Transform& tf);
     void UpdateCollider(Collider* collider, const Transform& tf0, const Transform& tf1);
 
 private:
     friend class World;
     friend class BroadPhase;
+    friend class TreeBroadPhase;
+    friend class SAPBroadPhase;
+    friend class GridBroadPhase;
+    friend class IslandManager;
 
     World* world;
 
-    BroadPhase broadPhase;
+    std::unique_ptr<BroadPhase> broadPhase;
+
+    // Colliders added while bulk inserting wait here without a proxy, see World::BeginBulkInsert()
+    bool bulkInsert;
+    std::vector<Collider*> pendingColliders;
+
+    bool bulkRemove;
 
     Contact* contactList;
     int32 contactCount;
 
+    // Collider pairs of the existing contacts
+    PairSet pairSet;
+
+    // Contacts with at least one body on an awake island
+    // Per-step loops walk this array so sleeping contacts cost nothing
+    Contact** awakeContacts;
+    int32 awakeContactCapacity;
+    int32 awakeContactCount;
+
     void Destroy(Contact* c);
     void OnNewContact(Collider*, Collider*);
+
+    bool IsAwake(Contact* c) const;
+    void AddAwakeContact(Contact* c);
+    void RemoveAwakeContact(Contact* c);
+
+    // Called by the island manager when the island of the body wakes up or falls asleep
+    void WakeContacts(RigidBody* body);
+    void SleepContacts(RigidBody* body);
 };
 
 inline void ContactManager::UpdateContactGraph()
 {
     // Find new contacts for moved objects
     // broadphase will callback OnNewContact(Collider*, Collider*)
-    broadPhase.FindNewContacts();
+    broadPhase->FindNewContacts();
 }
 
 inline int32 ContactManager::GetContactCount() const
@@ -18,8 +18,9 @@ public:
                   float dampingRatio = 1.0f,
                   float jointMass = 1.0f);
 
-    virtual void Prepare(const Timestep& step) override;
-    virtual void SolveVelocityConstraints(const Timestep& step) override;
+    virtual void Prepare(const Timestep& step, const SolverBodies& bodies) override;
+    virtual void WarmStart(SolverBodies& bodies) override;
+    virtual void SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies) override;
 
     const Vec2& GetLocalAnchorA() const;
     const Vec2& GetLocalAnchorB() const;
@@ -39,7 +40,7 @@ private:
     float bias;
     float impulseSum;
 
-    void ApplyImpulse(float lambda);
+    void ApplyImpulse(SolverBodies& bodies, float lambda);
 };
 
 inline const Vec2& DistanceJoint::GetLocalAnchorA() const
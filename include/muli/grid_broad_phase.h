@@ -0,0 +1,133 @@
+#pragma once
+
+#include "broad_phase.h"
+
+namespace muli
+{
+
+// Uniform grid stored in a spatial hash, see WorldSettings::grid_cell_size
+// Each proxy is inserted into the cells its fat aabb covers, so inserting and moving a proxy costs O(1) for colliders
+// of about the cell size and the neighbors are enumerated from a few small contiguous buckets without any tree rotation
+// Proxies covering more than grid_large_proxy_cells cells (grounds, walls) are kept in a separate list and tested linearly
+class GridBroadPhase : public BroadPhase
+{
+public:
+    GridBroadPhase(World* world, ContactManager* contactManager);
+    ~GridBroadPhase() noexcept;
+
+    virtual void FindNewContacts() override;
+    virtual bool TestOverlap(Collider* colliderA, Collider* colliderB) const override;
+
+    virtual void Add(Collider* collider, const AABB& aabb) override;
+    virtual void Remove(Collider* collider) override;
+    virtual void Update(Collider* collider, const AABB& aabb, const Vec2& displacement) override;
+    virtual void Refresh(Collider* collider) override;
+
+    virtual void Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const override;
+    virtual void Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const override;
+    virtual void AABBCast(const AABBCastInput& input,
+                          const std::function<float(const AABBCastInput&, Collider*)>& callback) const override;
+
+protected:
+    virtual Collider* GetCollider(NodeProxy proxy) const override;
+
+private:
+    // Inclusive range of cell coordinates
+    struct CellRange
+    {
+        int32 minX, minY;
+        int32 maxX, maxY;
+    };
+
+    struct Proxy
+    {
+        AABB aabb; // Fattened aabb
+        CellRange cells;
+
+        Collider* collider;
+        int32 next; // Free list
+
+        int32 largeIndex; // Index in the large proxy list, -1 if the proxy is in the grid
+        bool moved;
+    };
+
+    typedef GrowableArray<NodeProxy, 4> Bucket;
+
+    float cellSize;
+    float invCellSize;
+
+    Proxy* proxies;
+    int32 proxyCapacity;
+    int32 proxyCount;
+    int32 freeList;
+
+    // Power of two number of buckets, cells are hashed into them
+    std::unique_ptr<Bucket[]> buckets;
+    int32 bucketCount;
+    int32 cellEntryCount;
+
+    GrowableArray<NodeProxy, 16> largeProxies;
+
+    GrowableArray<NodeProxy, 64> moveBuffer;
+
+    // Candidate pairs collected by each thread while querying the moved proxies
+    std::unique_ptr<PairBuffer[]> pairBuffers;
+    int32 pairBufferCount;
+
+    int32 AllocateProxy();
+    void FreeProxy(NodeProxy proxy);
+
+    int32 GetCellCoord(float v) const;
+    CellRange GetCellRange(const AABB& aabb) const;
+    Bucket& GetBucket(int32 x, int32 y) const;
+
+    static bool IsLarge(const CellRange& cells);
+
+    void InsertProxy(NodeProxy proxy);
+    void RemoveProxy(NodeProxy proxy);
+    void GrowBuckets();
+
+    void BufferMove(NodeProxy proxy);
+
+    // Call the function for the proxies overlapping the aabb until it returns false
+    // Returns false if the function stopped the query
+    template <typename F>
+    bool ForEachOverlap(const AABB& aabb, F&& function) const;
+};
+
+inline int32 GridBroadPhase::GetCellCoord(float v) const
+{
+    // Keep far away coordinates in the integer range, proxies that far away are in the large proxy list anyway
+    return int32(Clamp(Floor(v * invCellSize), -1e9f, 1e9f));
+}
+
+inline GridBroadPhase::CellRange GridBroadPhase::GetCellRange(const AABB& aabb) const
+{
+    return CellRange{ GetCellCoord(aabb.min.x), GetCellCoord(aabb.min.y), GetCellCoord(aabb.max.x), GetCellCoord(aabb.max.y) };
+}
+
+inline GridBroadPhase::Bucket& GridBroadPhase::GetBucket(int32 x, int32 y) const
+{
+    uint32 h = (uint32(x) * 73856093u) ^ (uint32(y) * 19349663u);
+    return buckets[h & (bucketCount - 1)];
+}
+
+inline bool GridBroadPhase::IsLarge(const CellRange& cells)
+{
+    int64 w = int64(cells.maxX) - cells.minX + 1;
+    int64 h = int64(cells.maxY) - cells.minY + 1;
+
+    return w * h > grid_large_proxy_cells;
+}
+
+inline bool GridBroadPhase::TestOverlap(Collider* _colliderA, Collider* _colliderB) const
+{
+    return proxies[_colliderA->proxy].aabb.TestOverlap(proxies[_colliderB->proxy].aabb);
+}
+
+inline Collider* GridBroadPhase::GetCollider(NodeProxy proxy) const
+{
+    return proxies[proxy].collider;
+}
+
+} // namespace muli
@@ -10,7 +10,7 @@ class Island
 private:
     friend class World;
 
-    Island(World* world, int32 bodyCapacity, int32 contactCapacity, int32 jointCapacity);
+    Island(World* world, LinearAllocator* allocator, int32 bodyCapacity, int32 contactCapacity, int32 jointCapacity);
     ~Island();
 
     void Add(RigidBody* body);
@@ -21,7 +21,45 @@ private:
     void SolveTOI(float dt);
     void Clear();
 
+    // Pack the velocities and masses of the bodies into the solver arrays and assign the constraint solver indices
+    void BuildSolverBodies();
+    void StoreSolverBodies();
+    void FreeSolverBodies();
+
+    // Partition the constraints so that no non-static body appears twice within a color
+    void BuildColors();
+    void FreeColors();
+
+    template <typename T>
+    void ColorConstraints(T** constraints, int32 count, T** colored, int32* colorOffsets);
+
+    template <typename T, typename F>
+    void SolveColored(T** constraints, const int32* colorOffsets, F&& function);
+
+    // Call the function with chunks of [0, count) on the thread pool if the island is solved in parallel
+    template <typename F>
+    void ParallelFor(int32 count, F&& function);
+
+    // Pack the colored contacts into bundles of simd_width contacts
+    void BuildWideSolvers();
+    void FreeWideSolvers();
+    void SolveWideContacts(const Timestep& step);
+
+    // Largest body velocity change since the last call, used to stop the velocity iterations early
+    float MeasureVelocityChange();
+
+    // Call the function for every constraint backward, or color by color if the island is solved in parallel
+    template <typename F>
+    void ForEachContact(F&& function);
+    template <typename F>
+    void ForEachJoint(F&& function);
+
+    void SolveSoftStep();
+    void IntegrateVelocities(const Timestep& subStep);
+    void IntegratePositions(const Timestep& subStep);
+
     World* world;
+    LinearAllocator* allocator;
 
     // Static body is not included
     RigidBody** bodies;
@@ -35,7 +73,33 @@ private:
     int32 contactCount;
     int32 jointCount;
 
+    // Colored constraints are solved in parallel color by color
+    // The last color holds the overflowed constraints, which are solved serially
+    Contact** coloredContacts;
+    Joint** coloredJoints;
+    int32 contactColorOffsets[graph_color_count + 2];
+    int32 jointColorOffsets[graph_color_count + 2];
+
+    // Island bodies come first in the same order as the bodies array, followed by one slot per static body reference
+    SolverBodies solverBodies;
+    int32 solverBodyCapacity;
+
+    // Bundles are grouped by color, the overflowed contacts are solved with the scalar solver
+    WideContactSolver* wideSolvers;
+    int32 wideSolverCount;
+    int32 wideColorOffsets[graph_color_count + 1];
+
+    // Velocities at the last MeasureVelocityChange() call
+    Vec2* savedLinearVelocity;
+    float* savedAngularVelocity;
+
+    // Iterations actually used by the last Solve()
+    int32 velocityIterations;
+    int32 positionIterations;
+
     bool sleeping;
+    bool parallel;
+    bool wide;
 };
 
 inline void Island::Add(RigidBody* body)
@@ -64,6 +128,8 @@ inline void Island::Clear()
     jointCount = 0;
 
     sleeping = false;
+    parallel = false;
+    wide = false;
 }
 
 } // namespace muli
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+
+namespace muli
+{
+
+class World;
+class RigidBody;
+class Contact;
+class Joint;
+
+// Connected component of the constraint graph that persists across the steps
+// Non-static bodies, touching contacts and joints are linked into the island they belong to
+struct PersistentIsland
+{
+    PersistentIsland* prev;
+    PersistentIsland* next;
+
+    // Members are kept in the order they joined the island
+    RigidBody* bodyList;
+    RigidBody* bodyListTail;
+    Contact* contactList;
+    Contact* contactListTail;
+    Joint* jointList;
+    Joint* jointListTail;
+
+    int32 bodyCount;
+    int32 contactCount;
+    int32 jointCount;
+
+    // Number of constraints removed since the last split, the island may be disconnected if it's non-zero
+    int32 constraintRemoveCount;
+
+    bool sleeping;
+};
+
+// Maintains the islands incrementally instead of rebuilding them with a graph search every step
+// Islands are merged (union by size) when a contact begins touching or a joint is created,
+// and split lazily only when an island that lost constraints tries to fall asleep
+class IslandManager
+{
+public:
+    IslandManager(World* world);
+    ~IslandManager();
+
+    PersistentIsland* GetAwakeIslandList() const;
+    int32 GetAwakeIslandCount() const;
+    int32 GetSleepingBodyCount() const;
+
+protected:
+    friend class World;
+    friend class RigidBody;
+    friend class ContactManager;
+    friend class Contact;
+
+    void AddBody(RigidBody* body);
+    void RemoveBody(RigidBody* body);
+    void AddContact(Contact* contact);
+    void RemoveContact(Contact* contact);
+    void AddJoint(Joint* joint);
+    void RemoveJoint(Joint* joint);
+
+    void Wake(PersistentIsland* island);
+    void Sleep(PersistentIsland* island);
+
+    // Split the island into its connected components
+    // The first component keeps the island, the others are inserted right after it in the awake list
+    void Split(PersistentIsland* island);
+
+private:
+    World* world;
+
+    PersistentIsland* awakeList;
+    PersistentIsland* sleepingList;
+    int32 awakeIslandCount;
+    int32 sleepingBodyCount;
+
+    PersistentIsland* CreateIsland();
+    void DestroyIsland(PersistentIsland* island);
+    PersistentIsland* Merge(PersistentIsland* islandA, PersistentIsland* islandB);
+
+    void LinkBody(PersistentIsland* island, RigidBody* body);
+    void LinkContact(PersistentIsland* island, Contact* contact);
+    void LinkJoint(PersistentIsland* island, Joint* joint);
+
+    void InsertAfter(PersistentIsland** list, PersistentIsland* after, PersistentIsland* island);
+    void Remove(PersistentIsland** list, PersistentIsland* island);
+};
+
+inline PersistentIsland* IslandManager::GetAwakeIslandList() const
+{
+    return awakeList;
+}
+
+inline int32 IslandManager::GetAwakeIslandCount() const
+{
+    return awakeIslandCount;
+}
+
+inline int32 IslandManager::GetSleepingBodyCount() const
+{
+    return sleepingBodyCount;
+}
+
+} // namespace muli
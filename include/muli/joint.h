@@ -8,6 +8,7 @@ namespace muli
 
 class Joint;
 class JointDestroyCallback;
+struct PersistentIsland;
 
 struct JointEdge
 {
@@ -53,6 +54,8 @@ class Joint : public Constraint
      * https://pybullet.org/Bullet/phpBB3/viewtopic.php?f=4&t=1354
      */
     friend class World;
+    friend class Island;
+    friend class IslandManager;
 
 public:
     enum Type : uint8
@@ -124,6 +127,10 @@ private:
     JointEdge nodeA;
     JointEdge nodeB;
 
+    PersistentIsland* island;
+    Joint* islandPrev;
+    Joint* islandNext;
+
     bool flagIsland;
 };
 
@@ -22,11 +22,15 @@ public:
     int32 GetAllocation() const;
     int32 GetMaxAllocation() const;
 
+    // Every returned block is aligned to this boundary, so SIMD and pointer-sized data can be placed in it
+    static constexpr inline int32 alignment = 16;
+
 private:
     struct MemoryEntry
     {
         int8* data;
         int32 size;
+        int32 alignedSize;
         bool mallocUsed;
     };
 
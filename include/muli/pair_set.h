@@ -0,0 +1,88 @@
+#pragma once
+
+#include "common.h"
+
+namespace muli
+{
+
+// Open addressing hash set of unordered pointer pairs
+// Linear probing with backward shift deletion, so the table never fills up with tombstones
+class PairSet
+{
+public:
+    PairSet(int32 initialCapacity = 256);
+    ~PairSet();
+
+    PairSet(const PairSet&) noexcept = delete;
+    PairSet& operator=(const PairSet&) noexcept = delete;
+
+    // Returns false if the pair is already in the set
+    bool Add(const void* a, const void* b);
+
+    // Returns false if the pair is not in the set
+    bool Remove(const void* a, const void* b);
+
+    bool Contains(const void* a, const void* b) const;
+
+    int32 GetCount() const;
+    int32 GetCapacity() const;
+
+private:
+    struct Entry
+    {
+        uint64 key1;
+        uint64 key2;
+    };
+
+    static uint32 Hash(uint64 key1, uint64 key2);
+    static void MakeKey(const void* a, const void* b, uint64* key1, uint64* key2);
+
+    int32 Find(uint64 key1, uint64 key2) const;
+    void Grow();
+
+    // Empty slots hold a zero key1, a valid pair never contains a null pointer
+    Entry* entries;
+    int32 capacity;
+    int32 count;
+};
+
+inline void PairSet::MakeKey(const void* a, const void* b, uint64* key1, uint64* key2)
+{
+    uint64 ka = uint64(uintptr_t(a));
+    uint64 kb = uint64(uintptr_t(b));
+
+    *key1 = Min(ka, kb);
+    *key2 = Max(ka, kb);
+}
+
+inline uint32 PairSet::Hash(uint64 key1, uint64 key2)
+{
+    // Mix the keys with the 64 bit finalizer of MurmurHash3
+    uint64 h = key1 * 0x9E3779B97F4A7C15ull ^ key2;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return uint32(h);
+}
+
+inline bool PairSet::Contains(const void* a, const void* b) const
+{
+    uint64 key1, key2;
+    MakeKey(a, b, &key1, &key2);
+
+    return entries[Find(key1, key2)].key1 != 0;
+}
+
+inline int32 PairSet::GetCount() const
+{
+    return count;
+}
+
+inline int32 PairSet::GetCapacity() const
+{
+    return capacity;
+}
+
+} // namespace muli
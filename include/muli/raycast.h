@@ -21,6 +21,15 @@ struct RayCastOutput
     float fraction;
 };
 
+// Closest hit of a ray of a batched ray cast, collider is nullptr if the ray hit nothing
+struct RayCastHit
+{
+    class Collider* collider;
+    Vec2 point;
+    Vec2 normal;
+    float fraction;
+};
+
 struct ShapeCastInput
 {
     class Shape* shapeA;
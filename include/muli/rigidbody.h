@@ -15,6 +15,7 @@ class Shape;
 struct Node;
 struct ContactEdge;
 struct JointEdge;
+struct PersistentIsland;
 class RayCastAnyCallback;
 class RayCastClosestCallback;
 class BodyDestroyCallback;
@@ -170,17 +171,18 @@ public:
 protected:
     friend class World;
     friend class Island;
+    friend class IslandManager;
 
     friend class AABBTree;
     friend class BroadPhase;
+    friend class TreeBroadPhase;
+    friend class SAPBroadPhase;
+    friend class GridBroadPhase;
     friend class ContactManager;
 
     friend class Collider;
 
     friend class Contact;
-    friend class ContactSolver;
-    friend class BlockSolver;
-    friend class PositionSolver;
 
     friend class Joint;
     friend class GrabJoint;
@@ -244,6 +246,11 @@ private:
     ContactEdge* contactList;
     JointEdge* jointList;
 
+    // Persistent island this body belongs to, nullptr for static bodies
+    PersistentIsland* island;
+    RigidBody* islandPrev;
+    RigidBody* islandNext;
+
     float resting;
 };
 
@@ -622,17 +629,6 @@ inline bool RigidBody::IsSleeping() const
     return (flag & flag_sleeping) == flag_sleeping;
 }
 
-inline void RigidBody::Awake()
-{
-    if (type == Type::static_body)
-    {
-        return;
-    }
-
-    resting = 0.0f;
-    flag &= ~flag_sleeping;
-}
-
 inline void RigidBody::Sleep()
 {
     if (type == Type::static_body)
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "broad_phase.h"
+
+namespace muli
+{
+
+// Incremental sweep and prune on both axes
+// The endpoints of the fat boxes are kept sorted along each axis and a moved box is sorted back into place with insertion sort,
+// so the cost of a move is proportional to the number of endpoints it passes, which is small for temporally coherent motion
+// A pair is reported when a min endpoint passes a max endpoint and the boxes overlap
+// Queries scan the sorted x endpoints, use the tree broad phase for query heavy scenes
+class SAPBroadPhase : public BroadPhase
+{
+public:
+    SAPBroadPhase(World* world, ContactManager* contactManager);
+    ~SAPBroadPhase() noexcept;
+
+    virtual void FindNewContacts() override;
+    virtual bool TestOverlap(Collider* colliderA, Collider* colliderB) const override;
+
+    virtual void Add(Collider* collider, const AABB& aabb) override;
+    virtual void Remove(Collider* collider) override;
+    virtual void Update(Collider* collider, const AABB& aabb, const Vec2& displacement) override;
+    virtual void Refresh(Collider* collider) override;
+
+    virtual void Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const override;
+    virtual void Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const override;
+    virtual void AABBCast(const AABBCastInput& input,
+                          const std::function<float(const AABBCastInput&, Collider*)>& callback) const override;
+
+protected:
+    virtual Collider* GetCollider(NodeProxy proxy) const override;
+
+private:
+    struct Box
+    {
+        AABB aabb; // Fattened aabb
+        int32 min[2];
+        int32 max[2];
+
+        Collider* collider;
+        int32 next;
+    };
+
+    struct EndPoint
+    {
+        float value;
+        int32 data; // box << 1 | isMax
+
+        int32 GetBox() const;
+        bool IsMax() const;
+    };
+
+    Box* boxes;
+    int32 boxCapacity;
+    int32 boxCount;
+    int32 freeList;
+
+    // Sorted endpoints of the x and y axes
+    EndPoint* endPoints[2];
+    int32 endPointCount;
+
+    // Pairs reported while sorting, turned into contacts by FindNewContacts()
+    PairBuffer pairs;
+
+    int32 AllocateBox();
+    void FreeBox(int32 box);
+
+    // Move the endpoint to its sorted position, reporting the pairs that start to overlap
+    void SortDown(int32 axis, int32 index, bool report);
+    void SortUp(int32 axis, int32 index, bool report);
+    void ReportPair(int32 boxA, int32 boxB);
+
+    void SetBounds(int32 box, const AABB& aabb);
+
+    // Call the function for the boxes overlapping the aabb until it returns false
+    template <typename F>
+    void ForEachOverlap(const AABB& aabb, F&& function) const;
+};
+
+inline int32 SAPBroadPhase::EndPoint::GetBox() const
+{
+    return data >> 1;
+}
+
+inline bool SAPBroadPhase::EndPoint::IsMax() const
+{
+    return (data & 1) != 0;
+}
+
+inline bool SAPBroadPhase::TestOverlap(Collider* _colliderA, Collider* _colliderB) const
+{
+    return boxes[_colliderA->proxy].aabb.TestOverlap(boxes[_colliderB->proxy].aabb);
+}
+
+inline Collider* SAPBroadPhase::GetCollider(NodeProxy proxy) const
+{
+    return boxes[proxy].collider;
+}
+
+} // namespace muli
@@ -18,6 +18,14 @@ constexpr float toi_position_correction = 0.55f;
 constexpr float max_position_correction = 0.1f;     // meters
 constexpr float max_toi_position_correction = 0.1f; // meters
 
+// Islands having fewer contacts than this are solved with the scalar contact solver
+constexpr int32 simd_contact_threshold = 16;
+
+// Soft step solver settings
+constexpr float contact_hertz = 30.0f;         // Capped to a quarter of the sub step rate
+constexpr float contact_damping_ratio = 10.0f; // Heavily over-damped to avoid bouncing
+constexpr float contact_push_velocity = 3.0f;  // Maximum velocity used to push the overlapping bodies apart (m/s)
+
 // Collision detection settings
 constexpr int32 gjk_max_iteration = 20;
 constexpr float gjk_tolerance = epsilon;
@@ -34,6 +42,16 @@ constexpr int32 max_toi_contacts = 32;
 // Broad phase settings
 constexpr Vec2 aabb_margin{ 0.03f };
 constexpr float aabb_multiplier = 3.0f;
+// Proxies covering more cells than this are kept out of the grid and tested linearly (Grid broad phase only)
+constexpr int32 grid_large_proxy_cells = 16;
+// Steps between two checks of the dynamic tree cost in refit mode, each check is a pass over the whole tree
+constexpr int32 tree_refit_check_interval = 16;
+
+// Parallel solver settings
+// Islands having at least this many constraints are partitioned with graph coloring and solved in parallel
+constexpr int32 graph_coloring_threshold = 256;
+constexpr int32 graph_color_count = 12;
+constexpr int32 parallel_grain_size = 64;
 
 // Default body/collider settings
 
@@ -60,10 +78,36 @@ constexpr float default_joint_mass = 1.0f;
 // Exceeding this limit allocates polygon vertices on the heap.
 constexpr int32 max_local_polygon_vertices = 8;
 
+enum class SolverType : uint8
+{
+    // Velocity iterations of sequential impulses followed by the position iterations
+    sequential_impulse,
+    // Soft contact constraints solved in sub steps, each followed by a relax iteration without bias (See Box2D v3)
+    // Position iterations are not used
+    soft_step,
+};
+
+enum class BroadPhaseType : uint8
+{
+    // Dynamic aabb trees, one for the static colliders and one for the others
+    aabb_tree,
+    // Incremental sweep and prune on the x and y axes
+    // Cheap updates for many small coherently moving bodies, queries scan the sorted endpoints
+    sweep_and_prune,
+    // Spatial hash of uniform cells, see WorldSettings::grid_cell_size
+    // Dense scenes of many colliders of about the same size in a bounded area
+    uniform_grid,
+};
+
 struct Timestep
 {
-    int32 velocity_iterations = 8;
+    int32 velocity_iterations = 8; // Per island cap if velocity_tolerance is set
     int32 position_iterations = 3;
+    int32 sub_steps = 4; // Soft step solver only
+
+    // An island stops the velocity iterations once an iteration changes no body velocity more than this (m/s, rad/s)
+    // Resting and lightly loaded islands converge in a few iterations, zero always runs velocity_iterations
+    float velocity_tolerance = 0.0f;
 
     bool warm_starting = true;
     float dt;
@@ -86,6 +130,44 @@ struct WorldSettings
 
     AABB world_bounds{ Vec2{ -max_value, -max_value }, Vec2{ max_value, max_value } };
 
+    // Number of threads used to solve the islands, including the calling thread
+    // This value is read when the world is created
+    int32 worker_count = 1;
+
+    SolverType solver_type = SolverType::sequential_impulse;
+
+    // This value is read when the world is created
+    BroadPhaseType broad_phase_type = BroadPhaseType::aabb_tree;
+
+    // Cell size of the uniform grid broad phase, about twice the typical collider size works well
+    // This value is read when the world is created
+    float grid_cell_size = 1.0f;
+
+    // The aabb tree broad phase rebuilds its dynamic tree top down once the proxies reinserted since the last rebuild
+    // outnumber this times the proxy count, recovering the tree quality lost to heavy churn. Zero disables the rebuild
+    float tree_rebuild_churn = 0.0f;
+
+    // Moved dynamic proxies keep their place in the aabb tree and only enlarge their ancestors, which are tightened
+    // once per step, instead of being reinserted. This is much cheaper for heavy coherent motion. Once the tree cost per
+    // leaf grows past (1 + tree_refit_degradation) times the cost after the last rebuild, the smallest subtree containing
+    // the refitted proxies is rebuilt. The cost is checked every tree_refit_check_interval steps
+    bool tree_refit = false;
+    float tree_refit_degradation = 0.5f;
+
+    // Every step the aabb tree broad phase reinserts up to this many dynamic tree leaves, picked by how much they add to
+    // the tree cost. This keeps the tree quality steady under endless churn without stop the world rebuilds. Zero disables it
+    int32 tree_optimize_budget = 0;
+
+    // The world queries and casts of the aabb tree broad phase traverse 4-ary copies of the trees (see WideTree)
+    // that test four children at a time in SIMD. A copy is updated by the first query after its tree changed,
+    // so this pays off when many queries run between the steps
+    bool wide_tree_queries = false;
+
+    // Solve the contact velocity constraints in SIMD bundles of simd_width contacts
+    // Contact points are solved one by one, so the two-point block solver is not used
+    // Sequential impulse solver only
+    bool simd_contact_solver = false;
+
     mutable Timestep step;
 };
 
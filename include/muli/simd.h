@@ -0,0 +1,213 @@
+#pragma once
+
+#include "common.h"
+
+// Define MULI_NO_SIMD to force the portable scalar implementation
+#if !defined(MULI_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MULI_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define MULI_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace muli
+{
+
+constexpr int32 simd_width = 4;
+
+// Packed floats processed in lock step
+// Min and Max return the second operand on ties, the same way minps/maxps do,
+// so every implementation produces exactly the same bits
+struct FloatW
+{
+#if defined(MULI_SIMD_SSE2)
+    __m128 v;
+#elif defined(MULI_SIMD_NEON)
+    float32x4_t v;
+#else
+    float v[simd_width];
+#endif
+};
+
+inline FloatW LoadW(const float* p)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_loadu_ps(p) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vld1q_f32(p) };
+#else
+    return FloatW{ { p[0], p[1], p[2], p[3] } };
+#endif
+}
+
+inline void StoreW(float* p, const FloatW& a)
+{
+#if defined(MULI_SIMD_SSE2)
+    _mm_storeu_ps(p, a.v);
+#elif defined(MULI_SIMD_NEON)
+    vst1q_f32(p, a.v);
+#else
+    p[0] = a.v[0];
+    p[1] = a.v[1];
+    p[2] = a.v[2];
+    p[3] = a.v[3];
+#endif
+}
+
+inline FloatW SplatW(float s)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_set1_ps(s) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vdupq_n_f32(s) };
+#else
+    return FloatW{ { s, s, s, s } };
+#endif
+}
+
+inline FloatW operator+(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_add_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vaddq_f32(a.v, b.v) };
+#else
+    return FloatW{ { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } };
+#endif
+}
+
+inline FloatW operator-(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_sub_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vsubq_f32(a.v, b.v) };
+#else
+    return FloatW{ { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+#endif
+}
+
+inline FloatW operator*(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_mul_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vmulq_f32(a.v, b.v) };
+#else
+    return FloatW{ { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } };
+#endif
+}
+
+inline FloatW operator-(const FloatW& a)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vnegq_f32(a.v) };
+#else
+    return FloatW{ { -a.v[0], -a.v[1], -a.v[2], -a.v[3] } };
+#endif
+}
+
+inline FloatW& operator+=(FloatW& a, const FloatW& b)
+{
+    a = a + b;
+    return a;
+}
+
+inline FloatW& operator-=(FloatW& a, const FloatW& b)
+{
+    a = a - b;
+    return a;
+}
+
+inline FloatW MinW(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_min_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vbslq_f32(vcltq_f32(a.v, b.v), a.v, b.v) };
+#else
+    return FloatW{ { a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1], a.v[2] < b.v[2] ? a.v[2] : b.v[2],
+                     a.v[3] < b.v[3] ? a.v[3] : b.v[3] } };
+#endif
+}
+
+inline FloatW MaxW(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return FloatW{ _mm_max_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return FloatW{ vbslq_f32(vcgtq_f32(a.v, b.v), a.v, b.v) };
+#else
+    return FloatW{ { a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1], a.v[2] > b.v[2] ? a.v[2] : b.v[2],
+                     a.v[3] > b.v[3] ? a.v[3] : b.v[3] } };
+#endif
+}
+
+// Lane wise comparison results, all bits of a lane are set if the comparison holds
+struct MaskW
+{
+#if defined(MULI_SIMD_SSE2)
+    __m128 v;
+#elif defined(MULI_SIMD_NEON)
+    uint32x4_t v;
+#else
+    uint32 v[simd_width];
+#endif
+};
+
+inline MaskW LessW(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return MaskW{ _mm_cmplt_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return MaskW{ vcltq_f32(a.v, b.v) };
+#else
+    return MaskW{ { a.v[0] < b.v[0] ? ~0u : 0u, a.v[1] < b.v[1] ? ~0u : 0u, a.v[2] < b.v[2] ? ~0u : 0u,
+                    a.v[3] < b.v[3] ? ~0u : 0u } };
+#endif
+}
+
+inline MaskW LessEqualW(const FloatW& a, const FloatW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return MaskW{ _mm_cmple_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return MaskW{ vcleq_f32(a.v, b.v) };
+#else
+    return MaskW{ { a.v[0] <= b.v[0] ? ~0u : 0u, a.v[1] <= b.v[1] ? ~0u : 0u, a.v[2] <= b.v[2] ? ~0u : 0u,
+                    a.v[3] <= b.v[3] ? ~0u : 0u } };
+#endif
+}
+
+inline MaskW operator&(const MaskW& a, const MaskW& b)
+{
+#if defined(MULI_SIMD_SSE2)
+    return MaskW{ _mm_and_ps(a.v, b.v) };
+#elif defined(MULI_SIMD_NEON)
+    return MaskW{ vandq_u32(a.v, b.v) };
+#else
+    return MaskW{ { a.v[0] & b.v[0], a.v[1] & b.v[1], a.v[2] & b.v[2], a.v[3] & b.v[3] } };
+#endif
+}
+
+// Bit i of the result is set if lane i of the mask is set
+inline int32 MoveMaskW(const MaskW& a)
+{
+#if defined(MULI_SIMD_SSE2)
+    return _mm_movemask_ps(a.v);
+#elif defined(MULI_SIMD_NEON)
+    static const uint32 bits[simd_width] = { 1, 2, 4, 8 };
+    uint32x4_t b = vandq_u32(a.v, vld1q_u32(bits));
+    uint32x2_t s = vorr_u32(vget_low_u32(b), vget_high_u32(b));
+    return int32(vget_lane_u32(s, 0) | vget_lane_u32(s, 1));
+#else
+    return int32((a.v[0] & 1) | (a.v[1] & 2) | (a.v[2] & 4) | (a.v[3] & 8));
+#endif
+}
+
+} // namespace muli
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace muli
+{
+
+// Fixed size pool of worker threads used to run independent simulation tasks
+// The calling thread always participates in the work with thread index 0
+class ThreadPool
+{
+public:
+    using Task = std::function<void(int32 begin, int32 end, int32 threadIndex)>;
+
+    ThreadPool(int32 threadCount = 1);
+    ~ThreadPool() noexcept;
+
+    ThreadPool(const ThreadPool&) noexcept = delete;
+    ThreadPool& operator=(const ThreadPool&) noexcept = delete;
+
+    // Split the range [0, count) into chunks of grainSize and run the task over the chunks in parallel.
+    // Blocks until all chunks are processed. threadIndex is in the range [0, GetThreadCount())
+    void ParallelFor(int32 count, int32 grainSize, const Task& task);
+
+    int32 GetThreadCount() const;
+
+private:
+    void WorkerMain(int32 threadIndex);
+    void Execute(int32 threadIndex);
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const Task* task;
+    int32 taskCount;
+    int32 taskGrainSize;
+    std::atomic<int32> nextIndex;
+
+    int32 busyWorkers;
+    uint64 generation;
+    bool terminate;
+};
+
+inline int32 ThreadPool::GetThreadCount() const
+{
+    return int32(workers.size()) + 1;
+}
+
+} // namespace muli
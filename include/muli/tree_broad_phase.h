@@ -0,0 +1,273 @@
+#pragma once
+
+#include "broad_phase.h"
+#include "wide_tree.h"
+
+#include <mutex>
+
+namespace muli
+{
+
+struct TreeStats
+{
+    // Surface area heuristic cost of the dynamic tree, see AABBTree::ComputeTreeCost()
+    // Computed when the stats are read, so the simulation doesn't pay for it every step
+    float dynamicTreeCost;
+    int32 dynamicNodeCount;
+
+    // Leaves reinserted by the tree optimizer in the last step it ran and in total, see WorldSettings::tree_optimize_budget
+    int32 optimizedLeafCount;
+    int64 totalOptimizedLeafCount;
+
+    // Full and partial rebuilds of the dynamic tree triggered by the broad phase so far
+    int32 rebuildCount;
+};
+
+// Static colliders live in their own tree with tight bounds, the other colliders live in the dynamic tree
+// Static proxies are never moved by the simulation, so the static tree keeps the shape it was built with
+// and moved dynamic proxies query both trees while static proxies only query the dynamic tree
+class TreeBroadPhase : public BroadPhase
+{
+public:
+    TreeBroadPhase(World* world, ContactManager* contactManager);
+    ~TreeBroadPhase() noexcept;
+
+    virtual void FindNewContacts() override;
+    virtual bool TestOverlap(Collider* colliderA, Collider* colliderB) const override;
+
+    virtual void Add(Collider* collider, const AABB& aabb) override;
+    virtual void BulkAdd(std::span<Collider*> colliders, std::span<const AABB> aabbs) override;
+    virtual void Remove(Collider* collider) override;
+    virtual void BulkRemove(std::span<Collider*> colliders) override;
+    virtual void Update(Collider* collider, const AABB& aabb, const Vec2& displacement) override;
+    virtual void Refresh(Collider* collider) override;
+
+    virtual void Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const override;
+    virtual void Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const override;
+    virtual void AABBCast(const AABBCastInput& input,
+                          const std::function<float(const AABBCastInput&, Collider*)>& callback) const override;
+
+    // Batched queries and casts always traverse the binary trees in packets, see AABBTree::Query() and AABBTree::AABBCast()
+    virtual void Query(std::span<const AABB> aabbs, QueryHitBuffer& hits) const override;
+    virtual void AABBCast(std::span<const AABBCastInput> inputs,
+                          const std::function<float(int32, const AABBCastInput&, Collider*)>& callback) const override;
+
+    // Same as the virtual queries, but the callback is inlined through the traversals of both trees
+    // The callback interface is the same as the one of AABBTree
+    template <typename T>
+    void Query(const Vec2& point, T* callback) const;
+    template <typename T>
+    void Query(const AABB& aabb, T* callback) const;
+    template <typename T>
+    void AABBCast(const AABBCastInput& input, T* callback) const;
+
+    const TreeStats& GetStats() const;
+
+protected:
+    friend class World;
+
+    AABBTree staticTree;
+    AABBTree dynamicTree;
+
+    // Query copies of the trees, see WorldSettings::wide_tree_queries
+    mutable WideTree staticWideTree;
+    mutable WideTree dynamicWideTree;
+    mutable std::mutex wideTreeMutex;
+
+    virtual Collider* GetCollider(NodeProxy proxy) const override;
+
+private:
+    NodeProxy* moveBuffer;
+    int32 moveCapacity;
+    int32 moveCount;
+
+    // Position of each proxy key in the move buffer, -1 if the proxy isn't buffered
+    int32* moveIndices;
+    int32 moveIndexCapacity;
+
+    // Candidate pairs collected by each thread while querying the moved proxies
+    std::unique_ptr<PairBuffer[]> pairBuffers;
+    int32 pairBufferCount;
+
+    // Dynamic proxies reinserted since the last rebuild, see WorldSettings::tree_rebuild_churn
+    int32 reinsertCount;
+
+    // Dynamic tree cost per leaf after the last rebuild, see WorldSettings::tree_refit
+    float refitBaseCost;
+    int32 refitCheckCounter;
+
+    mutable TreeStats stats;
+
+    void BufferMove(NodeProxy proxy);
+    void UnBufferMove(NodeProxy proxy);
+
+    // The lowest bit of a proxy key tells which tree the node belongs to
+    static NodeProxy MakeProxyKey(NodeProxy node, bool staticProxy);
+    static NodeProxy GetNode(NodeProxy proxy);
+    static bool IsStaticProxy(NodeProxy proxy);
+
+    AABBTree& GetTree(NodeProxy proxy);
+    const AABBTree& GetTree(NodeProxy proxy) const;
+
+    // Bring the wide trees up to date with the trees, false if the world queries should use the trees
+    bool UpdateWideTrees() const;
+};
+
+inline NodeProxy TreeBroadPhase::MakeProxyKey(NodeProxy node, bool staticProxy)
+{
+    return (node << 1) | NodeProxy(staticProxy);
+}
+
+inline NodeProxy TreeBroadPhase::GetNode(NodeProxy proxy)
+{
+    return proxy >> 1;
+}
+
+inline bool TreeBroadPhase::IsStaticProxy(NodeProxy proxy)
+{
+    return (proxy & 1) != 0;
+}
+
+inline AABBTree& TreeBroadPhase::GetTree(NodeProxy proxy)
+{
+    return IsStaticProxy(proxy) ? staticTree : dynamicTree;
+}
+
+inline const AABBTree& TreeBroadPhase::GetTree(NodeProxy proxy) const
+{
+    return IsStaticProxy(proxy) ? staticTree : dynamicTree;
+}
+
+inline bool TreeBroadPhase::TestOverlap(Collider* _colliderA, Collider* _colliderB) const
+{
+    NodeProxy proxyA = _colliderA->proxy;
+    NodeProxy proxyB = _colliderB->proxy;
+
+    return GetTree(proxyA).GetAABB(GetNode(proxyA)).TestOverlap(GetTree(proxyB).GetAABB(GetNode(proxyB)));
+}
+
+inline const TreeStats& TreeBroadPhase::GetStats() const
+{
+    stats.dynamicTreeCost = dynamicTree.ComputeTreeCost();
+    stats.dynamicNodeCount = dynamicTree.GetNodeCount();
+
+    return stats;
+}
+
+inline Collider* TreeBroadPhase::GetCollider(NodeProxy proxy) const
+{
+    return GetTree(proxy).GetData(GetNode(proxy));
+}
+
+template <typename T>
+void TreeBroadPhase::Query(const Vec2& point, T* callback) const
+{
+    struct TempCallback
+    {
+        T* callback;
+        bool proceed;
+
+        bool QueryCallback(NodeProxy node, Collider* collider)
+        {
+            proceed = callback->QueryCallback(node, collider);
+            return proceed;
+        }
+    } tempCallback{ callback, true };
+
+    auto query = [&](const auto& dynamicQueryTree, const auto& staticQueryTree) -> void {
+        dynamicQueryTree.Query(point, &tempCallback);
+
+        if (tempCallback.proceed)
+        {
+            staticQueryTree.Query(point, &tempCallback);
+        }
+    };
+
+    if (UpdateWideTrees())
+    {
+        query(dynamicWideTree, staticWideTree);
+    }
+    else
+    {
+        query(dynamicTree, staticTree);
+    }
+}
+
+template <typename T>
+void TreeBroadPhase::Query(const AABB& aabb, T* callback) const
+{
+    struct TempCallback
+    {
+        T* callback;
+        bool proceed;
+
+        bool QueryCallback(NodeProxy node, Collider* collider)
+        {
+            proceed = callback->QueryCallback(node, collider);
+            return proceed;
+        }
+    } tempCallback{ callback, true };
+
+    auto query = [&](const auto& dynamicQueryTree, const auto& staticQueryTree) -> void {
+        dynamicQueryTree.Query(aabb, &tempCallback);
+
+        if (tempCallback.proceed)
+        {
+            staticQueryTree.Query(aabb, &tempCallback);
+        }
+    };
+
+    if (UpdateWideTrees())
+    {
+        query(dynamicWideTree, staticWideTree);
+    }
+    else
+    {
+        query(dynamicTree, staticTree);
+    }
+}
+
+template <typename T>
+void TreeBroadPhase::AABBCast(const AABBCastInput& input, T* callback) const
+{
+    // Carry the shortened ray over to the second tree
+    struct TempCallback
+    {
+        T* callback;
+        float maxFraction;
+
+        float AABBCastCallback(const AABBCastInput& subInput, Collider* collider)
+        {
+            float newFraction = callback->AABBCastCallback(subInput, collider);
+            if (newFraction >= 0.0f)
+            {
+                maxFraction = newFraction;
+            }
+
+            return newFraction;
+        }
+    } tempCallback{ callback, input.maxFraction };
+
+    auto cast = [&](const auto& dynamicQueryTree, const auto& staticQueryTree) -> void {
+        dynamicQueryTree.AABBCast(input, &tempCallback);
+
+        if (tempCallback.maxFraction > 0.0f)
+        {
+            AABBCastInput staticInput = input;
+            staticInput.maxFraction = tempCallback.maxFraction;
+
+            staticQueryTree.AABBCast(staticInput, &tempCallback);
+        }
+    };
+
+    if (UpdateWideTrees())
+    {
+        cast(dynamicWideTree, staticWideTree);
+    }
+    else
+    {
+        cast(dynamicTree, staticTree);
+    }
+}
+
+} // namespace muli
@@ -16,8 +16,9 @@ public:
               float dampingRatio = 1.0f,
               float jointMass = 1.0f);
 
-    virtual void Prepare(const Timestep& step) override;
-    virtual void SolveVelocityConstraints(const Timestep& step) override;
+    virtual void Prepare(const Timestep& step, const SolverBodies& bodies) override;
+    virtual void WarmStart(SolverBodies& bodies) override;
+    virtual void SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies) override;
 
     const Vec2& GetLocalAnchorA() const;
     const Vec2& GetLocalAnchorB() const;
@@ -37,7 +38,7 @@ private:
     Vec3 bias;
     Vec3 impulseSum;
 
-    void ApplyImpulse(const Vec3& lambda);
+    void ApplyImpulse(SolverBodies& bodies, const Vec3& lambda);
 };
 
 inline const Vec2& WeldJoint::GetLocalAnchorA() const
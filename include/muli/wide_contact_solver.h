@@ -0,0 +1,56 @@
+#pragma once
+
+#include "collision.h"
+#include "common.h"
+#include "simd.h"
+
+namespace muli
+{
+
+class Contact;
+struct SolverBodies;
+
+// Solves the velocity constraints of up to simd_width contacts at once, one contact per lane
+// Contacts in a bundle must not share a non-static body
+class WideContactSolver
+{
+public:
+    void Prepare(Contact** contacts, int32 count, const SolverBodies& bodies);
+    void Solve(SolverBodies& bodies);
+
+    // Write the accumulated impulses back to the contacts for warm starting
+    void StoreImpulses();
+
+private:
+    struct Row
+    {
+        float wa[simd_width]; // -ra × dir
+        float wb[simd_width]; //  rb × dir
+        float m[simd_width];  // effective mass
+        float bias[simd_width];
+        float impulse[simd_width];
+    };
+
+    Contact* contacts[simd_width];
+    int32 count;
+
+    // Solver indices of the reference and incident bodies
+    int32 index1[simd_width];
+    int32 index2[simd_width];
+
+    float invMass1[simd_width];
+    float invInertia1[simd_width];
+    float invMass2[simd_width];
+    float invInertia2[simd_width];
+
+    float normalX[simd_width];
+    float normalY[simd_width];
+    float tangentX[simd_width];
+    float tangentY[simd_width];
+    float friction[simd_width];
+
+    Row normalRows[max_contact_point_count];
+    Row tangentRows[max_contact_point_count];
+};
+
+} // namespace muli
@@ -0,0 +1,288 @@
+#pragma once
+
+#include "aabb_tree.h"
+#include "simd.h"
+
+#include <atomic>
+#include <bit>
+
+namespace muli
+{
+
+// Read only copy of an AABBTree collapsed into a 4-ary tree
+// The children bounds of a node are stored in SoA layout, so the traversals test all four children at once
+// Leaves keep the node proxies of the source tree, and the source tree must outlive the wide tree
+class WideTree
+{
+public:
+    static constexpr inline int32 nullNode = -1;
+    static constexpr inline int32 child_count = simd_width;
+
+    struct Node
+    {
+        float minX[child_count];
+        float minY[child_count];
+        float maxX[child_count];
+        float maxY[child_count];
+
+        // Non-negative children are wide nodes, leaves are stored as the bitwise not of the source node proxy
+        int32 children[child_count];
+        int32 count;
+    };
+
+    WideTree();
+    ~WideTree() noexcept;
+
+    WideTree(const WideTree&) = delete;
+    WideTree& operator=(const WideTree&) = delete;
+
+    // Collapse the tree, the old nodes are reused
+    void Build(const AABBTree& tree);
+
+    // Copy the new bounds of the tree the wide tree was built from, its structure must not have changed since
+    void Refit();
+
+    // Refit if only the bounds of the tree changed since the last build, otherwise build again
+    void Update(const AABBTree& tree);
+
+    // Lock free check, true if the wide tree was built from the current version of the tree
+    bool IsUpToDate(const AABBTree& tree) const;
+
+    template <typename T>
+    void Query(const Vec2& point, T* callback) const;
+    template <typename T>
+    void Query(const AABB& aabb, T* callback) const;
+    template <typename T>
+    void AABBCast(const AABBCastInput& input, T* callback) const;
+
+    int32 GetNodeCount() const;
+
+private:
+    const AABBTree* tree;
+    std::atomic<uint32> version;
+    uint32 structureVersion;
+    bool built;
+
+    int32 root;
+
+    Node* nodes;
+    NodeProxy* sources; // Source node of each child slot
+    int32 nodeCapacity;
+    int32 nodeCount;
+
+    static int32 MakeLeaf(NodeProxy node);
+    static bool IsLeaf(int32 child);
+    static NodeProxy GetLeafNode(int32 child);
+};
+
+inline bool WideTree::IsUpToDate(const AABBTree& other) const
+{
+    return version.load(std::memory_order_acquire) == other.GetVersion() && tree == &other && built;
+}
+
+inline int32 WideTree::GetNodeCount() const
+{
+    return nodeCount;
+}
+
+inline int32 WideTree::MakeLeaf(NodeProxy node)
+{
+    return ~node;
+}
+
+inline bool WideTree::IsLeaf(int32 child)
+{
+    return child < 0;
+}
+
+inline NodeProxy WideTree::GetLeafNode(int32 child)
+{
+    return ~child;
+}
+
+template <typename T>
+void WideTree::Query(const Vec2& point, T* callback) const
+{
+    Query(AABB{ point, point }, callback);
+}
+
+template <typename T>
+void WideTree::Query(const AABB& aabb, T* callback) const
+{
+    if (root == nullNode)
+    {
+        return;
+    }
+
+    const FloatW minX = SplatW(aabb.min.x);
+    const FloatW minY = SplatW(aabb.min.y);
+    const FloatW maxX = SplatW(aabb.max.x);
+    const FloatW maxY = SplatW(aabb.max.y);
+
+    GrowableArray<int32, 256> stack;
+    stack.EmplaceBack(root);
+
+    while (stack.Count() != 0)
+    {
+        const Node& node = nodes[stack.PopBack()];
+
+        // Same comparisons as AABB::TestOverlap()
+        MaskW overlap = LessEqualW(LoadW(node.minX), maxX) & LessEqualW(minX, LoadW(node.maxX)) &
+                        LessEqualW(LoadW(node.minY), maxY) & LessEqualW(minY, LoadW(node.maxY));
+
+        int32 hits = MoveMaskW(overlap) & ((1 << node.count) - 1);
+
+        while (hits != 0)
+        {
+            int32 i = std::countr_zero(uint32(hits));
+            hits &= hits - 1;
+
+            int32 child = node.children[i];
+            if (IsLeaf(child))
+            {
+                NodeProxy leaf = GetLeafNode(child);
+
+                bool proceed = callback->QueryCallback(leaf, tree->GetData(leaf));
+                if (proceed == false)
+                {
+                    return;
+                }
+            }
+            else
+            {
+                stack.EmplaceBack(child);
+            }
+        }
+    }
+}
+
+template <typename T>
+void WideTree::AABBCast(const AABBCastInput& input, T* callback) const
+{
+    const Vec2 p1 = input.from;
+    const Vec2 p2 = input.to;
+    const Vec2 halfExtents = input.halfExtents;
+
+    float maxFraction = input.maxFraction;
+
+    Vec2 d = p2 - p1;
+    float length = d.NormalizeSafe();
+    if (length == 0.0f || root == nullNode)
+    {
+        return;
+    }
+
+    // Same slab test as AABB::RayCast(), the near and far planes are picked once per ray
+    Vec2 dir = p2 - p1;
+    float invDX = 1.0f / dir.x;
+    float invDY = 1.0f / dir.y;
+
+    bool flipX = invDX < 0.0f;
+    bool flipY = invDY < 0.0f;
+
+    const FloatW originX = SplatW(p1.x);
+    const FloatW originY = SplatW(p1.y);
+    const FloatW invX = SplatW(invDX);
+    const FloatW invY = SplatW(invDY);
+    const FloatW marginX = SplatW(halfExtents.x);
+    const FloatW marginY = SplatW(halfExtents.y);
+    const FloatW zero = SplatW(0.0f);
+
+    struct Entry
+    {
+        int32 child;
+        float distance;
+    };
+
+    GrowableArray<Entry, 256> stack;
+    stack.EmplaceBack(root, 0.0f);
+
+    while (stack.Count() > 0)
+    {
+        Entry entry = stack.PopBack();
+
+        // The ray got shortened since this entry was pushed
+        if (entry.distance > maxFraction)
+        {
+            continue;
+        }
+
+        if (IsLeaf(entry.child))
+        {
+            NodeProxy leaf = GetLeafNode(entry.child);
+
+            AABBCastInput subInput;
+            subInput.from = p1;
+            subInput.to = p2;
+            subInput.maxFraction = maxFraction;
+            subInput.halfExtents = halfExtents;
+
+            float newFraction = callback->AABBCastCallback(subInput, tree->GetData(leaf));
+            if (newFraction == 0.0f)
+            {
+                return;
+            }
+
+            if (newFraction > 0.0f)
+            {
+                // Shorten the ray
+                maxFraction = newFraction;
+            }
+
+            continue;
+        }
+
+        const Node& node = nodes[entry.child];
+
+        FloatW minX = LoadW(node.minX) - marginX;
+        FloatW maxX = LoadW(node.maxX) + marginX;
+        FloatW minY = LoadW(node.minY) - marginY;
+        FloatW maxY = LoadW(node.maxY) + marginY;
+
+        FloatW tx0 = ((flipX ? maxX : minX) - originX) * invX;
+        FloatW tx1 = ((flipX ? minX : maxX) - originX) * invX;
+        FloatW ty0 = ((flipY ? maxY : minY) - originY) * invY;
+        FloatW ty1 = ((flipY ? minY : maxY) - originY) * invY;
+
+        FloatW tMin = MaxW(tx0, zero);
+        FloatW tMax = MinW(tx1, SplatW(maxFraction));
+        tMin = MaxW(ty0, tMin);
+        tMax = MinW(ty1, tMax);
+
+        int32 hits = MoveMaskW(LessW(tMin, tMax)) & ((1 << node.count) - 1);
+        if (hits == 0)
+        {
+            continue;
+        }
+
+        float distances[child_count];
+        StoreW(distances, tMin);
+
+        // Ordered traversal, sort the hit children by distance and push the farthest first
+        Entry hitEntries[child_count];
+        int32 hitCount = 0;
+
+        while (hits != 0)
+        {
+            int32 i = std::countr_zero(uint32(hits));
+            hits &= hits - 1;
+
+            Entry e{ node.children[i], distances[i] };
+
+            int32 j = hitCount++;
+            while (j > 0 && hitEntries[j - 1].distance < e.distance)
+            {
+                hitEntries[j] = hitEntries[j - 1];
+                --j;
+            }
+            hitEntries[j] = e;
+        }
+
+        for (int32 i = 0; i < hitCount; ++i)
+        {
+            stack.PushBack(hitEntries[i]);
+        }
+    }
+}
+
+} // namespace muli
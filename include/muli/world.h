@@ -5,9 +5,12 @@
 #include "collision.h"
 #include "common.h"
 #include "contact_manager.h"
+#include "island_manager.h"
 #include "linear_allocator.h"
+#include "thread_pool.h"
 
 #include "collider.h"
+#include "polygon.h"
 #include "rigidbody.h"
 
 #include "angle_joint.h"
@@ -24,6 +27,18 @@
 namespace muli
 {
 
+// Solver statistics of the last step
+struct StepStats
+{
+    int32 islandCount;
+
+    // Sums over the awake islands, and the most a single island used
+    int32 velocityIterations;
+    int32 positionIterations;
+    int32 maxVelocityIterations;
+    int32 maxPositionIterations;
+};
+
 class World
 {
 public:
@@ -41,6 +56,12 @@ public:
     void Destroy(Joint* joint);
     void Destroy(std::span<Joint*> joints);
 
+    // The colliders of the bodies created between these calls are inserted into the broad phase at once
+    // when EndBulkInsert() is called, which is much faster than one by one when loading a level
+    // World queries don't see the new colliders until then, a step inserts them anyway
+    void BeginBulkInsert();
+    void EndBulkInsert();
+
     // Buffered body will be destroy at the end of the step
     void BufferDestroy(RigidBody* body);
     void BufferDestroy(std::span<RigidBody*> bodies);
@@ -250,6 +271,39 @@ public:
         std::function<void(Collider* collider, const Vec2& point, const Vec2& normal, float t)> callback);
     // clang-format on
 
+    // Same as above, but the callback can be any callable such as a lambda
+    // With the aabb tree broad phase the callback is inlined through the tree traversals and the shape tests,
+    // so a hit costs no allocation or indirect call
+    template <typename F>
+        requires std::predicate<F&, Collider*>
+    void Query(const Vec2& point, F&& callback) const;
+    template <typename F>
+        requires std::predicate<F&, Collider*>
+    void Query(const AABB& aabb, F&& callback) const;
+    template <typename F>
+        requires std::is_invocable_r_v<float, F&, Collider*, const Vec2&, const Vec2&, float>
+    void RayCastAny(const Vec2& from, const Vec2& to, float radius, F&& callback);
+    template <typename F>
+        requires std::invocable<F&, Collider*, const Vec2&, const Vec2&, float>
+    bool RayCastClosest(const Vec2& from, const Vec2& to, float radius, F&& callback);
+    template <typename F>
+        requires std::is_invocable_r_v<float, F&, Collider*, const Vec2&, const Vec2&, float>
+    void ShapeCastAny(const Shape* shape, const Transform& tf, const Vec2& translation, F&& callback);
+    template <typename F>
+        requires std::invocable<F&, Collider*, const Vec2&, const Vec2&, float>
+    bool ShapeCastClosest(const Shape* shape, const Transform& tf, const Vec2& translation, F&& callback);
+
+    // Query the boxes at once, a hit is written for each collider overlapping each box, grouped by the index of the box
+    // Returns the number of hits, only the first hits.size() of them are written if the buffer is too small
+    // The boxes are clustered internally so nearby boxes share their tree traversals, their order doesn't matter
+    // The batch is split over the worker threads if multithreaded is true
+    int32 Query(std::span<const AABB> aabbs, std::span<QueryHit> hits, bool multithreaded = false);
+
+    // Cast the rays at once and write the closest hit of rays[i] to hits[i], returns the number of rays that hit a collider
+    // The rays are sorted into packets of nearby rays heading the same way internally, their order doesn't matter
+    // The batch is split over the worker threads if multithreaded is true
+    int32 RayCastClosest(std::span<const RayCastInput> rays, std::span<RayCastHit> hits, bool multithreaded = false);
+
     RigidBody* GetBodyList() const;
     RigidBody* GetBodyListTail() const;
     int32 GetBodyCount() const;
@@ -261,9 +315,13 @@ public:
 
     int32 GetSleepingBodyCount() const;
     int32 GetAwakeIslandCount() const;
+    const StepStats& GetStepStats() const;
 
-    const AABBTree& GetDynamicTree() const;
+    // These return nullptr (or do nothing) unless the AABB tree broad phase is in use
+    const AABBTree* GetStaticTree() const;
+    const AABBTree* GetDynamicTree() const;
     void RebuildDynamicTree();
+    const TreeStats* GetTreeStats() const;
 
     const WorldSettings& GetWorldSettings() const;
 
@@ -272,18 +330,32 @@ public:
 private:
     friend class RigidBody;
     friend class Island;
+    friend class IslandManager;
     friend class ContactManager;
     friend class BroadPhase;
+    friend class TreeBroadPhase;
+    friend class SAPBroadPhase;
+    friend class GridBroadPhase;
+    friend class Contact;
 
     void Solve();
     float SolveTOI();
 
+    // Run the broad phase queries on the trees directly with the aabb tree broad phase, so the callbacks get inlined
+    template <typename T>
+    void BroadPhaseQuery(const Vec2& point, T* callback) const;
+    template <typename T>
+    void BroadPhaseQuery(const AABB& aabb, T* callback) const;
+    template <typename T>
+    void BroadPhaseAABBCast(const AABBCastInput& input, T* callback) const;
+
     void FreeBody(RigidBody* body);
     void AddJoint(Joint* joint);
     void FreeJoint(Joint* joint);
 
     const WorldSettings& settings;
     ContactManager contactManager;
+    IslandManager islandManager;
 
     // Doubly linked list of all registered rigid bodies
     RigidBody* bodyList;
@@ -294,7 +366,7 @@ private:
     int32 jointCount;
 
     int32 islandCount;
-    int32 sleepingBodyCount;
+    StepStats stats;
 
     bool stepComplete;
 
@@ -303,6 +375,11 @@ private:
 
     LinearAllocator linearAllocator;
     BlockAllocator blockAllocator;
+
+    // Worker threads for the island solver
+    // Each thread owns its own linear allocator
+    ThreadPool threadPool;
+    std::unique_ptr<LinearAllocator[]> threadAllocators;
 };
 
 inline void World::Awake()
@@ -330,7 +407,7 @@ inline int32 World::GetBodyCount() const
 
 inline int32 World::GetSleepingBodyCount() const
 {
-    return sleepingBodyCount;
+    return islandManager.GetSleepingBodyCount();
 }
 
 inline int32 World::GetAwakeIslandCount() const
@@ -338,6 +415,11 @@ inline int32 World::GetAwakeIslandCount() const
     return islandCount;
 }
 
+inline const StepStats& World::GetStepStats() const
+{
+    return stats;
+}
+
 inline const Contact* World::GetContacts() const
 {
     return contactManager.contactList;
@@ -358,14 +440,55 @@ inline int32 World::GetJointCount() const
     return jointCount;
 }
 
-inline const AABBTree& World::GetDynamicTree() const
+inline const AABBTree* World::GetStaticTree() const
 {
-    return contactManager.broadPhase.tree;
+    if (settings.broad_phase_type != BroadPhaseType::aabb_tree)
+    {
+        return nullptr;
+    }
+
+    return &static_cast<const TreeBroadPhase*>(contactManager.broadPhase.get())->staticTree;
+}
+
+inline const AABBTree* World::GetDynamicTree() const
+{
+    if (settings.broad_phase_type != BroadPhaseType::aabb_tree)
+    {
+        return nullptr;
+    }
+
+    return &static_cast<const TreeBroadPhase*>(contactManager.broadPhase.get())->dynamicTree;
+}
+
+inline const TreeStats* World::GetTreeStats() const
+{
+    if (settings.broad_phase_type != BroadPhaseType::aabb_tree)
+    {
+        return nullptr;
+    }
+
+    return &static_cast<const TreeBroadPhase*>(contactManager.broadPhase.get())->GetStats();
 }
 
 inline void World::RebuildDynamicTree()
 {
-    contactManager.broadPhase.tree.Rebuild();
+    if (settings.broad_phase_type != BroadPhaseType::aabb_tree)
+    {
+        return;
+    }
+
+    static_cast<TreeBroadPhase*>(contactManager.broadPhase.get())->dynamicTree.Rebuild(&threadPool);
+}
+
+inline void World::BeginBulkInsert()
+{
+    contactManager.bulkInsert = true;
+}
+
+inline void World::EndBulkInsert()
+{
+    contactManager.bulkInsert = false;
+    contactManager.InsertPendingColliders();
 }
 
 inline const WorldSettings& World::GetWorldSettings() const
@@ -373,4 +496,242 @@ inline const WorldSettings& World::GetWorldSettings() const
     return settings;
 }
 
+template <typename T>
+void World::BroadPhaseQuery(const Vec2& point, T* callback) const
+{
+    if (settings.broad_phase_type == BroadPhaseType::aabb_tree)
+    {
+        static_cast<const TreeBroadPhase*>(contactManager.broadPhase.get())->Query(point, callback);
+    }
+    else
+    {
+        contactManager.broadPhase->Query(point, callback);
+    }
+}
+
+template <typename T>
+void World::BroadPhaseQuery(const AABB& aabb, T* callback) const
+{
+    if (settings.broad_phase_type == BroadPhaseType::aabb_tree)
+    {
+        static_cast<const TreeBroadPhase*>(contactManager.broadPhase.get())->Query(aabb, callback);
+    }
+    else
+    {
+        contactManager.broadPhase->Query(aabb, callback);
+    }
+}
+
+template <typename T>
+void World::BroadPhaseAABBCast(const AABBCastInput& input, T* callback) const
+{
+    if (settings.broad_phase_type == BroadPhaseType::aabb_tree)
+    {
+        static_cast<const TreeBroadPhase*>(contactManager.broadPhase.get())->AABBCast(input, callback);
+    }
+    else
+    {
+        contactManager.broadPhase->AABBCast(input, callback);
+    }
+}
+
+template <typename F>
+    requires std::predicate<F&, Collider*>
+void World::Query(const Vec2& point, F&& callback) const
+{
+    struct TempCallback
+    {
+        Vec2 point;
+        F& callback;
+
+        bool QueryCallback(NodeProxy node, Collider* collider)
+        {
+            muliNotUsed(node);
+
+            // Body was destroyed while querying
+            if (collider->body == nullptr)
+            {
+                return true;
+            }
+
+            if (collider->TestPoint(point))
+            {
+                return callback(collider);
+            }
+
+            return true;
+        }
+    } tempCallback{ point, callback };
+
+    BroadPhaseQuery(point, &tempCallback);
+}
+
+template <typename F>
+    requires std::predicate<F&, Collider*>
+void World::Query(const AABB& aabb, F&& callback) const
+{
+    struct TempCallback
+    {
+        Polygon box;
+        F& callback;
+
+        bool QueryCallback(NodeProxy node, Collider* collider)
+        {
+            muliNotUsed(node);
+
+            // Body was destroyed while querying
+            if (collider->body == nullptr)
+            {
+                return true;
+            }
+
+            if (Collide(collider->shape, collider->body->transform, &box, identity))
+            {
+                return callback(collider);
+            }
+
+            return true;
+        }
+    } tempCallback{ Polygon{ { aabb.min, { aabb.max.x, aabb.min.y }, aabb.max, { aabb.min.x, aabb.max.y } }, false, 0.0f },
+                    callback };
+
+    BroadPhaseQuery(aabb, &tempCallback);
+}
+
+template <typename F>
+    requires std::is_invocable_r_v<float, F&, Collider*, const Vec2&, const Vec2&, float>
+void World::RayCastAny(const Vec2& from, const Vec2& to, float radius, F&& callback)
+{
+    AABBCastInput input;
+    input.from = from;
+    input.to = to;
+    input.maxFraction = 1.0f;
+    input.halfExtents.Set(radius);
+
+    struct TempCallback
+    {
+        F& callback;
+
+        float AABBCastCallback(const AABBCastInput& subInput, Collider* collider)
+        {
+            RayCastInput input;
+            input.from = subInput.from;
+            input.to = subInput.to;
+            input.maxFraction = subInput.maxFraction;
+            input.radius = subInput.halfExtents.x;
+
+            RayCastOutput output;
+
+            bool hit = collider->RayCast(input, &output);
+            if (hit)
+            {
+                float fraction = output.fraction;
+                Vec2 point = (1.0f - fraction) * input.from + fraction * input.to;
+
+                return callback(collider, point, output.normal, fraction);
+            }
+
+            return input.maxFraction;
+        }
+    } tempCallback{ callback };
+
+    BroadPhaseAABBCast(input, &tempCallback);
+}
+
+template <typename F>
+    requires std::invocable<F&, Collider*, const Vec2&, const Vec2&, float>
+bool World::RayCastClosest(const Vec2& from, const Vec2& to, float radius, F&& callback)
+{
+    bool hit = false;
+    Collider* closestCollider = nullptr;
+    Vec2 closestPoint = Vec2::zero;
+    Vec2 closestNormal = Vec2::zero;
+    float closestFraction = 1.0f;
+
+    RayCastAny(from, to, radius, [&](Collider* collider, const Vec2& point, const Vec2& normal, float fraction) -> float {
+        hit = true;
+        closestCollider = collider;
+        closestPoint = point;
+        closestNormal = normal;
+        closestFraction = fraction;
+
+        return fraction;
+    });
+
+    if (hit)
+    {
+        callback(closestCollider, closestPoint, closestNormal, closestFraction);
+        return true;
+    }
+
+    return false;
+}
+
+template <typename F>
+    requires std::is_invocable_r_v<float, F&, Collider*, const Vec2&, const Vec2&, float>
+void World::ShapeCastAny(const Shape* shape, const Transform& tf, const Vec2& translation, F&& callback)
+{
+    AABB aabb;
+    shape->ComputeAABB(tf, &aabb);
+
+    AABBCastInput input;
+    input.from = tf.position;
+    input.to = tf.position + translation;
+    input.maxFraction = 1.0f;
+    input.halfExtents = 0.5f * aabb.GetExtents();
+
+    struct TempCallback
+    {
+        F& callback;
+        const Shape* shape;
+        Transform tf;
+        Vec2 translation;
+
+        float AABBCastCallback(const AABBCastInput& input, Collider* collider)
+        {
+            ShapeCastOutput output;
+
+            bool hit = ShapeCast(shape, tf, collider->GetShape(), collider->GetBody()->GetTransform(),
+                                 translation * input.maxFraction, Vec2::zero, &output);
+            if (hit)
+            {
+                return callback(collider, output.point, output.normal, output.t * input.maxFraction);
+            }
+
+            return input.maxFraction;
+        }
+    } tempCallback{ callback, shape, tf, translation };
+
+    BroadPhaseAABBCast(input, &tempCallback);
+}
+
+template <typename F>
+    requires std::invocable<F&, Collider*, const Vec2&, const Vec2&, float>
+bool World::ShapeCastClosest(const Shape* shape, const Transform& tf, const Vec2& translation, F&& callback)
+{
+    bool hit = false;
+    Collider* closestCollider = nullptr;
+    Vec2 closestPoint = Vec2::zero;
+    Vec2 closestNormal = Vec2::zero;
+    float closestT = 1.0f;
+
+    ShapeCastAny(shape, tf, translation, [&](Collider* collider, const Vec2& point, const Vec2& normal, float t) -> float {
+        hit = true;
+        closestCollider = collider;
+        closestPoint = point;
+        closestNormal = normal;
+        closestT = t;
+
+        return t;
+    });
+
+    if (hit)
+    {
+        callback(closestCollider, closestPoint, closestNormal, closestT);
+        return true;
+    }
+
+    return false;
+}
+
 } // namespace muli
\ No newline at end of file
@@ -1,32 +1,44 @@
 #include "muli/aabb_tree.h"
 #include "muli/growable_array.h"
 
+#include <algorithm>
+#include <bit>
+
 namespace muli
 {
 
-AABBTree::AABBTree()
+AABBTree::AABBTree(const Vec2& _margin)
     : root{ nullNode }
-    , nodeCapacity{ 32 }
+    , margin{ _margin }
+    , version{ 0 }
+    , structureVersion{ 0 }
+    , nodes{ nullptr }
+    , parents{ nullptr }
+    , nextFree{ nullptr }
+    , moved{ nullptr }
+    , refitted{ nullptr }
+    , userData{ nullptr }
+    , nodeCapacity{ 0 }
     , nodeCount{ 0 }
+    , optimizeCursor{ 0 }
 {
-    nodes = (Node*)muli::Alloc(nodeCapacity * sizeof(Node));
-    memset(nodes, 0, nodeCapacity * sizeof(Node));
+    ResizeNodes(32);
 
     // Build a linked list for the free list.
     for (int32 i = 0; i < nodeCapacity - 1; ++i)
     {
-        nodes[i].next = i + 1;
-        nodes[i].parent = i;
+        nextFree[i] = i + 1;
+        parents[i] = i;
     }
-    nodes[nodeCapacity - 1].next = nullNode;
-    nodes[nodeCapacity - 1].parent = nodeCapacity - 1;
+    nextFree[nodeCapacity - 1] = nullNode;
+    parents[nodeCapacity - 1] = nodeCapacity - 1;
 
     freeList = 0;
 }
 
 AABBTree::~AABBTree() noexcept
 {
-    muli::Free(nodes);
+    FreeNodes();
     root = nullNode;
     nodeCount = 0;
 }
@@ -34,43 +46,73 @@ AABBTree::~AABBTree() noexcept
 AABBTree::AABBTree(AABBTree&& other) noexcept
 {
     root = other.root;
+    margin = other.margin;
+    version = other.version;
+    structureVersion = other.structureVersion;
 
     nodes = other.nodes;
+    parents = other.parents;
+    nextFree = other.nextFree;
+    moved = other.moved;
+    refitted = other.refitted;
+    userData = other.userData;
     nodeCount = other.nodeCount;
     nodeCapacity = other.nodeCapacity;
 
     freeList = other.freeList;
+    optimizeCursor = other.optimizeCursor;
 
     other.root = nullNode;
 
     other.nodes = nullptr;
+    other.parents = nullptr;
+    other.nextFree = nullptr;
+    other.moved = nullptr;
+    other.refitted = nullptr;
+    other.userData = nullptr;
     other.nodeCount = 0;
     other.nodeCapacity = 0;
 
     other.freeList = nullNode;
+    other.optimizeCursor = 0;
 }
 
 AABBTree& AABBTree::operator=(AABBTree&& other) noexcept
 {
     muliAssert(this != &other);
 
-    muli::Free(nodes);
+    FreeNodes();
 
     root = other.root;
+    margin = other.margin;
+    version = other.version;
+    structureVersion = other.structureVersion;
 
     nodes = other.nodes;
+    parents = other.parents;
+    nextFree = other.nextFree;
+    moved = other.moved;
+    refitted = other.refitted;
+    userData = other.userData;
     nodeCount = other.nodeCount;
     nodeCapacity = other.nodeCapacity;
 
     freeList = other.freeList;
+    optimizeCursor = other.optimizeCursor;
 
     other.root = nullNode;
 
     other.nodes = nullptr;
+    other.parents = nullptr;
+    other.nextFree = nullptr;
+    other.moved = nullptr;
+    other.refitted = nullptr;
+    other.userData = nullptr;
     other.nodeCount = 0;
     other.nodeCapacity = 0;
 
     other.freeList = nullNode;
+    other.optimizeCursor = 0;
 
     return *this;
 }
@@ -80,6 +122,9 @@ NodeProxy AABBTree::InsertLeaf(NodeProxy leaf)
     muliAssert(0 <= leaf && leaf < nodeCapacity);
     muliAssert(nodes[leaf].IsLeaf());
 
+    ++version;
+    ++structureVersion;
+
     if (root == nullNode)
     {
         root = leaf;
@@ -189,17 +234,20 @@ NodeProxy AABBTree::InsertLeaf(NodeProxy leaf)
 #endif
 
     // Create a new parent
-    NodeProxy oldParent = nodes[bestSibling].parent;
+    NodeProxy oldParent = parents[bestSibling];
     NodeProxy newParent = AllocateNode();
     nodes[newParent].aabb = AABB::Union(aabb, nodes[bestSibling].aabb);
-    nodes[newParent].data = nullptr;
-    nodes[newParent].parent = oldParent;
+    userData[newParent] = nullptr;
+    parents[newParent] = oldParent;
+
+    // Stay on the path of Refit() if the sibling is on it
+    refitted[newParent] = refitted[bestSibling];
 
     // Connect new leaf and sibling to new parent
     nodes[newParent].child1 = leaf;
     nodes[newParent].child2 = bestSibling;
-    nodes[leaf].parent = newParent;
-    nodes[bestSibling].parent = newParent;
+    parents[leaf] = newParent;
+    parents[bestSibling] = newParent;
 
     if (oldParent != nullNode)
     {
@@ -228,7 +276,7 @@ NodeProxy AABBTree::InsertLeaf(NodeProxy leaf)
 
         Rotate(ancestor);
 
-        ancestor = nodes[ancestor].parent;
+        ancestor = parents[ancestor];
     }
 
     return leaf;
@@ -239,7 +287,12 @@ void AABBTree::RemoveLeaf(NodeProxy leaf)
     muliAssert(0 <= leaf && leaf < nodeCapacity);
     muliAssert(nodes[leaf].IsLeaf());
 
-    NodeProxy parent = nodes[leaf].parent;
+    ++version;
+    ++structureVersion;
+
+    refitted[leaf] = false;
+
+    NodeProxy parent = parents[leaf];
     if (parent == nullNode) // node is root
     {
         muliAssert(root == leaf);
@@ -247,7 +300,7 @@ void AABBTree::RemoveLeaf(NodeProxy leaf)
         return;
     }
 
-    NodeProxy grandParent = nodes[parent].parent;
+    NodeProxy grandParent = parents[parent];
     NodeProxy sibling;
     if (nodes[parent].child1 == leaf)
     {
@@ -262,7 +315,7 @@ void AABBTree::RemoveLeaf(NodeProxy leaf)
 
     if (grandParent != nullNode) // node has grandparent
     {
-        nodes[sibling].parent = grandParent;
+        parents[sibling] = grandParent;
 
         if (nodes[grandParent].child1 == parent)
         {
@@ -283,13 +336,13 @@ void AABBTree::RemoveLeaf(NodeProxy leaf)
 
             Rotate(ancestor);
 
-            ancestor = nodes[ancestor].parent;
+            ancestor = parents[ancestor];
         }
     }
     else // node has no grandparent
     {
         root = sibling;
-        nodes[sibling].parent = nullNode;
+        parents[sibling] = nullNode;
     }
 }
 
@@ -298,11 +351,11 @@ NodeProxy AABBTree::CreateNode(Data* data, const AABB& aabb)
     NodeProxy newNode = AllocateNode();
 
     // Fatten the aabb
-    nodes[newNode].aabb.max = aabb.max + aabb_margin;
-    nodes[newNode].aabb.min = aabb.min - aabb_margin;
-    nodes[newNode].data = data;
-    nodes[newNode].parent = nullNode;
-    nodes[newNode].moved = true;
+    nodes[newNode].aabb.max = aabb.max + margin;
+    nodes[newNode].aabb.min = aabb.min - margin;
+    userData[newNode] = data;
+    parents[newNode] = nullNode;
+    moved[newNode] = true;
 
     InsertLeaf(newNode);
 
@@ -320,6 +373,126 @@ bool AABBTree::MoveNode(NodeProxy node, AABB aabb, const Vec2& displacement, boo
         return false;
     }
 
+    RemoveLeaf(node);
+
+    nodes[node].aabb = FattenAABB(aabb, displacement);
+
+    InsertLeaf(node);
+
+    moved[node] = true;
+
+    return true;
+}
+
+bool AABBTree::RefitNode(NodeProxy node, AABB aabb, const Vec2& displacement, bool forceMove)
+{
+    muliAssert(0 <= node && node < nodeCapacity);
+    muliAssert(nodes[node].IsLeaf());
+
+    const AABB& treeAABB = nodes[node].aabb;
+    if (treeAABB.Contains(aabb) && forceMove == false)
+    {
+        return false;
+    }
+
+    ++version;
+
+    aabb = FattenAABB(aabb, displacement);
+    nodes[node].aabb = aabb;
+    moved[node] = true;
+    refitted[node] = true;
+
+    // Enlarge the ancestors so the tree stays valid until Refit()
+    // Once an ancestor on the path already contains the leaf, the ones above it do too
+    NodeProxy ancestor = parents[node];
+    while (ancestor != nullNode)
+    {
+        bool contained = nodes[ancestor].aabb.Contains(aabb);
+        if (contained == false)
+        {
+            nodes[ancestor].aabb = AABB::Union(nodes[ancestor].aabb, aabb);
+        }
+
+        if (refitted[ancestor])
+        {
+            if (contained)
+            {
+                break;
+            }
+        }
+        else
+        {
+            refitted[ancestor] = true;
+        }
+
+        ancestor = parents[ancestor];
+    }
+
+    return true;
+}
+
+NodeProxy AABBTree::Refit()
+{
+    if (root == nullNode || refitted[root] == false)
+    {
+        return nullNode;
+    }
+
+    ++version;
+
+    // The refitted nodes form a subtree hanging from the root, find the lowest node where its branches meet
+    NodeProxy region = root;
+    while (nodes[region].IsLeaf() == false)
+    {
+        bool refitted1 = refitted[nodes[region].child1];
+        bool refitted2 = refitted[nodes[region].child2];
+
+        if (refitted1 == refitted2)
+        {
+            break;
+        }
+
+        region = refitted1 ? nodes[region].child1 : nodes[region].child2;
+    }
+
+    // Collect the refitted nodes in preorder, so the reversed order tightens the children before their parents
+    GrowableArray<NodeProxy, 256> order;
+    GrowableArray<NodeProxy, 256> stack;
+    stack.EmplaceBack(root);
+
+    while (stack.Count() > 0)
+    {
+        NodeProxy node = stack.PopBack();
+        refitted[node] = false;
+
+        if (nodes[node].IsLeaf())
+        {
+            continue;
+        }
+
+        order.EmplaceBack(node);
+
+        if (refitted[nodes[node].child1])
+        {
+            stack.EmplaceBack(nodes[node].child1);
+        }
+        if (refitted[nodes[node].child2])
+        {
+            stack.EmplaceBack(nodes[node].child2);
+        }
+    }
+
+    for (int32 i = order.Count() - 1; i >= 0; --i)
+    {
+        NodeProxy node = order[i];
+        nodes[node].aabb = AABB::Union(nodes[nodes[node].child1].aabb, nodes[nodes[node].child2].aabb);
+    }
+
+    return region;
+}
+
+AABB AABBTree::FattenAABB(AABB aabb, const Vec2& displacement) const
+{
     Vec2 d = displacement * aabb_multiplier;
 
     if (d.x > 0.0f)
@@ -341,18 +514,10 @@ bool AABBTree::MoveNode(NodeProxy node, AABB aabb, const Vec2& displacement, boo
     }
 
     // Fatten the aabb
-    aabb.max += aabb_margin;
-    aabb.min -= aabb_margin;
-
-    RemoveLeaf(node);
-
-    nodes[node].aabb = aabb;
-
-    InsertLeaf(node);
-
-    nodes[node].moved = true;
+    aabb.max += margin;
+    aabb.min -= margin;
 
-    return true;
+    return aabb;
 }
 
 void AABBTree::RemoveNode(NodeProxy node)
@@ -364,6 +529,59 @@ void AABBTree::RemoveNode(NodeProxy node)
     FreeNode(node);
 }
 
+void AABBTree::RemoveNodes(std::span<const NodeProxy> removedNodes, ThreadPool* threadPool)
+{
+    int32 removeCount = int32(removedNodes.size());
+    if (removeCount == 0)
+    {
+        return;
+    }
+
+    int32 oldCount = (nodeCount + 1) / 2;
+
+    // A few nodes taken out of a large tree are cheaper to remove one by one
+    if (removeCount < oldCount - removeCount)
+    {
+        for (int32 i = 0; i < removeCount; ++i)
+        {
+            RemoveNode(removedNodes[i]);
+        }
+        return;
+    }
+
+    // Otherwise detach all the leaves, free the removed ones and build a tree over the rest
+    NodeProxy* leafNodes = (NodeProxy*)muli::Alloc(oldCount * sizeof(NodeProxy));
+    int32 count = ReleaseInternalNodes(leafNodes);
+
+    for (int32 i = 0; i < removeCount; ++i)
+    {
+        NodeProxy node = removedNodes[i];
+
+        muliAssert(0 <= node && node < nodeCapacity);
+        muliAssert(parents[node] == nullNode && nodes[node].IsLeaf());
+
+        FreeNode(node);
+    }
+
+    // Freed nodes are their own parents
+    int32 remainCount = 0;
+    for (int32 i = 0; i < count; ++i)
+    {
+        if (parents[leafNodes[i]] != leafNodes[i])
+        {
+            leafNodes[remainCount++] = leafNodes[i];
+        }
+    }
+
+    if (remainCount > 0)
+    {
+        root = BuildTree(leafNodes, remainCount, threadPool);
+        parents[root] = nullNode;
+    }
+
+    muli::Free(leafNodes);
+}
+
 void AABBTree::Rotate(NodeProxy node)
 {
     if (nodes[node].IsLeaf())
@@ -406,16 +624,18 @@ void AABBTree::Rotate(NodeProxy node)
     }
 
     // printf("Tree rotation occurred: %d\n", bestDiffIndex);
+    // A refitted node moved under its sibling puts the sibling on the path of Refit() as well
     switch (bestDiffIndex)
     {
     case 0:
     {
         // Swap(child2, nodes[child1].child2);
-        nodes[nodes[child1].child2].parent = node;
+        parents[nodes[child1].child2] = node;
         nodes[node].child2 = nodes[child1].child2;
 
         nodes[child1].child2 = child2;
-        nodes[child2].parent = child1;
+        parents[child2] = child1;
+        refitted[child1] = refitted[child1] || refitted[child2];
 
         nodes[child1].aabb = AABB::Union(nodes[nodes[child1].child1].aabb, nodes[nodes[child1].child2].aabb);
     }
@@ -423,11 +643,12 @@ void AABBTree::Rotate(NodeProxy node)
     case 1:
     {
         // Swap(child2, nodes[child1].child1);
-        nodes[nodes[child1].child1].parent = node;
+        parents[nodes[child1].child1] = node;
         nodes[node].child2 = nodes[child1].child1;
 
         nodes[child1].child1 = child2;
-        nodes[child2].parent = child1;
+        parents[child2] = child1;
+        refitted[child1] = refitted[child1] || refitted[child2];
 
         nodes[child1].aabb = AABB::Union(nodes[nodes[child1].child1].aabb, nodes[nodes[child1].child2].aabb);
     }
@@ -435,11 +656,12 @@ void AABBTree::Rotate(NodeProxy node)
     case 2:
     {
         // Swap(child1, nodes[child2].child2);
-        nodes[nodes[child2].child2].parent = node;
+        parents[nodes[child2].child2] = node;
         nodes[node].child1 = nodes[child2].child2;
 
         nodes[child2].child2 = child1;
-        nodes[child1].parent = child2;
+        parents[child1] = child2;
+        refitted[child2] = refitted[child2] || refitted[child1];
 
         nodes[child2].aabb = AABB::Union(nodes[nodes[child2].child1].aabb, nodes[nodes[child2].child2].aabb);
     }
@@ -447,11 +669,12 @@ void AABBTree::Rotate(NodeProxy node)
     case 3:
     {
         // Swap(child1, nodes[child2].child1);
-        nodes[nodes[child2].child1].parent = node;
+        parents[nodes[child2].child1] = node;
         nodes[node].child1 = nodes[child2].child1;
 
         nodes[child2].child1 = child1;
-        nodes[child1].parent = child2;
+        parents[child1] = child2;
+        refitted[child2] = refitted[child2] || refitted[child1];
 
         nodes[child2].aabb = AABB::Union(nodes[nodes[child2].child1].aabb, nodes[nodes[child2].child2].aabb);
     }
@@ -461,8 +684,8 @@ void AABBTree::Rotate(NodeProxy node)
 
 void AABBTree::Swap(NodeProxy node1, NodeProxy node2)
 {
-    NodeProxy parent1 = nodes[node1].parent;
-    NodeProxy parent2 = nodes[node2].parent;
+    NodeProxy parent1 = parents[node1];
+    NodeProxy parent2 = parents[node2];
 
     if (parent1 == parent2)
     {
@@ -479,7 +702,7 @@ void AABBTree::Swap(NodeProxy node1, NodeProxy node2)
     {
         nodes[parent1].child2 = node2;
     }
-    nodes[node2].parent = parent1;
+    parents[node2] = parent1;
 
     if (nodes[parent2].child1 == node2)
     {
@@ -489,7 +712,7 @@ void AABBTree::Swap(NodeProxy node1, NodeProxy node2)
     {
         nodes[parent2].child2 = node1;
     }
-    nodes[node1].parent = parent2;
+    parents[node1] = parent2;
 }
 
 void AABBTree::Traverse(std::function<void(const Node*)> callback) const
@@ -538,7 +761,7 @@ void AABBTree::Query(const Vec2& point, std::function<bool(NodeProxy, Data*)> ca
 
         if (nodes[current].IsLeaf())
         {
-            bool proceed = callback(current, nodes[current].data);
+            bool proceed = callback(current, userData[current]);
             if (proceed == false)
             {
                 return;
@@ -573,7 +796,7 @@ void AABBTree::Query(const AABB& aabb, std::function<bool(NodeProxy, Data*)> cal
 
         if (nodes[current].IsLeaf())
         {
-            bool proceed = callback(current, nodes[current].data);
+            bool proceed = callback(current, userData[current]);
             if (proceed == false)
             {
                 return;
@@ -587,6 +810,21 @@ void AABBTree::Query(const AABB& aabb, std::function<bool(NodeProxy, Data*)> cal
     }
 }
 
+void AABBTree::Query(std::span<const AABB> aabbs, std::function<bool(int32, NodeProxy, Data*)> callback) const
+{
+    struct TempCallback
+    {
+        std::function<bool(int32, NodeProxy, Data*)>& callback;
+
+        bool QueryCallback(int32 queryIndex, NodeProxy node, Data* data)
+        {
+            return callback(queryIndex, node, data);
+        }
+    } tempCallback{ callback };
+
+    Query(aabbs, &tempCallback);
+}
+
 void AABBTree::AABBCast(const AABBCastInput& input, std::function<float(const AABBCastInput& input, Data* data)> callback) const
 {
     const Vec2 p1 = input.from;
@@ -623,7 +861,7 @@ void AABBTree::AABBCast(const AABBCastInput& input, std::function<float(const AA
             subInput.maxFraction = maxFraction;
             subInput.halfExtents = halfExtents;
 
-            float newFraction = callback(subInput, node->data);
+            float newFraction = callback(subInput, userData[current]);
             if (newFraction == 0.0f)
             {
                 return;
@@ -666,22 +904,44 @@ void AABBTree::AABBCast(const AABBCastInput& input, std::function<float(const AA
     }
 }
 
+void AABBTree::AABBCast(std::span<const AABBCastInput> inputs,
+                        std::function<float(int32, const AABBCastInput& input, Data* data)> callback) const
+{
+    struct TempCallback
+    {
+        std::function<float(int32, const AABBCastInput& input, Data* data)>& callback;
+
+        float AABBCastCallback(int32 rayIndex, const AABBCastInput& subInput, Data* data)
+        {
+            return callback(rayIndex, subInput, data);
+        }
+    } tempCallback{ callback };
+
+    AABBCast(inputs, &tempCallback);
+}
+
 void AABBTree::Reset()
 {
+    ++version;
+    ++structureVersion;
     root = nullNode;
     nodeCount = 0;
     memset(nodes, 0, nodeCapacity * sizeof(Node));
+    memset(moved, 0, nodeCapacity * sizeof(bool));
+    memset(refitted, 0, nodeCapacity * sizeof(bool));
+    memset(userData, 0, nodeCapacity * sizeof(Data*));
 
     // Build a linked list for the free list.
     for (int32 i = 0; i < nodeCapacity - 1; ++i)
     {
-        nodes[i].next = i + 1;
-        nodes[i].parent = i;
+        nextFree[i] = i + 1;
+        parents[i] = i;
     }
-    nodes[nodeCapacity - 1].next = nullNode;
-    nodes[nodeCapacity - 1].parent = nodeCapacity - 1;
+    nextFree[nodeCapacity - 1] = nullNode;
+    parents[nodeCapacity - 1] = nodeCapacity - 1;
 
     freeList = 0;
+    optimizeCursor = 0;
 }
 
 NodeProxy AABBTree::AllocateNode()
@@ -691,60 +951,299 @@ NodeProxy AABBTree::AllocateNode()
         muliAssert(nodeCount == nodeCapacity);
 
         // Grow the node pool
-        Node* oldNodes = nodes;
-        nodeCapacity += nodeCapacity / 2;
-        nodes = (Node*)muli::Alloc(nodeCapacity * sizeof(Node));
-        memcpy(nodes, oldNodes, nodeCount * sizeof(Node));
-        memset(nodes + nodeCount, 0, (nodeCapacity - nodeCount) * sizeof(Node));
-        muli::Free(oldNodes);
+        ResizeNodes(nodeCapacity + nodeCapacity / 2);
 
         // Build a linked list for the free list.
         for (int32 i = nodeCount; i < nodeCapacity - 1; ++i)
         {
-            nodes[i].next = i + 1;
-            nodes[i].parent = i;
+            nextFree[i] = i + 1;
+            parents[i] = i;
         }
-        nodes[nodeCapacity - 1].next = nullNode;
-        nodes[nodeCapacity - 1].parent = nodeCapacity - 1;
+        nextFree[nodeCapacity - 1] = nullNode;
+        parents[nodeCapacity - 1] = nodeCapacity - 1;
 
         freeList = nodeCount;
     }
 
     NodeProxy node = freeList;
-    freeList = nodes[node].next;
-    nodes[node].parent = nullNode;
+    freeList = nextFree[node];
+    parents[node] = nullNode;
     nodes[node].child1 = nullNode;
     nodes[node].child2 = nullNode;
-    nodes[node].moved = false;
+    moved[node] = false;
+    refitted[node] = false;
     ++nodeCount;
 
     return node;
 }
 
+void AABBTree::ResizeNodes(int32 capacity)
+{
+    muliAssert(nodeCount <= capacity);
+
+    Node* oldNodes = nodes;
+    NodeProxy* oldParents = parents;
+    NodeProxy* oldNextFree = nextFree;
+    bool* oldMoved = moved;
+    bool* oldRefitted = refitted;
+    Data** oldUserData = userData;
+
+    // Keep the hot nodes aligned so that they never straddle a cache line
+    nodes = (Node*)muli::AlignedAlloc(capacity * sizeof(Node), alignof(Node));
+    parents = (NodeProxy*)muli::Alloc(capacity * sizeof(NodeProxy));
+    nextFree = (NodeProxy*)muli::Alloc(capacity * sizeof(NodeProxy));
+    moved = (bool*)muli::Alloc(capacity * sizeof(bool));
+    refitted = (bool*)muli::Alloc(capacity * sizeof(bool));
+    userData = (Data**)muli::Alloc(capacity * sizeof(Data*));
+
+    if (nodeCount > 0)
+    {
+        memcpy(nodes, oldNodes, nodeCount * sizeof(Node));
+        memcpy(parents, oldParents, nodeCount * sizeof(NodeProxy));
+        memcpy(nextFree, oldNextFree, nodeCount * sizeof(NodeProxy));
+        memcpy(moved, oldMoved, nodeCount * sizeof(bool));
+        memcpy(refitted, oldRefitted, nodeCount * sizeof(bool));
+        memcpy(userData, oldUserData, nodeCount * sizeof(Data*));
+    }
+
+    memset(nodes + nodeCount, 0, (capacity - nodeCount) * sizeof(Node));
+    memset(moved + nodeCount, 0, (capacity - nodeCount) * sizeof(bool));
+    memset(refitted + nodeCount, 0, (capacity - nodeCount) * sizeof(bool));
+    memset(userData + nodeCount, 0, (capacity - nodeCount) * sizeof(Data*));
+
+    muli::AlignedFree(oldNodes, alignof(Node));
+    muli::Free(oldParents);
+    muli::Free(oldNextFree);
+    muli::Free(oldMoved);
+    muli::Free(oldRefitted);
+    muli::Free(oldUserData);
+
+    nodeCapacity = capacity;
+}
+
+void AABBTree::FreeNodes()
+{
+    muli::AlignedFree(nodes, alignof(Node));
+    muli::Free(parents);
+    muli::Free(nextFree);
+    muli::Free(moved);
+    muli::Free(refitted);
+    muli::Free(userData);
+}
+
 void AABBTree::FreeNode(NodeProxy node)
 {
     muliAssert(0 <= node && node <= nodeCapacity);
     muliAssert(0 < nodeCount);
 
-    nodes[node].parent = node;
-    nodes[node].next = freeList;
+    parents[node] = node;
+    nextFree[node] = freeList;
+    refitted[node] = false;
     freeList = node;
 
     --nodeCount;
 }
 
-void AABBTree::Rebuild()
+// Binned surface area heuristic builder used by AABBTree::Rebuild()
+constexpr int32 rebuild_bin_count = 16;
+
+// Subtrees having less leaves than this are built serially by a single thread
+constexpr int32 rebuild_parallel_threshold = 1024;
+
+struct RebuildTask
+{
+    int32 begin;
+    int32 count;
+    int32 offset; // First internal node of the subtree
+};
+
+// Leaves are copied into a contiguous array so the partitioning doesn't chase the node indices
+struct RebuildLeaf
+{
+    AABB aabb;
+    Vec2 center;
+    NodeProxy node;
+};
+
+// Partition the leaves by the binned SAH and return the leaf count of the first child
+static int32 PartitionLeaves(RebuildLeaf* leaves, int32 count, AABB* bounds)
 {
-    // Rebuild tree with bottom up approach
+    AABB centroidBounds{ leaves[0].center, leaves[0].center };
+
+    for (int32 i = 1; i < count; ++i)
+    {
+        centroidBounds.min = Min(centroidBounds.min, leaves[i].center);
+        centroidBounds.max = Max(centroidBounds.max, leaves[i].center);
+    }
+
+    // Split along the longest axis of the centroids
+    Vec2 extents = centroidBounds.max - centroidBounds.min;
+    int32 axis = extents.x > extents.y ? 0 : 1;
+
+    if (count == 2 || extents[axis] <= 0.0f)
+    {
+        // Nothing to bin, or all the centroids are at the same position
+        AABB aabb = leaves[0].aabb;
+        for (int32 i = 1; i < count; ++i)
+        {
+            aabb = AABB::Union(aabb, leaves[i].aabb);
+        }
+
+        *bounds = aabb;
+        return count / 2;
+    }
+
+    struct Bin
+    {
+        AABB aabb;
+        int32 count;
+    } bins[rebuild_bin_count];
+
+    for (int32 i = 0; i < rebuild_bin_count; ++i)
+    {
+        bins[i].count = 0;
+    }
+
+    float min = centroidBounds.min[axis];
+    float scale = rebuild_bin_count / extents[axis];
+
+    auto binIndex = [=](const RebuildLeaf& leaf) -> int32 {
+        return Min(int32((leaf.center[axis] - min) * scale), rebuild_bin_count - 1);
+    };
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        Bin& bin = bins[binIndex(leaves[i])];
+
+        bin.aabb = bin.count == 0 ? leaves[i].aabb : AABB::Union(bin.aabb, leaves[i].aabb);
+        ++bin.count;
+    }
+
+    // Sweep the bins from the right to get the cost of the right side of each split
+    float rightCosts[rebuild_bin_count];
+    AABB rightAABB;
+    int32 rightCount = 0;
+
+    for (int32 i = rebuild_bin_count - 1; i > 0; --i)
+    {
+        if (bins[i].count > 0)
+        {
+            rightAABB = rightCount == 0 ? bins[i].aabb : AABB::Union(rightAABB, bins[i].aabb);
+            rightCount += bins[i].count;
+        }
+
+        rightCosts[i] = rightCount == 0 ? 0.0f : rightCount * SurfaceArea(rightAABB);
+    }
+
+    // The first and the last bins always contain the extreme centroids
+    *bounds = AABB::Union(bins[0].aabb, rightAABB);
+
+    // Sweep from the left and find the cheapest split, the split is after the best bin
+    float bestCost = max_value;
+    int32 bestBin = -1;
+    AABB leftAABB;
+    int32 leftCount = 0;
+
+    for (int32 i = 0; i < rebuild_bin_count - 1; ++i)
+    {
+        if (bins[i].count > 0)
+        {
+            leftAABB = leftCount == 0 ? bins[i].aabb : AABB::Union(leftAABB, bins[i].aabb);
+            leftCount += bins[i].count;
+        }
+
+        if (leftCount == 0 || leftCount == count)
+        {
+            continue;
+        }
+
+        float cost = leftCount * SurfaceArea(leftAABB) + rightCosts[i + 1];
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestBin = i;
+        }
+    }
+
+    if (bestBin == -1)
+    {
+        return count / 2;
+    }
+
+    RebuildLeaf* mid =
+        std::partition(leaves, leaves + count, [&](const RebuildLeaf& leaf) -> bool { return binIndex(leaf) <= bestBin; });
+
+    int32 split = int32(mid - leaves);
+    if (split == 0 || split == count)
+    {
+        return count / 2;
+    }
+
+    return split;
+}
+
+// Build the subtree of the task, the root of the subtree is already linked to its parent
+// Subtrees smaller than the threshold are pushed to the deferred list instead if it is given
+static void BuildSubtree(AABBTree::Node* nodes,
+                         NodeProxy* parents,
+                         RebuildLeaf* leaves,
+                         const NodeProxy* internals,
+                         const RebuildTask& task,
+                         GrowableArray<RebuildTask, 64>* deferred,
+                         int32 threshold)
+{
+    GrowableArray<RebuildTask, 64> stack;
+    stack.PushBack(task);
+
+    while (stack.Count() > 0)
+    {
+        RebuildTask t = stack.PopBack();
+        if (t.count == 1)
+        {
+            continue;
+        }
+
+        // Leave the small subtrees to the worker threads
+        if (deferred && t.count < threshold)
+        {
+            deferred->PushBack(t);
+            continue;
+        }
+
+        NodeProxy node = internals[t.offset];
+
+        AABB bounds;
+        int32 split = PartitionLeaves(leaves + t.begin, t.count, &bounds);
+
+        RebuildTask task1{ t.begin, split, t.offset + 1 };
+        RebuildTask task2{ t.begin + split, t.count - split, t.offset + split };
+
+        NodeProxy child1 = task1.count == 1 ? leaves[task1.begin].node : internals[task1.offset];
+        NodeProxy child2 = task2.count == 1 ? leaves[task2.begin].node : internals[task2.offset];
+
+        nodes[node].aabb = bounds;
+        nodes[node].child1 = child1;
+        nodes[node].child2 = child2;
+        parents[child1] = node;
+        parents[child2] = node;
+
+        stack.PushBack(task2);
+        stack.PushBack(task1);
+    }
+}
+
+int32 AABBTree::ReleaseInternalNodes(NodeProxy* leaves)
+{
+    ++version;
+    ++structureVersion;
 
-    NodeProxy* leaves = (NodeProxy*)muli::Alloc(nodeCount * sizeof(NodeProxy));
     int32 count = 0;
 
     // Collect all leaves
     for (int32 i = 0; i < nodeCapacity; ++i)
     {
         // Already in the free list
-        if (nodes[i].parent == i)
+        if (parents[i] == i)
         {
             continue;
         }
@@ -752,7 +1251,8 @@ void AABBTree::Rebuild()
         // Clean the leaf
         if (nodes[i].IsLeaf())
         {
-            nodes[i].parent = nullNode;
+            parents[i] = nullNode;
+            refitted[i] = false;
 
             leaves[count++] = i;
         }
@@ -763,57 +1263,487 @@ void AABBTree::Rebuild()
         }
     }
 
-    while (count > 1)
+    root = nullNode;
+    return count;
+}
+
+NodeProxy* AABBTree::AllocateInternalNodes(int32 leafCount)
+{
+    // Allocate all the internal nodes up front so the builders never reallocate the node array
+    // The subtree of a task with n leaves uses the n - 1 internal nodes starting at its offset
+    NodeProxy* internals = (NodeProxy*)muli::Alloc((leafCount - 1) * sizeof(NodeProxy));
+    for (int32 i = 0; i < leafCount - 1; ++i)
     {
-        float minCost = max_value;
-        int32 minI = -1;
-        int32 minJ = -1;
+        internals[i] = AllocateNode();
+    }
 
-        // Find the best aabb pair
-        for (int32 i = 0; i < count; ++i)
-        {
-            AABB aabbI = nodes[leaves[i]].aabb;
+    return internals;
+}
 
-            for (int32 j = i + 1; j < count; ++j)
+NodeProxy AABBTree::BuildTree(const NodeProxy* leafNodes, int32 count, ThreadPool* threadPool)
+{
+    if (count <= 1)
+    {
+        return leafNodes[0];
+    }
+
+    RebuildLeaf* leaves = (RebuildLeaf*)muli::Alloc(count * sizeof(RebuildLeaf));
+    for (int32 i = 0; i < count; ++i)
+    {
+        const AABB& aabb = nodes[leafNodes[i]].aabb;
+        leaves[i] = RebuildLeaf{ aabb, aabb.GetCenter(), leafNodes[i] };
+    }
+
+    NodeProxy* internals = AllocateInternalNodes(count);
+    NodeProxy subtreeRoot = internals[0];
+
+    RebuildTask task{ 0, count, 0 };
+
+    if (threadPool == nullptr || threadPool->GetThreadCount() == 1 || count < 2 * rebuild_parallel_threshold)
+    {
+        BuildSubtree(nodes, parents, leaves, internals, task, nullptr, 0);
+    }
+    else
+    {
+        // Split the top of the tree serially until there are enough subtrees for the threads
+        int32 threshold = Max(rebuild_parallel_threshold, count / (threadPool->GetThreadCount() * 4));
+
+        GrowableArray<RebuildTask, 64> subtrees;
+        BuildSubtree(nodes, parents, leaves, internals, task, &subtrees, threshold);
+
+        threadPool->ParallelFor(subtrees.Count(), 1, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+            muliNotUsed(threadIndex);
+
+            for (int32 i = begin; i < end; ++i)
             {
-                AABB aabbJ = nodes[leaves[j]].aabb;
+                BuildSubtree(nodes, parents, leaves, internals, subtrees[i], nullptr, 0);
+            }
+        });
+    }
 
-                AABB combined = AABB::Union(aabbI, aabbJ);
-                float cost = SurfaceArea(combined);
+    muli::Free(internals);
+    muli::Free(leaves);
 
-                if (cost < minCost)
-                {
-                    minCost = cost;
-                    minI = i;
-                    minJ = j;
-                }
+    return subtreeRoot;
+}
+
+float AABBTree::ComputeTreeCost() const
+{
+    // Linear pass over the node array instead of a traversal, free nodes are their own parents
+    float cost = 0.0f;
+
+    for (int32 i = 0; i < nodeCapacity; ++i)
+    {
+        if (parents[i] != i)
+        {
+            cost += SurfaceArea(nodes[i].aabb);
+        }
+    }
+
+    return cost;
+}
+
+float AABBTree::ComputeTreeCost(NodeProxy node) const
+{
+    muliAssert(0 <= node && node < nodeCapacity);
+
+    float cost = 0.0f;
+
+    GrowableArray<NodeProxy, 256> stack;
+    stack.EmplaceBack(node);
+
+    while (stack.Count() > 0)
+    {
+        NodeProxy current = stack.PopBack();
+        cost += SurfaceArea(nodes[current].aabb);
+
+        if (nodes[current].IsLeaf() == false)
+        {
+            stack.EmplaceBack(nodes[current].child1);
+            stack.EmplaceBack(nodes[current].child2);
+        }
+    }
+
+    return cost;
+}
+
+int32 AABBTree::Optimize(int32 budget)
+{
+    if (budget <= 0 || root == nullNode || nodes[root].IsLeaf())
+    {
+        return 0;
+    }
+
+    struct Candidate
+    {
+        NodeProxy leaf;
+        float cost;
+    };
+
+    // The most costly leaves of the window, sorted by descending cost
+    GrowableArray<Candidate, 32> candidates;
+
+    int32 windowSize = Min(budget * 16, nodeCapacity);
+    for (int32 i = 0; i < windowSize; ++i)
+    {
+        NodeProxy node = optimizeCursor;
+        optimizeCursor = (optimizeCursor + 1) % nodeCapacity;
+
+        // Skip the free nodes, the internal nodes and the root
+        NodeProxy parent = parents[node];
+        if (parent == node || parent == nullNode || nodes[node].IsLeaf() == false)
+        {
+            continue;
+        }
+
+        // Removing the leaf frees its parent and shrinks the ancestors, the parent dominates the saving
+        float cost = SurfaceArea(nodes[parent].aabb);
+
+        if (candidates.Count() == budget)
+        {
+            if (cost <= candidates.Back().cost)
+            {
+                continue;
             }
+
+            candidates.PopBack();
+        }
+
+        int32 j = candidates.Count();
+        candidates.EmplaceBack(node, cost);
+
+        while (j > 0 && candidates[j - 1].cost < cost)
+        {
+            candidates[j] = candidates[j - 1];
+            --j;
+        }
+        candidates[j] = Candidate{ node, cost };
+    }
+
+    // Leaves keep their node and bounds, InsertLeaf() finds the best sibling and rotates the new ancestors
+    for (int32 i = 0; i < candidates.Count(); ++i)
+    {
+        NodeProxy leaf = candidates[i].leaf;
+
+        RemoveLeaf(leaf);
+        InsertLeaf(leaf);
+    }
+
+    return candidates.Count();
+}
+
+void AABBTree::Rebuild(ThreadPool* threadPool)
+{
+    // Rebuild tree with top down approach, splitting the leaves by the binned surface area heuristic in O(n log n)
+
+    if (root == nullNode)
+    {
+        return;
+    }
+
+    NodeProxy* leafNodes = (NodeProxy*)muli::Alloc(nodeCount * sizeof(NodeProxy));
+    int32 count = ReleaseInternalNodes(leafNodes);
+
+    root = BuildTree(leafNodes, count, threadPool);
+    parents[root] = nullNode;
+
+    muli::Free(leafNodes);
+}
+
+NodeProxy AABBTree::RebuildSubtree(NodeProxy node, ThreadPool* threadPool)
+{
+    muliAssert(0 <= node && node < nodeCapacity);
+
+    if (nodes[node].IsLeaf())
+    {
+        return node;
+    }
+
+    ++version;
+    ++structureVersion;
+
+    NodeProxy parent = parents[node];
+
+    // Detach the leaves of the subtree and free its internal nodes
+    GrowableArray<NodeProxy, 256> leafNodes;
+    GrowableArray<NodeProxy, 256> stack;
+    stack.EmplaceBack(node);
+
+    while (stack.Count() > 0)
+    {
+        NodeProxy current = stack.PopBack();
+        refitted[current] = false;
+
+        if (nodes[current].IsLeaf())
+        {
+            parents[current] = nullNode;
+            leafNodes.EmplaceBack(current);
+        }
+        else
+        {
+            stack.EmplaceBack(nodes[current].child1);
+            stack.EmplaceBack(nodes[current].child2);
+            FreeNode(current);
+        }
+    }
+
+    // The subtree keeps its place and its bounds, so the ancestors are still valid
+    NodeProxy subtreeRoot = BuildTree(&leafNodes[0], leafNodes.Count(), threadPool);
+    parents[subtreeRoot] = parent;
+
+    if (parent == nullNode)
+    {
+        root = subtreeRoot;
+    }
+    else if (nodes[parent].child1 == node)
+    {
+        nodes[parent].child1 = subtreeRoot;
+    }
+    else
+    {
+        nodes[parent].child2 = subtreeRoot;
+    }
+
+    return subtreeRoot;
+}
+
+// Spread the lower 16 bits of the value to the even bits
+static uint32 SpreadBits(uint32 v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+struct MortonLeaf
+{
+    uint32 code;
+    NodeProxy node;
+};
+
+// Split the range of the sorted codes at the highest bit where the first and the last codes differ
+static int32 FindMortonSplit(const MortonLeaf* leaves, int32 count)
+{
+    uint32 first = leaves[0].code;
+    uint32 last = leaves[count - 1].code;
+
+    if (first == last)
+    {
+        return count / 2;
+    }
+
+    int32 commonPrefix = std::countl_zero(first ^ last);
+
+    // Binary search the last leaf that shares more than the common prefix with the first one
+    int32 split = 0;
+    int32 step = count - 1;
+
+    do
+    {
+        step = (step + 1) >> 1;
+        int32 newSplit = split + step;
+
+        if (newSplit < count - 1 && std::countl_zero(first ^ leaves[newSplit].code) > commonPrefix)
+        {
+            split = newSplit;
         }
+    } while (step > 1);
 
-        NodeProxy index1 = leaves[minI];
-        NodeProxy index2 = leaves[minJ];
-        Node* child1 = nodes + index1;
-        Node* child2 = nodes + index2;
+    return split + 1;
+}
 
-        // Create a parent(internal) node
-        NodeProxy parentIndex = AllocateNode();
-        Node* parent = nodes + parentIndex;
+// Write the indices sorted by their group first and then along the morton curve of their points to outOrder
+// Ties are broken by the index so the order is deterministic
+template <typename PointFcn, typename GroupFcn>
+static void SortMortonOrder(int32 count, PointFcn getPoint, GroupFcn getGroup, int32* outOrder)
+{
+    if (count == 0)
+    {
+        return;
+    }
 
-        parent->child1 = index1;
-        parent->child2 = index2;
-        parent->aabb = AABB::Union(child1->aabb, child2->aabb);
-        parent->parent = nullNode;
+    AABB bounds{ getPoint(0), getPoint(0) };
+    for (int32 i = 1; i < count; ++i)
+    {
+        Vec2 p = getPoint(i);
+        bounds.min = Min(bounds.min, p);
+        bounds.max = Max(bounds.max, p);
+    }
 
-        child1->parent = parentIndex;
-        child2->parent = parentIndex;
+    // Quantize the points to 16 bits per axis
+    Vec2 extents = bounds.max - bounds.min;
+    Vec2 scale{ extents.x > 0.0f ? 65535.0f / extents.x : 0.0f, extents.y > 0.0f ? 65535.0f / extents.y : 0.0f };
 
-        leaves[minI] = parentIndex;
+    struct MortonIndex
+    {
+        uint64 code;
+        int32 index;
+    };
+
+    MortonIndex* indices = (MortonIndex*)muli::Alloc(count * sizeof(MortonIndex));
+    for (int32 i = 0; i < count; ++i)
+    {
+        Vec2 p = getPoint(i) - bounds.min;
+
+        uint32 x = uint32(p.x * scale.x);
+        uint32 y = uint32(p.y * scale.y);
+        indices[i] = MortonIndex{ (uint64(getGroup(i)) << 32) | ((SpreadBits(y) << 1) | SpreadBits(x)), i };
+    }
+
+    std::sort(indices, indices + count, [](const MortonIndex& a, const MortonIndex& b) -> bool {
+        return a.code < b.code || (a.code == b.code && a.index < b.index);
+    });
 
-        leaves[minJ] = leaves[count - 1];
-        --count;
+    for (int32 i = 0; i < count; ++i)
+    {
+        outOrder[i] = indices[i].index;
+    }
+
+    muli::Free(indices);
+}
+
+void AABBTree::SortQueries(std::span<const AABB> aabbs, int32* outOrder)
+{
+    auto getCenter = [&](int32 i) -> Vec2 { return aabbs[i].GetCenter(); };
+    auto getGroup = [](int32 i) -> uint32 {
+        muliNotUsed(i);
+        return 0;
+    };
+
+    SortMortonOrder(int32(aabbs.size()), getCenter, getGroup, outOrder);
+}
+
+void AABBTree::SortRays(std::span<const AABBCastInput> inputs, int32* outOrder)
+{
+    // Rays heading into the same quadrant can share a packet, and the rays of a packet should pass nearby
+    auto getCenter = [&](int32 i) -> Vec2 { return (inputs[i].from + inputs[i].to) * 0.5f; };
+    auto getQuadrant = [&](int32 i) -> uint32 { return GetRayQuadrant(inputs[i]); };
+
+    SortMortonOrder(int32(inputs.size()), getCenter, getQuadrant, outOrder);
+}
+
+void AABBTree::CreateNodes(std::span<Data*> data, std::span<const AABB> aabbs, NodeProxy* outNodes, bool refine)
+{
+    muliAssert(data.size() == aabbs.size());
+
+    int32 newCount = int32(data.size());
+    if (newCount == 0)
+    {
+        return;
+    }
+
+    int32 oldCount = root == nullNode ? 0 : (nodeCount + 1) / 2;
+
+    for (int32 i = 0; i < newCount; ++i)
+    {
+        NodeProxy newNode = AllocateNode();
+
+        // Fatten the aabb
+        nodes[newNode].aabb.max = aabbs[i].max + margin;
+        nodes[newNode].aabb.min = aabbs[i].min - margin;
+        userData[newNode] = data[i];
+        parents[newNode] = nullNode;
+        moved[newNode] = true;
+
+        outNodes[i] = newNode;
+    }
+
+    // A few nodes streamed into a large tree are cheaper to insert one by one
+    if (newCount < oldCount)
+    {
+        for (int32 i = 0; i < newCount; ++i)
+        {
+            InsertLeaf(outNodes[i]);
+        }
+        return;
+    }
+
+    // Otherwise build a linear bvh of all the leaves from their sorted morton codes
+    NodeProxy* leafNodes = (NodeProxy*)muli::Alloc((oldCount + newCount) * sizeof(NodeProxy));
+    int32 count = ReleaseInternalNodes(leafNodes);
+
+    if (count <= 1)
+    {
+        root = leafNodes[0];
+        muli::Free(leafNodes);
+        return;
+    }
+
+    AABB centerBounds{ nodes[leafNodes[0]].aabb.GetCenter(), nodes[leafNodes[0]].aabb.GetCenter() };
+    for (int32 i = 1; i < count; ++i)
+    {
+        Vec2 center = nodes[leafNodes[i]].aabb.GetCenter();
+        centerBounds.min = Min(centerBounds.min, center);
+        centerBounds.max = Max(centerBounds.max, center);
+    }
+
+    // Quantize the centers to 16 bits per axis
+    Vec2 extents = centerBounds.max - centerBounds.min;
+    Vec2 scale{ extents.x > 0.0f ? 65535.0f / extents.x : 0.0f, extents.y > 0.0f ? 65535.0f / extents.y : 0.0f };
+
+    MortonLeaf* leaves = (MortonLeaf*)muli::Alloc(count * sizeof(MortonLeaf));
+    for (int32 i = 0; i < count; ++i)
+    {
+        Vec2 p = nodes[leafNodes[i]].aabb.GetCenter() - centerBounds.min;
+
+        uint32 x = uint32(p.x * scale.x);
+        uint32 y = uint32(p.y * scale.y);
+        leaves[i] = MortonLeaf{ (SpreadBits(y) << 1) | SpreadBits(x), leafNodes[i] };
+    }
+    muli::Free(leafNodes);
+
+    std::sort(leaves, leaves + count, [](const MortonLeaf& a, const MortonLeaf& b) -> bool { return a.code < b.code; });
+
+    NodeProxy* internals = AllocateInternalNodes(count);
+    root = internals[0];
+
+    // Link the nodes top down, the internal nodes end up in preorder
+    GrowableArray<RebuildTask, 64> stack;
+    stack.PushBack(RebuildTask{ 0, count, 0 });
+
+    while (stack.Count() > 0)
+    {
+        RebuildTask t = stack.PopBack();
+        if (t.count == 1)
+        {
+            continue;
+        }
+
+        NodeProxy node = internals[t.offset];
+        int32 split = FindMortonSplit(leaves + t.begin, t.count);
+
+        RebuildTask task1{ t.begin, split, t.offset + 1 };
+        RebuildTask task2{ t.begin + split, t.count - split, t.offset + split };
+
+        NodeProxy child1 = task1.count == 1 ? leaves[task1.begin].node : internals[task1.offset];
+        NodeProxy child2 = task2.count == 1 ? leaves[task2.begin].node : internals[task2.offset];
+
+        nodes[node].child1 = child1;
+        nodes[node].child2 = child2;
+        parents[child1] = node;
+        parents[child2] = node;
+
+        stack.PushBack(task2);
+        stack.PushBack(task1);
+    }
+
+    // Children come after their parent in preorder, so the reversed order refits the tree bottom up
+    // Rotations fix the splits the morton curve made across clusters
+    for (int32 i = count - 2; i >= 0; --i)
+    {
+        NodeProxy node = internals[i];
+        nodes[node].aabb = AABB::Union(nodes[nodes[node].child1].aabb, nodes[nodes[node].child2].aabb);
+
+        if (refine)
+        {
+            Rotate(node);
+        }
     }
 
-    root = leaves[0];
+    muli::Free(internals);
     muli::Free(leaves);
 }
 
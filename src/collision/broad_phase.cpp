@@ -8,144 +8,90 @@ namespace muli
 BroadPhase::BroadPhase(World* _world, ContactManager* _contactManager)
     : world{ _world }
     , contactManager{ _contactManager }
-    , moveCapacity{ 16 }
-    , moveCount{ 0 }
 {
-    moveBuffer = (NodeProxy*)muli::Alloc(moveCapacity * sizeof(NodeProxy));
 }
 
-BroadPhase::~BroadPhase()
+void BroadPhase::BulkAdd(std::span<Collider*> colliders, std::span<const AABB> aabbs)
 {
-    muli::Free(moveBuffer);
-}
+    muliAssert(colliders.size() == aabbs.size());
 
-void BroadPhase::BufferMove(NodeProxy node)
-{
-    // Grow the buffer as needed
-    if (moveCount == moveCapacity)
+    for (size_t i = 0; i < colliders.size(); ++i)
     {
-        NodeProxy* old = moveBuffer;
-        moveCapacity *= 2;
-        moveBuffer = (NodeProxy*)muli::Alloc(moveCapacity * sizeof(NodeProxy));
-        memcpy(moveBuffer, old, moveCount * sizeof(NodeProxy));
-        muli::Free(old);
+        Add(colliders[i], aabbs[i]);
     }
-
-    moveBuffer[moveCount] = node;
-    ++moveCount;
 }
 
-void BroadPhase::UnBufferMove(NodeProxy node)
+void BroadPhase::BulkRemove(std::span<Collider*> colliders)
 {
-    for (int32 i = 0; i < moveCount; ++i)
+    for (size_t i = 0; i < colliders.size(); ++i)
     {
-        if (moveBuffer[i] == node)
-        {
-            moveBuffer[i] = AABBTree::nullNode;
-        }
+        Remove(colliders[i]);
     }
 }
 
-void BroadPhase::FindNewContacts()
+void BroadPhase::Query(std::span<const AABB> aabbs, QueryHitBuffer& hits) const
 {
-    for (int32 i = 0; i < moveCount; ++i)
+    for (size_t i = 0; i < aabbs.size(); ++i)
     {
-        nodeA = moveBuffer[i];
-        if (nodeA == AABBTree::nullNode)
-        {
-            continue;
-        }
-
-        colliderA = tree.GetData(nodeA);
-        bodyA = colliderA->body;
-        typeA = colliderA->GetType();
+        Query(aabbs[i], [&](NodeProxy node, Collider* collider) -> bool {
+            muliNotUsed(node);
 
-        const AABB& treeAABB = tree.GetAABB(colliderA->node);
-
-        // This will callback our BroadPhase::QueryCallback(NodeProxy, Collider*)
-        tree.Query(treeAABB, this);
+            hits.EmplaceBack(int32(i), collider);
+            return true;
+        });
     }
+}
 
-    // Clear move buffer for next step
-    for (int32 i = 0; i < moveCount; ++i)
+void BroadPhase::AABBCast(std::span<const AABBCastInput> inputs,
+                          const std::function<float(int32, const AABBCastInput&, Collider*)>& callback) const
+{
+    for (size_t i = 0; i < inputs.size(); ++i)
     {
-        NodeProxy node = moveBuffer[i];
-        if (node != AABBTree::nullNode)
-        {
-            tree.ClearMoved(node);
-        }
+        AABBCast(inputs[i], [&](const AABBCastInput& subInput, Collider* collider) -> float {
+            return callback(int32(i), subInput, collider);
+        });
     }
-
-    moveCount = 0;
 }
 
-void BroadPhase::Add(Collider* collider, const AABB& aabb)
+void BroadPhase::CreateContacts(PairBuffer& pairs)
 {
-    NodeProxy node = tree.CreateNode(collider, aabb);
-    collider->node = node;
+    // A pair can be reported more than once, sorting puts the duplicates next to each other
+    std::sort(&pairs[0], &pairs[0] + pairs.Count(), [](const ProxyPair& a, const ProxyPair& b) -> bool {
+        return a.proxyA < b.proxyA || (a.proxyA == b.proxyA && a.proxyB < b.proxyB);
+    });
 
-    BufferMove(node);
-}
+    for (int32 i = 0; i < pairs.Count(); ++i)
+    {
+        const ProxyPair& pair = pairs[i];
 
-void BroadPhase::Remove(Collider* collider)
-{
-    NodeProxy node = collider->node;
-    tree.RemoveNode(node);
+        if (i > 0 && pair.proxyA == pairs[i - 1].proxyA && pair.proxyB == pairs[i - 1].proxyB)
+        {
+            continue;
+        }
 
-    UnBufferMove(node);
-}
+        Collider* colliderA = GetCollider(pair.proxyA);
+        Collider* colliderB = GetCollider(pair.proxyB);
 
-void BroadPhase::Update(Collider* collider, const AABB& aabb, const Vec2& displacement)
-{
-    NodeProxy node = collider->node;
-    bool rested = collider->body->resting > world->settings.sleeping_time;
-
-    bool nodeMoved = tree.MoveNode(node, aabb, displacement, rested);
-    if (nodeMoved)
-    {
-        BufferMove(node);
+        if (colliderA->GetType() <= colliderB->GetType())
+        {
+            contactManager->OnNewContact(colliderB, colliderA);
+        }
+        else
+        {
+            contactManager->OnNewContact(colliderA, colliderB);
+        }
     }
-}
-
-void BroadPhase::Refresh(Collider* collider)
-{
-    NodeProxy node = collider->node;
-    AABB aabb = collider->GetAABB();
 
-    tree.MoveNode(node, aabb, Vec2::zero, true);
-    BufferMove(node);
+    pairs.Clear();
 }
 
-bool BroadPhase::QueryCallback(NodeProxy nodeB, Collider* colliderB)
+bool BroadPhase::HasJustRested(const Collider* collider) const
 {
-    if (nodeA == nodeB)
-    {
-        return true;
-    }
-
-    RigidBody* bodyB = colliderB->body;
-    if (bodyA == bodyB)
-    {
-        return true;
-    }
-
-    // Avoid duplicate contact
-    if (tree.WasMoved(nodeB) && nodeA < nodeB)
-    {
-        return true;
-    }
-
-    Shape::Type typeB = colliderB->GetType();
-    if (typeA <= typeB)
-    {
-        contactManager->OnNewContact(colliderB, colliderA);
-    }
-    else
-    {
-        contactManager->OnNewContact(colliderA, colliderB);
-    }
+    // Bodies keep their own resting time, so only do it on the step the sleeping time is crossed
+    float resting = collider->body->resting;
+    float sleepingTime = world->settings.sleeping_time;
 
-    return true;
+    return resting > sleepingTime && resting - world->settings.step.dt <= sleepingTime;
 }
 
-} // namespace muli
\ No newline at end of file
+} // namespace muli
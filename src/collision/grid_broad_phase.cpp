@@ -0,0 +1,624 @@
+#include "muli/grid_broad_phase.h"
+#include "muli/contact_manager.h"
+#include "muli/world.h"
+
+namespace muli
+{
+
+GridBroadPhase::GridBroadPhase(World* _world, ContactManager* _contactManager)
+    : BroadPhase(_world, _contactManager)
+    , cellSize{ _world->settings.grid_cell_size }
+    , invCellSize{ 1.0f / _world->settings.grid_cell_size }
+    , proxyCapacity{ 32 }
+    , proxyCount{ 0 }
+    , freeList{ 0 }
+    , bucketCount{ 256 }
+    , cellEntryCount{ 0 }
+    , pairBufferCount{ 0 }
+{
+    muliAssert(cellSize > 0.0f);
+
+    proxies = (Proxy*)muli::Alloc(proxyCapacity * sizeof(Proxy));
+
+    // Build a linked list for the free list
+    for (int32 i = 0; i < proxyCapacity; ++i)
+    {
+        proxies[i].collider = nullptr;
+        proxies[i].next = i + 1;
+        proxies[i].moved = false;
+    }
+    proxies[proxyCapacity - 1].next = AABBTree::nullNode;
+
+    buckets = std::make_unique<Bucket[]>(bucketCount);
+}
+
+GridBroadPhase::~GridBroadPhase() noexcept
+{
+    muli::Free(proxies);
+}
+
+int32 GridBroadPhase::AllocateProxy()
+{
+    if (freeList == AABBTree::nullNode)
+    {
+        muliAssert(proxyCount == proxyCapacity);
+
+        // Grow the proxy pool
+        Proxy* old = proxies;
+        proxyCapacity *= 2;
+        proxies = (Proxy*)muli::Alloc(proxyCapacity * sizeof(Proxy));
+        memcpy(proxies, old, proxyCount * sizeof(Proxy));
+        muli::Free(old);
+
+        for (int32 i = proxyCount; i < proxyCapacity; ++i)
+        {
+            proxies[i].collider = nullptr;
+            proxies[i].next = i + 1;
+            proxies[i].moved = false;
+        }
+        proxies[proxyCapacity - 1].next = AABBTree::nullNode;
+
+        freeList = proxyCount;
+    }
+
+    int32 proxy = freeList;
+    freeList = proxies[proxy].next;
+    ++proxyCount;
+
+    return proxy;
+}
+
+void GridBroadPhase::FreeProxy(NodeProxy proxy)
+{
+    muliAssert(0 <= proxy && proxy < proxyCapacity);
+
+    // Keep the moved flag, the proxy may still be in the move buffer
+    proxies[proxy].collider = nullptr;
+    proxies[proxy].next = freeList;
+    freeList = proxy;
+    --proxyCount;
+}
+
+void GridBroadPhase::InsertProxy(NodeProxy proxy)
+{
+    Proxy& p = proxies[proxy];
+
+    if (IsLarge(p.cells))
+    {
+        p.largeIndex = largeProxies.Count();
+        largeProxies.PushBack(proxy);
+        return;
+    }
+
+    p.largeIndex = -1;
+
+    for (int32 y = p.cells.minY; y <= p.cells.maxY; ++y)
+    {
+        for (int32 x = p.cells.minX; x <= p.cells.maxX; ++x)
+        {
+            Bucket& bucket = GetBucket(x, y);
+
+            // Two cells of the proxy can be hashed into the same bucket
+            bool found = false;
+            for (int32 i = 0; i < bucket.Count(); ++i)
+            {
+                if (bucket[i] == proxy)
+                {
+                    found = true;
+                    break;
+                }
+            }
+
+            if (found == false)
+            {
+                bucket.PushBack(proxy);
+                ++cellEntryCount;
+            }
+        }
+    }
+
+    if (cellEntryCount > bucketCount)
+    {
+        GrowBuckets();
+    }
+}
+
+void GridBroadPhase::RemoveProxy(NodeProxy proxy)
+{
+    Proxy& p = proxies[proxy];
+
+    if (p.largeIndex != -1)
+    {
+        NodeProxy last = largeProxies.Back();
+        proxies[last].largeIndex = p.largeIndex;
+        largeProxies.RemoveSwap(p.largeIndex);
+        p.largeIndex = -1;
+        return;
+    }
+
+    for (int32 y = p.cells.minY; y <= p.cells.maxY; ++y)
+    {
+        for (int32 x = p.cells.minX; x <= p.cells.maxX; ++x)
+        {
+            Bucket& bucket = GetBucket(x, y);
+
+            for (int32 i = 0; i < bucket.Count(); ++i)
+            {
+                if (bucket[i] == proxy)
+                {
+                    bucket.RemoveSwap(i);
+                    --cellEntryCount;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void GridBroadPhase::GrowBuckets()
+{
+    bucketCount *= 2;
+    buckets = std::make_unique<Bucket[]>(bucketCount);
+    cellEntryCount = 0;
+
+    for (int32 i = 0; i < proxyCapacity; ++i)
+    {
+        if (proxies[i].collider != nullptr && proxies[i].largeIndex == -1)
+        {
+            InsertProxy(i);
+        }
+    }
+}
+
+void GridBroadPhase::BufferMove(NodeProxy proxy)
+{
+    if (proxies[proxy].moved == false)
+    {
+        proxies[proxy].moved = true;
+        moveBuffer.PushBack(proxy);
+    }
+}
+
+template <typename F>
+bool GridBroadPhase::ForEachOverlap(const AABB& aabb, F&& function) const
+{
+    CellRange q = GetCellRange(aabb);
+
+    int64 cellCount = (int64(q.maxX) - q.minX + 1) * (int64(q.maxY) - q.minY + 1);
+
+    // Visiting the cells costs more than testing all the proxies
+    if (cellCount > proxyCount)
+    {
+        for (int32 i = 0; i < proxyCapacity; ++i)
+        {
+            if (proxies[i].collider == nullptr || proxies[i].aabb.TestOverlap(aabb) == false)
+            {
+                continue;
+            }
+
+            if (function(i) == false)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    for (int32 y = q.minY; y <= q.maxY; ++y)
+    {
+        for (int32 x = q.minX; x <= q.maxX; ++x)
+        {
+            const Bucket& bucket = GetBucket(x, y);
+
+            for (int32 i = 0; i < bucket.Count(); ++i)
+            {
+                NodeProxy proxy = bucket[i];
+                const Proxy& p = proxies[proxy];
+
+                // Visit the proxy only in the first cell shared with the query,
+                // this also skips the proxies of other cells hashed into the same bucket
+                if (Max(p.cells.minX, q.minX) != x || Max(p.cells.minY, q.minY) != y)
+                {
+                    continue;
+                }
+
+                if (p.aabb.TestOverlap(aabb) == false)
+                {
+                    continue;
+                }
+
+                if (function(proxy) == false)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (int32 i = 0; i < largeProxies.Count(); ++i)
+    {
+        NodeProxy proxy = largeProxies[i];
+        if (proxies[proxy].aabb.TestOverlap(aabb) == false)
+        {
+            continue;
+        }
+
+        if (function(proxy) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void GridBroadPhase::FindNewContacts()
+{
+    ThreadPool& threadPool = world->threadPool;
+
+    if (pairBuffers == nullptr)
+    {
+        pairBufferCount = threadPool.GetThreadCount();
+        pairBuffers = std::make_unique<PairBuffer[]>(pairBufferCount);
+    }
+
+    // The grid is read only during the queries, so the move buffer can be queried in parallel
+    threadPool.ParallelFor(moveBuffer.Count(), parallel_grain_size, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+        PairBuffer& pairs = pairBuffers[threadIndex];
+
+        for (int32 i = begin; i < end; ++i)
+        {
+            NodeProxy proxyA = moveBuffer[i];
+            const Proxy& a = proxies[proxyA];
+            if (a.collider == nullptr)
+            {
+                continue;
+            }
+
+            RigidBody* bodyA = a.collider->body;
+            bool dynamicA = bodyA->GetType() == RigidBody::Type::dynamic_body;
+
+            ForEachOverlap(a.aabb, [&](NodeProxy proxyB) -> bool {
+                const Proxy& b = proxies[proxyB];
+
+                if (proxyA == proxyB)
+                {
+                    return true;
+                }
+
+                RigidBody* bodyB = b.collider->body;
+                if (bodyA == bodyB)
+                {
+                    return true;
+                }
+
+                if (dynamicA == false && bodyB->GetType() != RigidBody::Type::dynamic_body)
+                {
+                    return true;
+                }
+
+                // Avoid duplicate pair, the other moved proxy reports it
+                if (b.moved && proxyA < proxyB)
+                {
+                    return true;
+                }
+
+                pairs.EmplaceBack(Min(proxyA, proxyB), Max(proxyA, proxyB));
+                return true;
+            });
+        }
+    });
+
+    // Merge the thread buffers into the first one
+    PairBuffer& pairs = pairBuffers[0];
+    for (int32 i = 1; i < pairBufferCount; ++i)
+    {
+        PairBuffer& threadPairs = pairBuffers[i];
+        for (int32 j = 0; j < threadPairs.Count(); ++j)
+        {
+            pairs.PushBack(threadPairs[j]);
+        }
+        threadPairs.Clear();
+    }
+
+    CreateContacts(pairs);
+
+    // Clear move buffer for next step
+    for (int32 i = 0; i < moveBuffer.Count(); ++i)
+    {
+        proxies[moveBuffer[i]].moved = false;
+    }
+
+    moveBuffer.Clear();
+}
+
+void GridBroadPhase::Add(Collider* collider, const AABB& aabb)
+{
+    NodeProxy proxy = AllocateProxy();
+    Proxy& p = proxies[proxy];
+
+    p.collider = collider;
+    p.aabb.min = aabb.min - aabb_margin;
+    p.aabb.max = aabb.max + aabb_margin;
+    p.cells = GetCellRange(p.aabb);
+
+    InsertProxy(proxy);
+
+    collider->proxy = proxy;
+
+    BufferMove(proxy);
+}
+
+void GridBroadPhase::Remove(Collider* collider)
+{
+    NodeProxy proxy = collider->proxy;
+
+    RemoveProxy(proxy);
+    FreeProxy(proxy);
+}
+
+void GridBroadPhase::Update(Collider* collider, const AABB& aabb, const Vec2& displacement)
+{
+    NodeProxy proxy = collider->proxy;
+    Proxy& p = proxies[proxy];
+
+    if (p.aabb.Contains(aabb) && HasJustRested(collider) == false)
+    {
+        return;
+    }
+
+    // Fatten the aabb the same way as AABBTree::MoveNode()
+    AABB fatAABB = aabb;
+    Vec2 d = displacement * aabb_multiplier;
+
+    if (d.x > 0.0f)
+    {
+        fatAABB.max.x += d.x;
+    }
+    else
+    {
+        fatAABB.min.x += d.x;
+    }
+
+    if (d.y > 0.0f)
+    {
+        fatAABB.max.y += d.y;
+    }
+    else
+    {
+        fatAABB.min.y += d.y;
+    }
+
+    fatAABB.max += aabb_margin;
+    fatAABB.min -= aabb_margin;
+
+    p.aabb = fatAABB;
+
+    // Only touch the buckets if the proxy has crossed a cell boundary
+    CellRange cells = GetCellRange(fatAABB);
+    if (cells.minX != p.cells.minX || cells.minY != p.cells.minY || cells.maxX != p.cells.maxX || cells.maxY != p.cells.maxY)
+    {
+        RemoveProxy(proxy);
+        p.cells = cells;
+        InsertProxy(proxy);
+    }
+
+    BufferMove(proxy);
+}
+
+void GridBroadPhase::Refresh(Collider* collider)
+{
+    // Tighten the proxy and report all its overlaps again
+    Remove(collider);
+    Add(collider, collider->GetAABB());
+}
+
+void GridBroadPhase::Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const
+{
+    ForEachOverlap(AABB{ point, point }, [&](NodeProxy proxy) -> bool { return callback(proxy, proxies[proxy].collider); });
+}
+
+void GridBroadPhase::Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const
+{
+    ForEachOverlap(aabb, [&](NodeProxy proxy) -> bool { return callback(proxy, proxies[proxy].collider); });
+}
+
+void GridBroadPhase::AABBCast(const AABBCastInput& input,
+                              const std::function<float(const AABBCastInput&, Collider*)>& callback) const
+{
+    const Vec2 p1 = input.from;
+    const Vec2 p2 = input.to;
+    const Vec2 halfExtents = input.halfExtents;
+
+    float maxFraction = input.maxFraction;
+
+    Vec2 d = p2 - p1;
+    if (d.Length2() == 0.0f)
+    {
+        return;
+    }
+
+    Vec2 end = p1 + maxFraction * d;
+    AABB sweptAABB{ Min(p1, end) - halfExtents, Max(p1, end) + halfExtents };
+
+    struct Candidate
+    {
+        float fraction;
+        NodeProxy proxy;
+    };
+
+    GrowableArray<Candidate, 64> candidates;
+
+    auto addCandidate = [&](NodeProxy proxy) -> void {
+        float fraction = proxies[proxy].aabb.RayCast(p1, p2, 0.0f, maxFraction, halfExtents);
+        if (fraction != max_value)
+        {
+            candidates.EmplaceBack(fraction, proxy);
+        }
+    };
+
+    // Visit the collected proxies front to back so the callbacks shorten the ray early
+    // Returns false if a callback terminated the cast
+    auto visitCandidates = [&]() -> bool {
+        if (candidates.Count() == 0)
+        {
+            return true;
+        }
+
+        // A proxy covering several cells is collected more than once, the copies end up next to each other
+        std::sort(&candidates[0], &candidates[0] + candidates.Count(), [](const Candidate& a, const Candidate& b) -> bool {
+            return a.fraction < b.fraction || (a.fraction == b.fraction && a.proxy < b.proxy);
+        });
+
+        for (int32 i = 0; i < candidates.Count(); ++i)
+        {
+            const Candidate& candidate = candidates[i];
+
+            if (i > 0 && candidate.proxy == candidates[i - 1].proxy)
+            {
+                continue;
+            }
+
+            if (candidate.fraction > maxFraction)
+            {
+                break;
+            }
+
+            AABBCastInput subInput;
+            subInput.from = p1;
+            subInput.to = p2;
+            subInput.maxFraction = maxFraction;
+            subInput.halfExtents = halfExtents;
+
+            float newFraction = callback(subInput, proxies[candidate.proxy].collider);
+            if (newFraction == 0.0f)
+            {
+                return false;
+            }
+
+            if (newFraction > 0.0f)
+            {
+                // Shorten the ray
+                maxFraction = newFraction;
+            }
+        }
+
+        candidates.Clear();
+        return true;
+    };
+
+    CellRange r = GetCellRange(sweptAABB);
+
+    int64 columnCount = int64(r.maxX) - r.minX + 1;
+    int64 rowCount = int64(r.maxY) - r.minY + 1;
+
+    if (columnCount + rowCount > proxyCount)
+    {
+        // Long ray over a sparse grid, test all the proxies
+        for (int32 i = 0; i < proxyCapacity; ++i)
+        {
+            if (proxies[i].collider != nullptr && proxies[i].aabb.TestOverlap(sweptAABB))
+            {
+                addCandidate(i);
+            }
+        }
+
+        visitCandidates();
+        return;
+    }
+
+    // Walk the columns crossed by the swept box in the ray direction and visit the rows it covers in each column
+    // A proxy is collected in the first of its columns reached by the ray, so the walk stops once the next column
+    // begins beyond the shortened ray
+    // The visited rows of consecutive columns overlap, so a proxy is already collected if it covers the rows visited in
+    // the previous column
+    // Slightly thicken the ray so the cells along the column boundaries are not missed by rounding
+    Vec2 extents = halfExtents + Vec2{ linear_slop };
+
+    int32 step = d.x >= 0.0f ? 1 : -1;
+    int32 first = d.x >= 0.0f ? r.minX : r.maxX;
+    int32 last = d.x >= 0.0f ? r.maxX : r.minX;
+
+    bool prevVisited = false;
+    int32 prevMinY = 0;
+    int32 prevMaxY = 0;
+
+    for (int32 x = first;; x += step)
+    {
+        float t0 = 0.0f;
+        float t1 = maxFraction;
+
+        if (d.x != 0.0f)
+        {
+            float ta = (x * cellSize - extents.x - p1.x) / d.x;
+            float tb = ((x + 1) * cellSize + extents.x - p1.x) / d.x;
+
+            t0 = Max(t0, Min(ta, tb));
+            t1 = Min(t1, Max(ta, tb));
+        }
+
+        if (t0 > maxFraction)
+        {
+            break;
+        }
+
+        bool visited = t0 <= t1;
+        int32 minY = 0;
+        int32 maxY = 0;
+
+        if (visited)
+        {
+            float ya = p1.y + t0 * d.y;
+            float yb = p1.y + t1 * d.y;
+
+            minY = Max(r.minY, GetCellCoord(Min(ya, yb) - extents.y));
+            maxY = Min(r.maxY, GetCellCoord(Max(ya, yb) + extents.y));
+
+            for (int32 y = minY; y <= maxY; ++y)
+            {
+                const Bucket& bucket = GetBucket(x, y);
+
+                for (int32 i = 0; i < bucket.Count(); ++i)
+                {
+                    const CellRange& cells = proxies[bucket[i]].cells;
+
+                    // Skip the proxies of other cells hashed into the same bucket
+                    if (x < cells.minX || x > cells.maxX || y < cells.minY || y > cells.maxY)
+                    {
+                        continue;
+                    }
+
+                    // Skip the proxies already collected in the previous columns
+                    int32 prevX = x - step;
+                    if (prevVisited && prevX >= cells.minX && prevX <= cells.maxX && cells.minY <= prevMaxY &&
+                        cells.maxY >= prevMinY)
+                    {
+                        continue;
+                    }
+
+                    addCandidate(bucket[i]);
+                }
+            }
+        }
+
+        prevVisited = visited;
+        prevMinY = minY;
+        prevMaxY = maxY;
+
+        if (x == first)
+        {
+            for (int32 i = 0; i < largeProxies.Count(); ++i)
+            {
+                addCandidate(largeProxies[i]);
+            }
+        }
+
+        if (visitCandidates() == false || x == last)
+        {
+            break;
+        }
+    }
+}
+
+} // namespace muli
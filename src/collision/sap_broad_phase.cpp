@@ -0,0 +1,415 @@
+#include "muli/sap_broad_phase.h"
+#include "muli/contact_manager.h"
+#include "muli/world.h"
+
+namespace muli
+{
+
+// Endpoints of the same value are ordered min first, so touching boxes overlap like in AABB::TestOverlap()
+static inline bool EndPointLess(float valueA, bool maxA, float valueB, bool maxB)
+{
+    return valueA < valueB || (valueA == valueB && maxA == false && maxB == true);
+}
+
+SAPBroadPhase::SAPBroadPhase(World* _world, ContactManager* _contactManager)
+    : BroadPhase(_world, _contactManager)
+    , boxCapacity{ 32 }
+    , boxCount{ 0 }
+    , freeList{ 0 }
+    , endPointCount{ 0 }
+{
+    boxes = (Box*)muli::Alloc(boxCapacity * sizeof(Box));
+    endPoints[0] = (EndPoint*)muli::Alloc(2 * boxCapacity * sizeof(EndPoint));
+    endPoints[1] = (EndPoint*)muli::Alloc(2 * boxCapacity * sizeof(EndPoint));
+
+    // Build a linked list for the free list
+    for (int32 i = 0; i < boxCapacity - 1; ++i)
+    {
+        boxes[i].next = i + 1;
+    }
+    boxes[boxCapacity - 1].next = AABBTree::nullNode;
+}
+
+SAPBroadPhase::~SAPBroadPhase() noexcept
+{
+    muli::Free(endPoints[1]);
+    muli::Free(endPoints[0]);
+    muli::Free(boxes);
+}
+
+int32 SAPBroadPhase::AllocateBox()
+{
+    if (freeList == AABBTree::nullNode)
+    {
+        muliAssert(boxCount == boxCapacity);
+
+        // Grow the box pool and the endpoint arrays
+        Box* oldBoxes = boxes;
+        EndPoint* oldX = endPoints[0];
+        EndPoint* oldY = endPoints[1];
+
+        boxCapacity *= 2;
+        boxes = (Box*)muli::Alloc(boxCapacity * sizeof(Box));
+        endPoints[0] = (EndPoint*)muli::Alloc(2 * boxCapacity * sizeof(EndPoint));
+        endPoints[1] = (EndPoint*)muli::Alloc(2 * boxCapacity * sizeof(EndPoint));
+
+        memcpy(boxes, oldBoxes, boxCount * sizeof(Box));
+        memcpy(endPoints[0], oldX, endPointCount * sizeof(EndPoint));
+        memcpy(endPoints[1], oldY, endPointCount * sizeof(EndPoint));
+
+        muli::Free(oldY);
+        muli::Free(oldX);
+        muli::Free(oldBoxes);
+
+        for (int32 i = boxCount; i < boxCapacity - 1; ++i)
+        {
+            boxes[i].next = i + 1;
+        }
+        boxes[boxCapacity - 1].next = AABBTree::nullNode;
+
+        freeList = boxCount;
+    }
+
+    int32 box = freeList;
+    freeList = boxes[box].next;
+    ++boxCount;
+
+    return box;
+}
+
+void SAPBroadPhase::FreeBox(int32 box)
+{
+    muliAssert(0 <= box && box < boxCapacity);
+
+    boxes[box].collider = nullptr;
+    boxes[box].next = freeList;
+    freeList = box;
+    --boxCount;
+}
+
+void SAPBroadPhase::SortDown(int32 axis, int32 index, bool report)
+{
+    EndPoint* ep = endPoints[axis];
+    EndPoint e = ep[index];
+
+    while (index > 0 && EndPointLess(e.value, e.IsMax(), ep[index - 1].value, ep[index - 1].IsMax()))
+    {
+        const EndPoint& prev = ep[index - 1];
+        int32 other = prev.GetBox();
+
+        // A min endpoint passed a max endpoint downward, the boxes may start to overlap
+        if (report && e.IsMax() == false && prev.IsMax())
+        {
+            ReportPair(e.GetBox(), other);
+        }
+
+        ep[index] = prev;
+        if (prev.IsMax())
+        {
+            boxes[other].max[axis] = index;
+        }
+        else
+        {
+            boxes[other].min[axis] = index;
+        }
+
+        --index;
+    }
+
+    ep[index] = e;
+    if (e.IsMax())
+    {
+        boxes[e.GetBox()].max[axis] = index;
+    }
+    else
+    {
+        boxes[e.GetBox()].min[axis] = index;
+    }
+}
+
+void SAPBroadPhase::SortUp(int32 axis, int32 index, bool report)
+{
+    EndPoint* ep = endPoints[axis];
+    EndPoint e = ep[index];
+
+    while (index < endPointCount - 1 && EndPointLess(ep[index + 1].value, ep[index + 1].IsMax(), e.value, e.IsMax()))
+    {
+        const EndPoint& next = ep[index + 1];
+        int32 other = next.GetBox();
+
+        // A max endpoint passed a min endpoint upward, the boxes may start to overlap
+        if (report && e.IsMax() && next.IsMax() == false)
+        {
+            ReportPair(e.GetBox(), other);
+        }
+
+        ep[index] = next;
+        if (next.IsMax())
+        {
+            boxes[other].max[axis] = index;
+        }
+        else
+        {
+            boxes[other].min[axis] = index;
+        }
+
+        ++index;
+    }
+
+    ep[index] = e;
+    if (e.IsMax())
+    {
+        boxes[e.GetBox()].max[axis] = index;
+    }
+    else
+    {
+        boxes[e.GetBox()].min[axis] = index;
+    }
+}
+
+void SAPBroadPhase::ReportPair(int32 boxA, int32 boxB)
+{
+    const Box& a = boxes[boxA];
+    const Box& b = boxes[boxB];
+
+    RigidBody* bodyA = a.collider->body;
+    RigidBody* bodyB = b.collider->body;
+
+    if (bodyA == bodyB)
+    {
+        return;
+    }
+
+    if (bodyA->GetType() != RigidBody::Type::dynamic_body && bodyB->GetType() != RigidBody::Type::dynamic_body)
+    {
+        return;
+    }
+
+    if (a.aabb.TestOverlap(b.aabb) == false)
+    {
+        return;
+    }
+
+    pairs.EmplaceBack(Min(boxA, boxB), Max(boxA, boxB));
+}
+
+void SAPBroadPhase::SetBounds(int32 box, const AABB& aabb)
+{
+    Box& b = boxes[box];
+    AABB old = b.aabb;
+    b.aabb = aabb;
+
+    for (int32 axis = 0; axis < 2; ++axis)
+    {
+        EndPoint* ep = endPoints[axis];
+        ep[b.min[axis]].value = aabb.min[axis];
+        ep[b.max[axis]].value = aabb.max[axis];
+
+        // Grow first so that the min endpoint never passes the max endpoint of the same box
+        if (aabb.min[axis] < old.min[axis]) SortDown(axis, b.min[axis], true);
+        if (aabb.max[axis] > old.max[axis]) SortUp(axis, b.max[axis], true);
+        if (aabb.min[axis] > old.min[axis]) SortUp(axis, b.min[axis], true);
+        if (aabb.max[axis] < old.max[axis]) SortDown(axis, b.max[axis], true);
+    }
+}
+
+void SAPBroadPhase::FindNewContacts()
+{
+    CreateContacts(pairs);
+}
+
+void SAPBroadPhase::Add(Collider* collider, const AABB& aabb)
+{
+    int32 box = AllocateBox();
+    Box& b = boxes[box];
+
+    b.collider = collider;
+    b.aabb.min = aabb.min - aabb_margin;
+    b.aabb.max = aabb.max + aabb_margin;
+
+    // Insert the endpoints at the end and sort them down
+    for (int32 axis = 0; axis < 2; ++axis)
+    {
+        EndPoint* ep = endPoints[axis];
+
+        b.min[axis] = endPointCount;
+        ep[endPointCount].value = b.aabb.min[axis];
+        ep[endPointCount].data = box << 1;
+
+        b.max[axis] = endPointCount + 1;
+        ep[endPointCount + 1].value = b.aabb.max[axis];
+        ep[endPointCount + 1].data = (box << 1) | 1;
+    }
+
+    endPointCount += 2;
+
+    // The min endpoint passes the max endpoints of every box that can overlap on the x axis,
+    // so sorting the x axis reports all the overlapping boxes
+    // Sort the min endpoint first, the max endpoint can't pass the min endpoint of its own box
+    SortDown(0, b.min[0], true);
+    SortDown(0, b.max[0], false);
+    SortDown(1, b.min[1], false);
+    SortDown(1, b.max[1], false);
+
+    collider->proxy = box;
+}
+
+void SAPBroadPhase::Remove(Collider* collider)
+{
+    int32 box = collider->proxy;
+    Box& b = boxes[box];
+
+    // Move the endpoints to the end and drop them
+    for (int32 axis = 0; axis < 2; ++axis)
+    {
+        EndPoint* ep = endPoints[axis];
+
+        ep[b.max[axis]].value = max_value;
+        SortUp(axis, b.max[axis], false);
+        ep[b.min[axis]].value = max_value;
+        SortUp(axis, b.min[axis], false);
+
+        muliAssert(b.min[axis] == endPointCount - 2 && b.max[axis] == endPointCount - 1);
+    }
+
+    endPointCount -= 2;
+
+    // Forget the pairs that are not turned into contacts yet
+    for (int32 i = pairs.Count() - 1; i >= 0; --i)
+    {
+        if (pairs[i].proxyA == box || pairs[i].proxyB == box)
+        {
+            pairs.RemoveSwap(i);
+        }
+    }
+
+    FreeBox(box);
+}
+
+void SAPBroadPhase::Update(Collider* collider, const AABB& aabb, const Vec2& displacement)
+{
+    int32 box = collider->proxy;
+
+    if (boxes[box].aabb.Contains(aabb) && HasJustRested(collider) == false)
+    {
+        return;
+    }
+
+    // Fatten the aabb the same way as AABBTree::MoveNode()
+    AABB fatAABB = aabb;
+    Vec2 d = displacement * aabb_multiplier;
+
+    if (d.x > 0.0f)
+    {
+        fatAABB.max.x += d.x;
+    }
+    else
+    {
+        fatAABB.min.x += d.x;
+    }
+
+    if (d.y > 0.0f)
+    {
+        fatAABB.max.y += d.y;
+    }
+    else
+    {
+        fatAABB.min.y += d.y;
+    }
+
+    fatAABB.max += aabb_margin;
+    fatAABB.min -= aabb_margin;
+
+    SetBounds(box, fatAABB);
+}
+
+void SAPBroadPhase::Refresh(Collider* collider)
+{
+    // The contacts of the collider are destroyed, so report all its overlaps again
+    Remove(collider);
+    Add(collider, collider->GetAABB());
+}
+
+template <typename F>
+void SAPBroadPhase::ForEachOverlap(const AABB& aabb, F&& function) const
+{
+    const EndPoint* ep = endPoints[0];
+
+    // Boxes overlapping the aabb on the x axis begin before the max x of the aabb
+    for (int32 i = 0; i < endPointCount && ep[i].value <= aabb.max.x; ++i)
+    {
+        if (ep[i].IsMax())
+        {
+            continue;
+        }
+
+        int32 box = ep[i].GetBox();
+        if (boxes[box].aabb.TestOverlap(aabb) == false)
+        {
+            continue;
+        }
+
+        if (function(box) == false)
+        {
+            return;
+        }
+    }
+}
+
+void SAPBroadPhase::Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const
+{
+    ForEachOverlap(AABB{ point, point }, [&](int32 box) -> bool { return callback(box, boxes[box].collider); });
+}
+
+void SAPBroadPhase::Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const
+{
+    ForEachOverlap(aabb, [&](int32 box) -> bool { return callback(box, boxes[box].collider); });
+}
+
+void SAPBroadPhase::AABBCast(const AABBCastInput& input,
+                             const std::function<float(const AABBCastInput&, Collider*)>& callback) const
+{
+    const Vec2 p1 = input.from;
+    const Vec2 p2 = input.to;
+    const Vec2 halfExtents = input.halfExtents;
+
+    float maxFraction = input.maxFraction;
+
+    if ((p2 - p1).Length2() == 0.0f)
+    {
+        return;
+    }
+
+    // Bounds of the swept aabb
+    Vec2 end = p1 + maxFraction * (p2 - p1);
+    AABB sweptAABB{ Min(p1, end) - halfExtents, Max(p1, end) + halfExtents };
+
+    ForEachOverlap(sweptAABB, [&](int32 box) -> bool {
+        if (boxes[box].aabb.RayCast(p1, p2, 0.0f, maxFraction, halfExtents) == max_value)
+        {
+            return true;
+        }
+
+        AABBCastInput subInput;
+        subInput.from = p1;
+        subInput.to = p2;
+        subInput.maxFraction = maxFraction;
+        subInput.halfExtents = halfExtents;
+
+        float newFraction = callback(subInput, boxes[box].collider);
+        if (newFraction == 0.0f)
+        {
+            return false;
+        }
+
+        if (newFraction > 0.0f)
+        {
+            // Shorten the ray
+            maxFraction = newFraction;
+        }
+
+        return true;
+    });
+}
+
+} // namespace muli
@@ -0,0 +1,511 @@
+#include "muli/tree_broad_phase.h"
+#include "muli/contact_manager.h"
+#include "muli/world.h"
+
+namespace muli
+{
+
+TreeBroadPhase::TreeBroadPhase(World* _world, ContactManager* _contactManager)
+    : BroadPhase(_world, _contactManager)
+    , staticTree{ Vec2::zero }
+    , moveCapacity{ 16 }
+    , moveCount{ 0 }
+    , moveIndexCapacity{ 32 }
+    , pairBufferCount{ 0 }
+    , reinsertCount{ 0 }
+    , refitBaseCost{ 0.0f }
+    , refitCheckCounter{ 0 }
+    , stats{}
+{
+    moveBuffer = (NodeProxy*)muli::Alloc(moveCapacity * sizeof(NodeProxy));
+    moveIndices = (int32*)muli::Alloc(moveIndexCapacity * sizeof(int32));
+
+    for (int32 i = 0; i < moveIndexCapacity; ++i)
+    {
+        moveIndices[i] = -1;
+    }
+}
+
+TreeBroadPhase::~TreeBroadPhase() noexcept
+{
+    muli::Free(moveBuffer);
+    muli::Free(moveIndices);
+}
+
+void TreeBroadPhase::BufferMove(NodeProxy proxy)
+{
+    // Grow the index table as needed, the proxy keys are bounded by twice the node capacity of the trees
+    if (proxy >= moveIndexCapacity)
+    {
+        int32* old = moveIndices;
+        int32 oldCapacity = moveIndexCapacity;
+        moveIndexCapacity = Max(proxy + 1, moveIndexCapacity * 2);
+        moveIndices = (int32*)muli::Alloc(moveIndexCapacity * sizeof(int32));
+        memcpy(moveIndices, old, oldCapacity * sizeof(int32));
+        muli::Free(old);
+
+        for (int32 i = oldCapacity; i < moveIndexCapacity; ++i)
+        {
+            moveIndices[i] = -1;
+        }
+    }
+
+    // A proxy moved more than once in a step is buffered once
+    if (moveIndices[proxy] != -1)
+    {
+        return;
+    }
+
+    // Grow the buffer as needed
+    if (moveCount == moveCapacity)
+    {
+        NodeProxy* old = moveBuffer;
+        moveCapacity *= 2;
+        moveBuffer = (NodeProxy*)muli::Alloc(moveCapacity * sizeof(NodeProxy));
+        memcpy(moveBuffer, old, moveCount * sizeof(NodeProxy));
+        muli::Free(old);
+    }
+
+    moveIndices[proxy] = moveCount;
+    moveBuffer[moveCount] = proxy;
+    ++moveCount;
+}
+
+void TreeBroadPhase::UnBufferMove(NodeProxy proxy)
+{
+    muliAssert(0 <= proxy && proxy < moveIndexCapacity);
+
+    int32 index = moveIndices[proxy];
+    if (index != -1)
+    {
+        moveBuffer[index] = AABBTree::nullNode;
+        moveIndices[proxy] = -1;
+    }
+}
+
+void TreeBroadPhase::FindNewContacts()
+{
+    ThreadPool& threadPool = world->threadPool;
+
+    if (pairBuffers == nullptr)
+    {
+        pairBufferCount = threadPool.GetThreadCount();
+        pairBuffers = std::make_unique<PairBuffer[]>(pairBufferCount);
+    }
+
+    // Rebuild the dynamic tree once it went through enough churn, leaf nodes and their moved flags are kept
+    float churn = world->settings.tree_rebuild_churn;
+    if (churn <= 0.0f)
+    {
+        reinsertCount = 0;
+    }
+    else if (reinsertCount > churn * (dynamicTree.GetNodeCount() + 1) / 2)
+    {
+        dynamicTree.Rebuild(&threadPool);
+        reinsertCount = 0;
+        refitBaseCost = 0.0f;
+        ++stats.rebuildCount;
+    }
+
+    // Tighten the ancestors of the proxies refitted during the step, each of them once
+    // The tree cost is a pass over the whole tree, so the degradation is only sampled every few refitting steps
+    NodeProxy refitRegion = dynamicTree.Refit();
+    if (refitRegion != AABBTree::nullNode && (refitBaseCost <= 0.0f || ++refitCheckCounter >= tree_refit_check_interval))
+    {
+        refitCheckCounter = 0;
+
+        float leafCount = float((dynamicTree.GetNodeCount() + 1) / 2);
+        float cost = dynamicTree.ComputeTreeCost();
+
+        if (refitBaseCost <= 0.0f)
+        {
+            refitBaseCost = cost / leafCount;
+        }
+        else if (cost > refitBaseCost * leafCount * (1.0f + world->settings.tree_refit_degradation))
+        {
+            // Only the region changes, so update the cost with the difference of its subtree cost
+            float regionCost = dynamicTree.ComputeTreeCost(refitRegion);
+            NodeProxy rebuiltRegion = dynamicTree.RebuildSubtree(refitRegion, &threadPool);
+            cost += dynamicTree.ComputeTreeCost(rebuiltRegion) - regionCost;
+
+            refitBaseCost = cost / leafCount;
+            ++stats.rebuildCount;
+        }
+    }
+
+    // Spend the optimizer budget on the leaves that cost the tree the most, their bounds don't change so no pair is missed
+    int32 optimizeBudget = world->settings.tree_optimize_budget;
+    if (optimizeBudget > 0)
+    {
+        stats.optimizedLeafCount = dynamicTree.Optimize(optimizeBudget);
+        stats.totalOptimizedLeafCount += stats.optimizedLeafCount;
+    }
+
+    struct PairQuery
+    {
+        const AABBTree* tree;
+        bool staticTree;
+        PairBuffer* pairs;
+
+        NodeProxy proxyA;
+        RigidBody* bodyA;
+
+        bool QueryCallback(NodeProxy nodeB, Collider* colliderB)
+        {
+            NodeProxy proxyB = MakeProxyKey(nodeB, staticTree);
+
+            if (proxyA == proxyB)
+            {
+                return true;
+            }
+
+            if (bodyA == colliderB->body)
+            {
+                return true;
+            }
+
+            // Avoid duplicate pair, the other moved proxy reports it
+            if (tree->WasMoved(nodeB) && proxyA < proxyB)
+            {
+                return true;
+            }
+
+            pairs->EmplaceBack(Min(proxyA, proxyB), Max(proxyA, proxyB));
+            return true;
+        }
+    };
+
+    // The trees are read only during the queries, so the move buffer can be queried in parallel
+    threadPool.ParallelFor(moveCount, parallel_grain_size, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+        PairQuery dynamicQuery{ &dynamicTree, false, &pairBuffers[threadIndex], AABBTree::nullNode, nullptr };
+        PairQuery staticQuery{ &staticTree, true, &pairBuffers[threadIndex], AABBTree::nullNode, nullptr };
+
+        for (int32 i = begin; i < end; ++i)
+        {
+            NodeProxy proxy = moveBuffer[i];
+            if (proxy == AABBTree::nullNode)
+            {
+                continue;
+            }
+
+            const AABBTree& tree = GetTree(proxy);
+            NodeProxy node = GetNode(proxy);
+
+            const AABB& treeAABB = tree.GetAABB(node);
+            RigidBody* body = tree.GetData(node)->body;
+
+            dynamicQuery.proxyA = proxy;
+            dynamicQuery.bodyA = body;
+            dynamicTree.Query(treeAABB, &dynamicQuery);
+
+            // Static proxies never pair with each other
+            if (IsStaticProxy(proxy) == false)
+            {
+                staticQuery.proxyA = proxy;
+                staticQuery.bodyA = body;
+                staticTree.Query(treeAABB, &staticQuery);
+            }
+        }
+    });
+
+    // Merge the thread buffers into the first one
+    PairBuffer& pairs = pairBuffers[0];
+    for (int32 i = 1; i < pairBufferCount; ++i)
+    {
+        PairBuffer& threadPairs = pairBuffers[i];
+        for (int32 j = 0; j < threadPairs.Count(); ++j)
+        {
+            pairs.PushBack(threadPairs[j]);
+        }
+        threadPairs.Clear();
+    }
+
+    CreateContacts(pairs);
+
+    // Clear move buffer for next step
+    for (int32 i = 0; i < moveCount; ++i)
+    {
+        NodeProxy proxy = moveBuffer[i];
+        if (proxy != AABBTree::nullNode)
+        {
+            GetTree(proxy).ClearMoved(GetNode(proxy));
+            moveIndices[proxy] = -1;
+        }
+    }
+
+    moveCount = 0;
+}
+
+void TreeBroadPhase::Add(Collider* collider, const AABB& aabb)
+{
+    bool staticProxy = collider->body->GetType() == RigidBody::Type::static_body;
+    AABBTree& tree = staticProxy ? staticTree : dynamicTree;
+
+    NodeProxy proxy = MakeProxyKey(tree.CreateNode(collider, aabb), staticProxy);
+    collider->proxy = proxy;
+
+    if (staticProxy == false)
+    {
+        ++reinsertCount;
+    }
+
+    BufferMove(proxy);
+}
+
+void TreeBroadPhase::BulkAdd(std::span<Collider*> colliders, std::span<const AABB> aabbs)
+{
+    muliAssert(colliders.size() == aabbs.size());
+
+    int32 count = int32(colliders.size());
+    if (count == 0)
+    {
+        return;
+    }
+
+    Collider** sortedColliders = (Collider**)muli::Alloc(count * sizeof(Collider*));
+    AABB* sortedAABBs = (AABB*)muli::Alloc(count * sizeof(AABB));
+    NodeProxy* newNodes = (NodeProxy*)muli::Alloc(count * sizeof(NodeProxy));
+
+    // Static colliders at the front, the others at the back
+    int32 staticCount = 0;
+    int32 dynamicIndex = count;
+    for (int32 i = 0; i < count; ++i)
+    {
+        int32 index = colliders[i]->body->GetType() == RigidBody::Type::static_body ? staticCount++ : --dynamicIndex;
+
+        sortedColliders[index] = colliders[i];
+        sortedAABBs[index] = aabbs[i];
+    }
+
+    staticTree.CreateNodes({ sortedColliders, size_t(staticCount) }, { sortedAABBs, size_t(staticCount) }, newNodes);
+    dynamicTree.CreateNodes({ sortedColliders + staticCount, size_t(count - staticCount) },
+                            { sortedAABBs + staticCount, size_t(count - staticCount) }, newNodes + staticCount);
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        NodeProxy proxy = MakeProxyKey(newNodes[i], i < staticCount);
+        sortedColliders[i]->proxy = proxy;
+
+        BufferMove(proxy);
+    }
+
+    muli::Free(newNodes);
+    muli::Free(sortedAABBs);
+    muli::Free(sortedColliders);
+}
+
+void TreeBroadPhase::Remove(Collider* collider)
+{
+    NodeProxy proxy = collider->proxy;
+    GetTree(proxy).RemoveNode(GetNode(proxy));
+
+    UnBufferMove(proxy);
+}
+
+void TreeBroadPhase::BulkRemove(std::span<Collider*> colliders)
+{
+    int32 count = int32(colliders.size());
+    if (count == 0)
+    {
+        return;
+    }
+
+    NodeProxy* removedNodes = (NodeProxy*)muli::Alloc(count * sizeof(NodeProxy));
+
+    // Static nodes at the front, the others at the back
+    int32 staticCount = 0;
+    int32 dynamicIndex = count;
+    for (int32 i = 0; i < count; ++i)
+    {
+        NodeProxy proxy = colliders[i]->proxy;
+        UnBufferMove(proxy);
+
+        int32 index = IsStaticProxy(proxy) ? staticCount++ : --dynamicIndex;
+        removedNodes[index] = GetNode(proxy);
+    }
+
+    ThreadPool* threadPool = &world->threadPool;
+    staticTree.RemoveNodes({ removedNodes, size_t(staticCount) }, threadPool);
+    dynamicTree.RemoveNodes({ removedNodes + staticCount, size_t(count - staticCount) }, threadPool);
+
+    muli::Free(removedNodes);
+}
+
+void TreeBroadPhase::Update(Collider* collider, const AABB& aabb, const Vec2& displacement)
+{
+    NodeProxy proxy = collider->proxy;
+
+    // Static proxies are always reinserted to keep the static tree tight
+    if (world->settings.tree_refit && IsStaticProxy(proxy) == false)
+    {
+        if (dynamicTree.RefitNode(GetNode(proxy), aabb, displacement, HasJustRested(collider)))
+        {
+            BufferMove(proxy);
+        }
+        return;
+    }
+
+    bool nodeMoved = GetTree(proxy).MoveNode(GetNode(proxy), aabb, displacement, HasJustRested(collider));
+    if (nodeMoved)
+    {
+        BufferMove(proxy);
+
+        if (IsStaticProxy(proxy) == false)
+        {
+            ++reinsertCount;
+        }
+    }
+}
+
+void TreeBroadPhase::Refresh(Collider* collider)
+{
+    NodeProxy proxy = collider->proxy;
+    bool staticProxy = collider->body->GetType() == RigidBody::Type::static_body;
+
+    // The body type has changed, move the proxy to the other tree
+    if (IsStaticProxy(proxy) != staticProxy)
+    {
+        Remove(collider);
+        Add(collider, collider->GetAABB());
+        return;
+    }
+
+    GetTree(proxy).MoveNode(GetNode(proxy), collider->GetAABB(), Vec2::zero, true);
+    BufferMove(proxy);
+
+    if (staticProxy == false)
+    {
+        ++reinsertCount;
+    }
+}
+
+void TreeBroadPhase::Query(const Vec2& point, const std::function<bool(NodeProxy, Collider*)>& callback) const
+{
+    struct TempCallback
+    {
+        const std::function<bool(NodeProxy, Collider*)>& callback;
+
+        bool QueryCallback(NodeProxy node, Collider* collider)
+        {
+            return callback(node, collider);
+        }
+    } tempCallback{ callback };
+
+    Query(point, &tempCallback);
+}
+
+void TreeBroadPhase::Query(const AABB& aabb, const std::function<bool(NodeProxy, Collider*)>& callback) const
+{
+    struct TempCallback
+    {
+        const std::function<bool(NodeProxy, Collider*)>& callback;
+
+        bool QueryCallback(NodeProxy node, Collider* collider)
+        {
+            return callback(node, collider);
+        }
+    } tempCallback{ callback };
+
+    Query(aabb, &tempCallback);
+}
+
+void TreeBroadPhase::AABBCast(const AABBCastInput& input,
+                              const std::function<float(const AABBCastInput&, Collider*)>& callback) const
+{
+    struct TempCallback
+    {
+        const std::function<float(const AABBCastInput&, Collider*)>& callback;
+
+        float AABBCastCallback(const AABBCastInput& subInput, Collider* collider)
+        {
+            return callback(subInput, collider);
+        }
+    } tempCallback{ callback };
+
+    AABBCast(input, &tempCallback);
+}
+
+void TreeBroadPhase::Query(std::span<const AABB> aabbs, QueryHitBuffer& hits) const
+{
+    struct TempCallback
+    {
+        QueryHitBuffer& hits;
+
+        bool QueryCallback(int32 queryIndex, NodeProxy node, Collider* collider)
+        {
+            muliNotUsed(node);
+
+            hits.EmplaceBack(queryIndex, collider);
+            return true;
+        }
+    } tempCallback{ hits };
+
+    dynamicTree.Query(aabbs, &tempCallback);
+    staticTree.Query(aabbs, &tempCallback);
+}
+
+void TreeBroadPhase::AABBCast(std::span<const AABBCastInput> inputs,
+                              const std::function<float(int32, const AABBCastInput&, Collider*)>& callback) const
+{
+    int32 rayCount = int32(inputs.size());
+    if (rayCount == 0)
+    {
+        return;
+    }
+
+    // Carry the shortened rays over to the second tree
+    AABBCastInput* staticInputs = (AABBCastInput*)muli::Alloc(rayCount * sizeof(AABBCastInput));
+    memcpy(staticInputs, inputs.data(), rayCount * sizeof(AABBCastInput));
+
+    struct TempCallback
+    {
+        const std::function<float(int32, const AABBCastInput&, Collider*)>& callback;
+        AABBCastInput* staticInputs;
+
+        float AABBCastCallback(int32 rayIndex, const AABBCastInput& subInput, Collider* collider)
+        {
+            float newFraction = callback(rayIndex, subInput, collider);
+            if (newFraction >= 0.0f)
+            {
+                staticInputs[rayIndex].maxFraction = newFraction;
+            }
+
+            return newFraction;
+        }
+    } tempCallback{ callback, staticInputs };
+
+    dynamicTree.AABBCast(inputs, &tempCallback);
+    staticTree.AABBCast(std::span<const AABBCastInput>(staticInputs, rayCount), &tempCallback);
+
+    muli::Free(staticInputs);
+}
+
+bool TreeBroadPhase::UpdateWideTrees() const
+{
+    if (world->settings.wide_tree_queries == false)
+    {
+        return false;
+    }
+
+    if (dynamicWideTree.IsUpToDate(dynamicTree) && staticWideTree.IsUpToDate(staticTree))
+    {
+        return true;
+    }
+
+    // Queries may run on several threads, only one of them rebuilds the copies
+    std::lock_guard<std::mutex> lock(wideTreeMutex);
+
+    if (dynamicWideTree.IsUpToDate(dynamicTree) == false)
+    {
+        dynamicWideTree.Update(dynamicTree);
+    }
+
+    if (staticWideTree.IsUpToDate(staticTree) == false)
+    {
+        staticWideTree.Update(staticTree);
+    }
+
+    return true;
+}
+
+} // namespace muli
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "muli/wide_tree.h"
+
+namespace muli
+{
+
+WideTree::WideTree()
+    : tree{ nullptr }
+    , version{ 0 }
+    , structureVersion{ 0 }
+    , built{ false }
+    , root{ nullNode }
+    , nodes{ nullptr }
+    , sources{ nullptr }
+    , nodeCapacity{ 0 }
+    , nodeCount{ 0 }
+{
+}
+
+WideTree::~WideTree() noexcept
+{
+    muli::AlignedFree(nodes, alignof(Node));
+    muli::Free(sources);
+}
+
+void WideTree::Build(const AABBTree& source)
+{
+    tree = &source;
+    root = nullNode;
+    nodeCount = 0;
+
+    if (source.root != nullNode)
+    {
+        // Every wide node consumes at least one binary internal node, a lone leaf still needs a root
+        int32 capacity = Max(1, source.nodeCount / 2);
+        if (nodeCapacity < capacity)
+        {
+            muli::AlignedFree(nodes, alignof(Node));
+            muli::Free(sources);
+            nodeCapacity = capacity + capacity / 2;
+            nodes = (Node*)muli::AlignedAlloc(nodeCapacity * sizeof(Node), alignof(Node));
+            sources = (NodeProxy*)muli::Alloc(nodeCapacity * child_count * sizeof(NodeProxy));
+        }
+
+        const AABBTree::Node* sourceNodes = source.nodes;
+
+        struct Task
+        {
+            NodeProxy node; // Source node collapsed into the wide node
+            int32 wideNode;
+        };
+
+        GrowableArray<Task, 64> stack;
+
+        root = nodeCount++;
+        stack.EmplaceBack(source.root, root);
+
+        while (stack.Count() > 0)
+        {
+            Task task = stack.PopBack();
+
+            // Open the largest internal child until there are four children
+            NodeProxy children[child_count];
+            int32 count;
+
+            if (sourceNodes[task.node].IsLeaf())
+            {
+                children[0] = task.node;
+                count = 1;
+            }
+            else
+            {
+                children[0] = sourceNodes[task.node].child1;
+                children[1] = sourceNodes[task.node].child2;
+                count = 2;
+            }
+
+            while (count < child_count)
+            {
+                int32 best = -1;
+                float bestArea = -1.0f;
+
+                for (int32 i = 0; i < count; ++i)
+                {
+                    const AABBTree::Node& child = sourceNodes[children[i]];
+                    if (child.IsLeaf() == false)
+                    {
+                        float area = SurfaceArea(child.aabb);
+                        if (area > bestArea)
+                        {
+                            bestArea = area;
+                            best = i;
+                        }
+                    }
+                }
+
+                if (best == -1)
+                {
+                    break;
+                }
+
+                NodeProxy opened = children[best];
+                children[best] = sourceNodes[opened].child1;
+                children[count++] = sourceNodes[opened].child2;
+            }
+
+            Node& node = nodes[task.wideNode];
+            node.count = count;
+
+            NodeProxy* nodeSources = sources + task.wideNode * child_count;
+
+            for (int32 i = 0; i < child_count; ++i)
+            {
+                // Empty slots are masked out by the child count
+                if (i >= count)
+                {
+                    node.minX[i] = max_value;
+                    node.minY[i] = max_value;
+                    node.maxX[i] = -max_value;
+                    node.maxY[i] = -max_value;
+                    node.children[i] = nullNode;
+                    continue;
+                }
+
+                const AABBTree::Node& child = sourceNodes[children[i]];
+                nodeSources[i] = children[i];
+
+                node.minX[i] = child.aabb.min.x;
+                node.minY[i] = child.aabb.min.y;
+                node.maxX[i] = child.aabb.max.x;
+                node.maxY[i] = child.aabb.max.y;
+
+                if (child.IsLeaf())
+                {
+                    node.children[i] = MakeLeaf(children[i]);
+                }
+                else
+                {
+                    muliAssert(nodeCount < nodeCapacity);
+
+                    int32 wideChild = nodeCount++;
+                    node.children[i] = wideChild;
+                    stack.EmplaceBack(children[i], wideChild);
+                }
+            }
+        }
+    }
+
+    built = true;
+    structureVersion = source.structureVersion;
+    version.store(source.version, std::memory_order_release);
+}
+
+void WideTree::Refit()
+{
+    muliAssert(built && tree->structureVersion == structureVersion);
+
+    const AABBTree::Node* sourceNodes = tree->nodes;
+
+    for (int32 i = 0; i < nodeCount; ++i)
+    {
+        Node& node = nodes[i];
+        const NodeProxy* nodeSources = sources + i * child_count;
+
+        for (int32 j = 0; j < node.count; ++j)
+        {
+            const AABB& aabb = sourceNodes[nodeSources[j]].aabb;
+
+            node.minX[j] = aabb.min.x;
+            node.minY[j] = aabb.min.y;
+            node.maxX[j] = aabb.max.x;
+            node.maxY[j] = aabb.max.y;
+        }
+    }
+
+    version.store(tree->version, std::memory_order_release);
+}
+
+void WideTree::Update(const AABBTree& source)
+{
+    if (built && tree == &source && structureVersion == source.structureVersion)
+    {
+        Refit();
+    }
+    else
+    {
+        Build(source);
+    }
+}
+
+} // namespace muli
@@ -14,7 +14,7 @@ Collider::Collider()
     : OnDestroy{ nullptr }
     , ContactListener{ &defaultListener }
     , next{ nullptr }
-    , node{ AABBTree::nullNode }
+    , proxy{ AABBTree::nullNode }
     , enabled{ true }
 {
 }
@@ -7,6 +7,8 @@ namespace muli
 Constraint::Constraint(RigidBody* _bodyA, RigidBody* _bodyB)
     : bodyA{ _bodyA }
     , bodyB{ _bodyB }
+    , indexA{ 0 }
+    , indexB{ 0 }
     , beta{ 0.0f }
     , gamma{ 0.0f }
 {
@@ -1,7 +1,5 @@
 #include "muli/contact.h"
-#include "muli/block_solver.h"
 #include "muli/callbacks.h"
-#include "muli/contact_solver.h"
 #include "muli/settings.h"
 #include "muli/world.h"
 
@@ -11,13 +9,20 @@ namespace muli
 bool block_solve = true;
 extern CollideFunction* collide_function_map[Shape::Type::shape_count][Shape::Type::shape_count];
 
+// The solver touches every contact several times per step, keep it within 7 cache lines
+static_assert(sizeof(Contact) <= 7 * 64, "Contact grew beyond its cache budget");
+
 Contact::Contact(Collider* _colliderA, Collider* _colliderB)
     : Constraint(_colliderA->body, _colliderB->body)
     , colliderA{ _colliderA }
     , colliderB{ _colliderB }
+    , island{ nullptr }
+    , islandPrev{ nullptr }
+    , islandNext{ nullptr }
     , flag{ 0 }
     , toiCount{ 0 }
     , toi{ 0.0f }
+    , awakeIndex{ -1 }
 {
     muliAssert(colliderA->GetType() >= colliderB->GetType());
 
@@ -39,10 +44,11 @@ void Contact::Update()
     ContactManifold oldManifold = manifold;
     for (int32 i = 0; i < max_contact_point_count; ++i)
     {
-        normalSolvers[i].impulseSave = normalSolvers[i].impulse;
-        tangentSolvers[i].impulseSave = tangentSolvers[i].impulse;
-        normalSolvers[i].impulse = 0.0f;
-        tangentSolvers[i].impulse = 0.0f;
+        ContactConstraint::Point& cp = constraint.points[i];
+        cp.normalImpulseSave = cp.normalImpulse;
+        cp.tangentImpulseSave = cp.tangentImpulse;
+        cp.normalImpulse = 0.0f;
+        cp.tangentImpulse = 0.0f;
     }
 
     // clang-format off
@@ -65,6 +71,8 @@ void Contact::Update()
     {
         if (wasTouching == true)
         {
+            bodyA->world->islandManager.RemoveContact(this);
+
             if (colliderA->ContactListener) colliderA->ContactListener->OnContactEnd(colliderA, colliderB, this);
             if (colliderB->ContactListener) colliderB->ContactListener->OnContactEnd(colliderB, colliderA, this);
         }
@@ -90,8 +98,8 @@ void Contact::Update()
         {
             if (manifold.contactPoints[n].id == oldManifold.contactPoints[o].id)
             {
-                normalSolvers[n].impulse = normalSolvers[o].impulseSave;
-                tangentSolvers[n].impulse = tangentSolvers[o].impulseSave;
+                constraint.points[n].normalImpulse = constraint.points[o].normalImpulseSave;
+                constraint.points[n].tangentImpulse = constraint.points[o].tangentImpulseSave;
                 break;
             }
         }
@@ -101,6 +109,8 @@ void Contact::Update()
     {
         if (wasTouching == false)
         {
+            bodyA->world->islandManager.AddContact(this);
+
             if (colliderA->ContactListener) colliderA->ContactListener->OnContactBegin(colliderA, colliderB, this);
             if (colliderB->ContactListener) colliderB->ContactListener->OnContactBegin(colliderB, colliderA, this);
         }
@@ -120,93 +130,613 @@ void Contact::Update()
     }
 }
 
-void Contact::Prepare(const Timestep& step)
+
+void Contact::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(step);
+
+    if (manifold.featureFlipped)
+    {
+        index1 = indexB;
+        index2 = indexA;
+    }
+    else
+    {
+        index1 = indexA;
+        index2 = indexB;
+    }
+
+    const Vec2& v1 = bodies.linearVelocity[index1];
+    float w1 = bodies.angularVelocity[index1];
+    const Vec2& v2 = bodies.linearVelocity[index2];
+    float w2 = bodies.angularVelocity[index2];
+
+    float im1 = bodies.invMass[index1];
+    float ii1 = bodies.invInertia[index1];
+    float im2 = bodies.invMass[index2];
+    float ii2 = bodies.invInertia[index2];
+
+    const Vec2& normal = manifold.contactNormal;
+    const Vec2& tangent = manifold.contactTangent;
+
+    Transform tf1{ b1->sweep.c, b1->sweep.a };
+    Transform tf2{ b2->sweep.c, b2->sweep.a };
+
+    // Store the reference plane and the clip points in body frames for position correction
+    constraint.localPlanePoint = MulT(tf1, manifold.referencePoint.p);
+    constraint.localNormal = MulT(tf1.rotation, normal);
+
     for (int32 i = 0; i < manifold.contactCount; ++i)
     {
-        normalSolvers[i].Prepare(this, ContactSolver::Type::normal, manifold.contactNormal, i, step);
-        tangentSolvers[i].Prepare(this, ContactSolver::Type::tangent, manifold.contactTangent, i, step);
-        positionSolvers[i].Prepare(this, i);
+        ContactConstraint::Point& cp = constraint.points[i];
+
+        // Compute Jacobian J and effective mass M
+        // J = [-dir, -ra × dir, dir, rb × dir] (dir: Contact vector, normal or tangent)
+        // M = (J · M^-1 · J^t)^-1
+
+        Vec2 point = manifold.contactPoints[i].p;
+        Vec2 ra = point - b1->sweep.c;
+        Vec2 rb = point - b2->sweep.c;
+
+        cp.normalWa = -Cross(ra, normal);
+        cp.normalWb = Cross(rb, normal);
+        cp.tangentWa = -Cross(ra, tangent);
+        cp.tangentWb = Cross(rb, tangent);
+
+        // Relative velocity at contact point
+        Vec2 relativeVelocity = (v2 + Cross(w2, rb)) - (v1 + Cross(w1, ra));
+
+        // Normal velocity == veclocity constraint: jv
+        float normalVelocity = Dot(normal, relativeVelocity);
+
+        cp.normalBias = 0.0f;
+        if (-normalVelocity > restitutionThreshold)
+        {
+            cp.normalBias = restitution * normalVelocity;
+        }
+
+        // clang-format off
+        float k = im1
+                + cp.normalWa * ii1 * cp.normalWa
+                + im2
+                + cp.normalWb * ii2 * cp.normalWb;
+        // clang-format on
+
+        cp.normalMass = k > 0.0f ? 1.0f / k : 0.0f;
+
+        // clang-format off
+        k = im1
+          + cp.tangentWa * ii1 * cp.tangentWa
+          + im2
+          + cp.tangentWb * ii2 * cp.tangentWb;
+        // clang-format on
+
+        cp.tangentMass = k > 0.0f ? 1.0f / k : 0.0f;
+
+        cp.localClipPoint = MulT(tf2, point);
     }
 
     if (manifold.contactCount == 2 && block_solve == true)
     {
-        blockSolver.Prepare(this);
+        // Compute Jacobian J and effective mass M
+        // J = [-n, -ra1 × n, n, rb1 × n
+        //      -n, -ra2 × n, n, rb2 × n]
+        // K = (J · M^-1 · J^t)
+        // M = K^-1
+
+        const ContactConstraint::Point& cp1 = constraint.points[0];
+        const ContactConstraint::Point& cp2 = constraint.points[1];
+
+        Mat2& k = constraint.k;
+        k[0][0] = im1 + im2 + cp1.normalWa * ii1 * cp1.normalWa + cp1.normalWb * ii2 * cp1.normalWb;
+        k[1][1] = im1 + im2 + cp2.normalWa * ii1 * cp2.normalWa + cp2.normalWb * ii2 * cp2.normalWb;
+        k[0][1] = im1 + im2 + cp1.normalWa * ii1 * cp2.normalWa + cp1.normalWb * ii2 * cp2.normalWb;
+        k[1][0] = k[0][1];
+
+        if (k.GetDeterminant() != 0.0f)
+        {
+            constraint.blockSolve = true;
+            constraint.m = k.GetInverse();
+        }
+        else
+        {
+            constraint.blockSolve = false;
+        }
     }
 }
 
-void Contact::SolveVelocityConstraints(const Timestep& step)
+void Contact::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
+    // Compute corrective impulse: Pc
+    // Pc = J^t * λ (λ: lagrangian multiplier)
+    // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
+
+    Vec2& v1 = bodies.linearVelocity[index1];
+    float& w1 = bodies.angularVelocity[index1];
+    Vec2& v2 = bodies.linearVelocity[index2];
+    float& w2 = bodies.angularVelocity[index2];
+
+    float im1 = bodies.invMass[index1];
+    float ii1 = bodies.invInertia[index1];
+    float im2 = bodies.invMass[index2];
+    float ii2 = bodies.invInertia[index2];
+
+    const Vec2& normal = manifold.contactNormal;
+    const Vec2& tangent = manifold.contactTangent;
+
     // Solve tangential constraint first
     for (int32 i = 0; i < manifold.contactCount; ++i)
     {
-        tangentSolvers[i].Solve(&normalSolvers[i]);
+        ContactConstraint::Point& cp = constraint.points[i];
+
+        // Jacobian * velocity vector (Tangent velocity)
+        float jv = Dot(-tangent, v1) + cp.tangentWa * w1 + Dot(tangent, v2) + cp.tangentWb * w2;
+
+        float lambda = cp.tangentMass * -(jv - surfaceSpeed);
+
+        // Clamp impulse correctly and accumulate it
+        float maxFriction = friction * cp.normalImpulse;
+        float oldImpulse = cp.tangentImpulse;
+        cp.tangentImpulse = Clamp(oldImpulse + lambda, -maxFriction, maxFriction);
+        lambda = cp.tangentImpulse - oldImpulse;
+
+        // Apply impulse
+        // V2 = V2' + M^-1 ⋅ Pc
+        // Pc = J^t ⋅ λ
+        v1 += (-tangent) * (im1 * lambda);
+        w1 += ii1 * cp.tangentWa * lambda;
+        v2 += tangent * (im2 * lambda);
+        w2 += ii2 * cp.tangentWb * lambda;
     }
 
-    if (manifold.contactCount == 1 || block_solve == false || blockSolver.enabled == false)
+    if (manifold.contactCount == 2 && block_solve == true && constraint.blockSolve == true)
     {
-        for (int32 i = 0; i < manifold.contactCount; ++i)
+        // Solve two contact constraints simultaneously (2-Contact LCP solver)
+        SolveBlockConstraints(bodies, Vec2{ constraint.points[0].normalBias, constraint.points[1].normalBias });
+        return;
+    }
+
+    for (int32 i = 0; i < manifold.contactCount; ++i)
+    {
+        ContactConstraint::Point& cp = constraint.points[i];
+
+        // Jacobian * velocity vector (Normal velocity)
+        float jv = Dot(-normal, v1) + cp.normalWa * w1 + Dot(normal, v2) + cp.normalWb * w2;
+
+        float lambda = cp.normalMass * -(jv + cp.normalBias);
+
+        float oldImpulse = cp.normalImpulse;
+        cp.normalImpulse = Max(0.0f, oldImpulse + lambda);
+        lambda = cp.normalImpulse - oldImpulse;
+
+        v1 += (-normal) * (im1 * lambda);
+        w1 += ii1 * cp.normalWa * lambda;
+        v2 += normal * (im2 * lambda);
+        w2 += ii2 * cp.normalWb * lambda;
+    }
+}
+
+// Solve two contact constraints simultaneously
+// https://www.gdcvault.com/play/1020603/Physics-for-Game-Programmers-Understanding
+// Soft constraints scale the effective mass by massScale, which turns A into A / massScale below,
+// and keep only (1 - impulseScale) of the old total impulse 'a' in b'
+void Contact::SolveBlockConstraints(SolverBodies& bodies, const Vec2& bias, float massScale, float impulseScale)
+{
+    /*
+        The comments below are copied from Box2D::b2_contact_solver.cpp
+        Check out Box2D: https://box2d.org
+
+        Block solver developed in collaboration with Dirk Gregorius (back in 01/07 on Box2D_Lite).
+        Build the mini LCP for this contact patch
+
+        vn = A * x + b, vn >= 0, x >= 0 and vn_i * x_i = 0 with i = 1..2
+
+        A = J * W * JT and J = ( -n, -r1 x n, n, r2 x n )
+        b = vn0 - velocityBias
+
+        The system is solved using the "Total enumeration method" (s. Murty). The complementary constraint vn_i * x_i
+        implies that we must have in any solution either vn_i = 0 or x_i = 0. So for the 2D contact problem the cases
+        vn1 = 0 and vn2 = 0, x1 = 0 and x2 = 0, x1 = 0 and vn2 = 0, x2 = 0 and vn1 = 0 need to be tested. The first valid
+        solution that satisfies the problem is chosen.
+
+        In order to acontactount of the acontactumulated impulse 'a' (because of the iterative nature of the solver which only
+        requires that the acontactumulated impulse is clamped and not the incremental impulse) we change the impulse variable
+        (x_i).
+
+        Substitute:
+
+        x = a + d
+
+        a := old total impulse
+        x := new total impulse
+        d := incremental impulse
+
+        For the current iteration we extend the formula for the incremental impulse
+        to compute the new total impulse:
+
+        vn = A * d + b
+            = A * (x - a) + b
+            = A * x + b - A * a
+            = A * x + b'
+        b' = b - A * a;
+    */
+
+    Vec2& v1 = bodies.linearVelocity[index1];
+    float& w1 = bodies.angularVelocity[index1];
+    Vec2& v2 = bodies.linearVelocity[index2];
+    float& w2 = bodies.angularVelocity[index2];
+
+    const Vec2& normal = manifold.contactNormal;
+    Mat2& k = constraint.k;
+    Mat2& m = constraint.m;
+
+    ContactConstraint::Point& cp1 = constraint.points[0];
+    ContactConstraint::Point& cp2 = constraint.points[1];
+
+    Vec2 a{ cp1.normalImpulse, cp2.normalImpulse }; // old total impulse
+    muliAssert(a.x >= 0.0f && a.y >= 0.0f);
+
+    // clang-format off
+    // (Velocity constraint) Normal velocity: Jv = 0
+    float vn1 = Dot(-normal, v1)
+              + cp1.normalWa * w1
+              + Dot(normal, v2)
+              + cp1.normalWb * w2;
+
+    float vn2 = Dot(-normal, v1)
+              + cp2.normalWa * w1
+              + Dot(normal, v2)
+              + cp2.normalWb * w2;
+    // clang-format on
+
+    Vec2 b{ vn1 + bias.x, vn2 + bias.y };
+
+    // b' = b - K * a
+    // Soft: b' = b - (K / massScale) * (1 - impulseScale) * a
+    b = b - (k * (a * (1.0f - impulseScale))) / massScale;
+    Vec2 x{ 0.0f }; // Lambda;
+
+    //
+    // Case 1: vn = 0
+    // Both constraints are violated
+    //
+    // 0 = A * x + b'
+    //
+    // Solve for x:
+    //
+    // x = - inv(A) * b'
+    //
+    x = -(m * b) * massScale;
+    if (x.x >= 0.0f && x.y >= 0.0f)
+    {
+        goto solved;
+    }
+
+    //
+    // Case 2: vn1 = 0 and x2 = 0
+    // The first constraint is violated and the second constraint is satisfied
+    //
+    //   0 = a11 * x1 + a12 * 0 + b1'
+    // vn2 = a21 * x1 + a22 * 0 + b2'
+    //
+    x.x = massScale * cp1.normalMass * -b.x;
+    x.y = 0.0f;
+    vn1 = 0.0f;
+    vn2 = k[0][1] * x.x / massScale + b.y;
+    if (x.x >= 0.0f && vn2 >= 0.0f)
+    {
+        goto solved;
+    }
+
+    //
+    // Case 3: vn2 = 0 and x1 = 0
+    // The first constraint is satisfied and the second constraint is violated
+    //
+    // vn1 = a11 * 0 + a12 * x2 + b1'
+    //   0 = a21 * 0 + a22 * x2 + b2'
+    //
+    x.x = 0.0f;
+    x.y = massScale * cp2.normalMass * -b.y;
+    vn1 = k[1][0] * x.y / massScale + b.x;
+    vn2 = 0.0f;
+    if (x.y >= 0.0f && vn1 >= 0.0f)
+    {
+        goto solved;
+    }
+
+    //
+    // Case 4: x1 = 0 and x2 = 0
+    // Both constraints are satisfied
+    //
+    // vn1 = b1
+    // vn2 = b2;
+    //
+    x.x = 0.0f;
+    x.y = 0.0f;
+    vn1 = b.x;
+    vn2 = b.y;
+    if (vn1 >= 0.0f && vn2 >= 0.0f)
+    {
+        goto solved;
+    }
+
+// How did you reach here?! something went wrong!
+// You can sometimes reach here because of floating point errors :(
+#if 0
+        muliAssert(false);
+#endif
+
+solved:
+    // Get the incremental impulse
+    Vec2 d = x - a;
+
+    // Apply incremental impulse
+    // V2 = V2' + M^-1 ⋅ Pc
+    // Pc = J^t ⋅ λ
+    v1 += (-normal) * (bodies.invMass[index1] * (d.x + d.y));
+    w1 += bodies.invInertia[index1] * (cp1.normalWa * d.x + cp2.normalWa * d.y);
+    v2 += normal * (bodies.invMass[index2] * (d.x + d.y));
+    w2 += bodies.invInertia[index2] * (cp1.normalWb * d.x + cp2.normalWb * d.y);
+
+    // Accumulate
+    cp1.normalImpulse = x.x;
+    cp2.normalImpulse = x.y;
+}
+
+void Contact::WarmStart(SolverBodies& bodies)
+{
+    Vec2& v1 = bodies.linearVelocity[index1];
+    float& w1 = bodies.angularVelocity[index1];
+    Vec2& v2 = bodies.linearVelocity[index2];
+    float& w2 = bodies.angularVelocity[index2];
+
+    float im1 = bodies.invMass[index1];
+    float ii1 = bodies.invInertia[index1];
+    float im2 = bodies.invMass[index2];
+    float ii2 = bodies.invInertia[index2];
+
+    const Vec2& normal = manifold.contactNormal;
+    const Vec2& tangent = manifold.contactTangent;
+
+    for (int32 i = 0; i < manifold.contactCount; ++i)
+    {
+        const ContactConstraint::Point& cp = constraint.points[i];
+
+        v1 += (-normal) * (im1 * cp.normalImpulse);
+        w1 += ii1 * cp.normalWa * cp.normalImpulse;
+        v2 += normal * (im2 * cp.normalImpulse);
+        w2 += ii2 * cp.normalWb * cp.normalImpulse;
+
+        v1 += (-tangent) * (im1 * cp.tangentImpulse);
+        w1 += ii1 * cp.tangentWa * cp.tangentImpulse;
+        v2 += tangent * (im2 * cp.tangentImpulse);
+        w2 += ii2 * cp.tangentWb * cp.tangentImpulse;
+    }
+}
+
+// Solve the contact with the current separation instead of correcting the positions afterward
+// The bias pushes the bodies apart softly, the relax iteration (useBias == false) removes the velocity it added
+void Contact::SolveSoftConstraints(const Timestep& step, SolverBodies& bodies, const Softness& softness, bool useBias)
+{
+    Vec2& v1 = bodies.linearVelocity[index1];
+    float& w1 = bodies.angularVelocity[index1];
+    Vec2& v2 = bodies.linearVelocity[index2];
+    float& w2 = bodies.angularVelocity[index2];
+
+    float im1 = bodies.invMass[index1];
+    float ii1 = bodies.invInertia[index1];
+    float im2 = bodies.invMass[index2];
+    float ii2 = bodies.invInertia[index2];
+
+    const Vec2& normal = manifold.contactNormal;
+    const Vec2& tangent = manifold.contactTangent;
+
+    // Bodies have been moved by the previous sub steps, their rotations are kept in sync with the sweeps
+    Transform tf1{ b1->sweep.c, b1->transform.rotation };
+    Transform tf2{ b2->sweep.c, b2->transform.rotation };
+
+    Vec2 planePoint = Mul(tf1, constraint.localPlanePoint);
+    Vec2 planeNormal = Mul(tf1.rotation, constraint.localNormal);
+
+    float bias[max_contact_point_count];
+    float massScale[max_contact_point_count];
+    float impulseScale[max_contact_point_count];
+
+    for (int32 i = 0; i < manifold.contactCount; ++i)
+    {
+        Vec2 clipPoint = Mul(tf2, constraint.points[i].localClipPoint);
+        float separation = Dot(clipPoint - planePoint, planeNormal);
+
+        bias[i] = 0.0f;
+        massScale[i] = 1.0f;
+        impulseScale[i] = 0.0f;
+
+        if (separation > 0.0f)
+        {
+            // Speculative, allow the bodies to approach until they touch
+            bias[i] = separation * step.inv_dt;
+        }
+        else if (useBias)
         {
-            normalSolvers[i].Solve();
+            bias[i] = Max(softness.biasRate * Min(separation + linear_slop, 0.0f), -contact_push_velocity);
+            massScale[i] = softness.massScale;
+            impulseScale[i] = softness.impulseScale;
         }
     }
+
+    // Solving the points one by one gives a resting box uneven impulses, which tall stacks amplify into a tilt
+    // Use the block solver when both points are equally soft
+    if (manifold.contactCount == 2 && block_solve == true && constraint.blockSolve == true && massScale[0] == massScale[1] &&
+        impulseScale[0] == impulseScale[1])
+    {
+        SolveBlockConstraints(bodies, Vec2{ bias[0], bias[1] }, massScale[0], impulseScale[0]);
+    }
     else
     {
-        // Solve two contact constraints simultaneously (2-Contact LCP solver)
-        blockSolver.Solve();
+        for (int32 i = 0; i < manifold.contactCount; ++i)
+        {
+            ContactConstraint::Point& cp = constraint.points[i];
+
+            float jv = Dot(-normal, v1) + cp.normalWa * w1 + Dot(normal, v2) + cp.normalWb * w2;
+
+            float lambda = -cp.normalMass * massScale[i] * (jv + bias[i]) - impulseScale[i] * cp.normalImpulse;
+
+            float oldImpulse = cp.normalImpulse;
+            cp.normalImpulse = Max(0.0f, oldImpulse + lambda);
+            lambda = cp.normalImpulse - oldImpulse;
+
+            v1 += (-normal) * (im1 * lambda);
+            w1 += ii1 * cp.normalWa * lambda;
+            v2 += normal * (im2 * lambda);
+            w2 += ii2 * cp.normalWb * lambda;
+        }
+    }
+
+    // Friction is clamped with the normal impulses of this iteration
+    for (int32 i = 0; i < manifold.contactCount; ++i)
+    {
+        ContactConstraint::Point& cp = constraint.points[i];
+
+        float jv = Dot(-tangent, v1) + cp.tangentWa * w1 + Dot(tangent, v2) + cp.tangentWb * w2;
+
+        float lambda = cp.tangentMass * -(jv - surfaceSpeed);
+
+        float maxFriction = friction * cp.normalImpulse;
+        float oldImpulse = cp.tangentImpulse;
+        cp.tangentImpulse = Clamp(oldImpulse + lambda, -maxFriction, maxFriction);
+        lambda = cp.tangentImpulse - oldImpulse;
+
+        v1 += (-tangent) * (im1 * lambda);
+        w1 += ii1 * cp.tangentWa * lambda;
+        v2 += tangent * (im2 * lambda);
+        w2 += ii2 * cp.tangentWb * lambda;
     }
 }
 
-bool Contact::SolvePositionConstraints(const Timestep& step)
+// The soft step solver doesn't use the restitution bias while solving, apply it once after all sub steps
+void Contact::ApplyRestitution(SolverBodies& bodies)
 {
-    muliNotUsed(step);
+    if (restitution == 0.0f)
+    {
+        return;
+    }
 
-    bool solved = true;
+    Vec2& v1 = bodies.linearVelocity[index1];
+    float& w1 = bodies.angularVelocity[index1];
+    Vec2& v2 = bodies.linearVelocity[index2];
+    float& w2 = bodies.angularVelocity[index2];
 
-    cLinearImpulseA.SetZero();
-    cLinearImpulseB.SetZero();
-    cAngularImpulseA = 0.0f;
-    cAngularImpulseB = 0.0f;
+    float im1 = bodies.invMass[index1];
+    float ii1 = bodies.invInertia[index1];
+    float im2 = bodies.invMass[index2];
+    float ii2 = bodies.invInertia[index2];
+
+    const Vec2& normal = manifold.contactNormal;
 
-    // Solve position constraint
     for (int32 i = 0; i < manifold.contactCount; ++i)
     {
-        solved &= positionSolvers[i].Solve();
+        ContactConstraint::Point& cp = constraint.points[i];
+
+        // normalBias holds the target bounce velocity computed from the approaching velocity in Prepare()
+        if (cp.normalBias == 0.0f || cp.normalImpulse == 0.0f)
+        {
+            continue;
+        }
+
+        float jv = Dot(-normal, v1) + cp.normalWa * w1 + Dot(normal, v2) + cp.normalWb * w2;
+
+        float lambda = -cp.normalMass * (jv + cp.normalBias);
+
+        float oldImpulse = cp.normalImpulse;
+        cp.normalImpulse = Max(0.0f, oldImpulse + lambda);
+        lambda = cp.normalImpulse - oldImpulse;
+
+        v1 += (-normal) * (im1 * lambda);
+        w1 += ii1 * cp.normalWa * lambda;
+        v2 += normal * (im2 * lambda);
+        w2 += ii2 * cp.normalWb * lambda;
     }
+}
 
-    b1->sweep.c += b1->invMass * cLinearImpulseA;
-    b1->sweep.a += b1->invInertia * cAngularImpulseA;
-    b2->sweep.c += b2->invMass * cLinearImpulseB;
-    b2->sweep.a += b2->invInertia * cAngularImpulseB;
+bool Contact::SolvePositionConstraints(const Timestep& step)
+{
+    muliNotUsed(step);
 
-    return solved;
+    return SolvePositionConstraints(position_correction, max_position_correction, position_solver_threshold, false);
 }
 
 bool Contact::SolveTOIPositionConstraints()
+{
+    // TOI position solver must push further than the discrete position solver
+    return SolvePositionConstraints(toi_position_correction, max_toi_position_correction, toi_position_solver_threshold, true);
+}
+
+bool Contact::SolvePositionConstraints(float correction, float maxCorrection, float threshold, bool toi)
 {
     bool solved = true;
 
-    cLinearImpulseA.SetZero();
-    cLinearImpulseB.SetZero();
-    cAngularImpulseA = 0.0f;
-    cAngularImpulseB = 0.0f;
+    // Impulse buffer for position correction
+    // prefix 'c' stands for corrective
+    Vec2 cLinearImpulseA{ 0.0f };
+    Vec2 cLinearImpulseB{ 0.0f };
+    float cAngularImpulseA = 0.0f;
+    float cAngularImpulseB = 0.0f;
+
+    Transform tfA{ b1->sweep.c, b1->sweep.a };
+    Transform tfB{ b2->sweep.c, b2->sweep.a };
+
+    Vec2 planePoint = Mul(tfA, constraint.localPlanePoint);
+    Vec2 normal = Mul(tfA.rotation, constraint.localNormal);
 
     // Solve position constraint
     for (int32 i = 0; i < manifold.contactCount; ++i)
     {
-        solved &= positionSolvers[i].SolveTOI();
+        Vec2 clipPoint = Mul(tfB, constraint.points[i].localClipPoint); // penetration point
+
+        float separation = Dot(clipPoint - planePoint, normal);
+
+        Vec2 ra = clipPoint - tfA.position;
+        Vec2 rb = clipPoint - tfB.position;
+
+        float ran = Cross(ra, normal);
+        float rbn = Cross(rb, normal);
+
+        // clang-format off
+        // effective mass = 1 / k;
+        float k = b1->invMass
+                + ran * b1->invInertia * ran
+                + b2->invMass
+                + rbn * b2->invInertia * rbn;
+        // clang-format on
+
+        // Constraint (bias)
+        float c = Clamp(correction * (separation + linear_slop), -maxCorrection, 0.0f);
+
+        // Compute normal impulse
+        float lambda = k > 0.0f ? -c / k : 0.0f;
+        Vec2 impulse = normal * lambda;
+
+        cLinearImpulseA -= impulse;
+        cAngularImpulseA -= Cross(ra, impulse);
+        cLinearImpulseB += impulse;
+        cAngularImpulseB += Cross(rb, impulse);
+
+        // We can't expect separation >= -linear_slop
+        // because we don't push the separation above -linear_slop
+        solved &= -separation <= threshold;
     }
 
     // Push the body only if it's involved in TOI contact
     // TOI index == 0 or 1
-    if (b1->islandIndex < 2)
+    // Static bodies are shared by the islands and the colors solved in parallel, so only write to the bodies that can move
+    if (b1->type == RigidBody::Type::dynamic_body && (toi == false || b1->islandIndex < 2))
     {
         b1->sweep.c += b1->invMass * cLinearImpulseA;
         b1->sweep.a += b1->invInertia * cAngularImpulseA;
     }
-    if (b2->islandIndex < 2)
+    if (b2->type == RigidBody::Type::dynamic_body && (toi == false || b2->islandIndex < 2))
     {
         b2->sweep.c += b2->invMass * cLinearImpulseB;
         b2->sweep.a += b2->invInertia * cAngularImpulseB;
@@ -0,0 +1,170 @@
+#include "muli/wide_contact_solver.h"
+#include "muli/contact.h"
+
+namespace muli
+{
+
+void WideContactSolver::Prepare(Contact** bundleContacts, int32 bundleCount, const SolverBodies& bodies)
+{
+    muliAssert(bundleCount > 0 && bundleCount <= simd_width);
+
+    // Empty lanes have zero mass and zero jacobian so they never produce any impulse
+    memset(this, 0, sizeof(WideContactSolver));
+    count = bundleCount;
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        Contact* c = bundleContacts[i];
+        contacts[i] = c;
+
+        index1[i] = c->index1;
+        index2[i] = c->index2;
+
+        invMass1[i] = bodies.invMass[index1[i]];
+        invInertia1[i] = bodies.invInertia[index1[i]];
+        invMass2[i] = bodies.invMass[index2[i]];
+        invInertia2[i] = bodies.invInertia[index2[i]];
+
+        normalX[i] = c->manifold.contactNormal.x;
+        normalY[i] = c->manifold.contactNormal.y;
+        tangentX[i] = c->manifold.contactTangent.x;
+        tangentY[i] = c->manifold.contactTangent.y;
+        friction[i] = c->friction;
+
+        for (int32 p = 0; p < c->manifold.contactCount; ++p)
+        {
+            const ContactConstraint::Point& cp = c->constraint.points[p];
+
+            normalRows[p].wa[i] = cp.normalWa;
+            normalRows[p].wb[i] = cp.normalWb;
+            normalRows[p].m[i] = cp.normalMass;
+            normalRows[p].bias[i] = cp.normalBias;
+            normalRows[p].impulse[i] = cp.normalImpulse;
+
+            tangentRows[p].wa[i] = cp.tangentWa;
+            tangentRows[p].wb[i] = cp.tangentWb;
+            tangentRows[p].m[i] = cp.tangentMass;
+            tangentRows[p].bias[i] = -c->surfaceSpeed;
+            tangentRows[p].impulse[i] = cp.tangentImpulse;
+        }
+    }
+}
+
+void WideContactSolver::Solve(SolverBodies& bodies)
+{
+    // Gather the body velocities into lanes
+    float v1x[simd_width] = { 0.0f }, v1y[simd_width] = { 0.0f }, w1s[simd_width] = { 0.0f };
+    float v2x[simd_width] = { 0.0f }, v2y[simd_width] = { 0.0f }, w2s[simd_width] = { 0.0f };
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        const Vec2& v1 = bodies.linearVelocity[index1[i]];
+        const Vec2& v2 = bodies.linearVelocity[index2[i]];
+
+        v1x[i] = v1.x;
+        v1y[i] = v1.y;
+        w1s[i] = bodies.angularVelocity[index1[i]];
+        v2x[i] = v2.x;
+        v2y[i] = v2.y;
+        w2s[i] = bodies.angularVelocity[index2[i]];
+    }
+
+    FloatW vx1 = LoadW(v1x), vy1 = LoadW(v1y), w1 = LoadW(w1s);
+    FloatW vx2 = LoadW(v2x), vy2 = LoadW(v2y), w2 = LoadW(w2s);
+
+    FloatW im1 = LoadW(invMass1), ii1 = LoadW(invInertia1);
+    FloatW im2 = LoadW(invMass2), ii2 = LoadW(invInertia2);
+
+    // Solve tangential constraint first
+    FloatW tx = LoadW(tangentX), ty = LoadW(tangentY);
+    FloatW mu = LoadW(friction);
+
+    for (int32 p = 0; p < max_contact_point_count; ++p)
+    {
+        Row& row = tangentRows[p];
+
+        FloatW wa = LoadW(row.wa);
+        FloatW wb = LoadW(row.wb);
+
+        // Jacobian * velocity vector (Tangent velocity)
+        FloatW jv = ((-tx) * vx1 + (-ty) * vy1) + wa * w1 + (tx * vx2 + ty * vy2) + wb * w2;
+
+        FloatW lambda = LoadW(row.m) * -(jv + LoadW(row.bias));
+
+        // Clamp the accumulated impulse with the friction cone
+        FloatW maxFriction = mu * LoadW(normalRows[p].impulse);
+        FloatW oldImpulse = LoadW(row.impulse);
+        FloatW impulse = MaxW(-maxFriction, MinW(oldImpulse + lambda, maxFriction));
+        StoreW(row.impulse, impulse);
+
+        lambda = impulse - oldImpulse;
+
+        vx1 += (-tx) * (im1 * lambda);
+        vy1 += (-ty) * (im1 * lambda);
+        w1 += ii1 * wa * lambda;
+        vx2 += tx * (im2 * lambda);
+        vy2 += ty * (im2 * lambda);
+        w2 += ii2 * wb * lambda;
+    }
+
+    FloatW nx = LoadW(normalX), ny = LoadW(normalY);
+    FloatW zero = SplatW(0.0f);
+
+    for (int32 p = 0; p < max_contact_point_count; ++p)
+    {
+        Row& row = normalRows[p];
+
+        FloatW wa = LoadW(row.wa);
+        FloatW wb = LoadW(row.wb);
+
+        // Jacobian * velocity vector (Normal velocity)
+        FloatW jv = ((-nx) * vx1 + (-ny) * vy1) + wa * w1 + (nx * vx2 + ny * vy2) + wb * w2;
+
+        FloatW lambda = LoadW(row.m) * -(jv + LoadW(row.bias));
+
+        FloatW oldImpulse = LoadW(row.impulse);
+        FloatW impulse = MaxW(zero, oldImpulse + lambda);
+        StoreW(row.impulse, impulse);
+
+        lambda = impulse - oldImpulse;
+
+        vx1 += (-nx) * (im1 * lambda);
+        vy1 += (-ny) * (im1 * lambda);
+        w1 += ii1 * wa * lambda;
+        vx2 += nx * (im2 * lambda);
+        vy2 += ny * (im2 * lambda);
+        w2 += ii2 * wb * lambda;
+    }
+
+    // Scatter the velocities, no body appears twice in a bundle
+    StoreW(v1x, vx1);
+    StoreW(v1y, vy1);
+    StoreW(w1s, w1);
+    StoreW(v2x, vx2);
+    StoreW(v2y, vy2);
+    StoreW(w2s, w2);
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        bodies.linearVelocity[index1[i]].Set(v1x[i], v1y[i]);
+        bodies.angularVelocity[index1[i]] = w1s[i];
+        bodies.linearVelocity[index2[i]].Set(v2x[i], v2y[i]);
+        bodies.angularVelocity[index2[i]] = w2s[i];
+    }
+}
+
+void WideContactSolver::StoreImpulses()
+{
+    for (int32 i = 0; i < count; ++i)
+    {
+        Contact* c = contacts[i];
+
+        for (int32 p = 0; p < c->manifold.contactCount; ++p)
+        {
+            c->constraint.points[p].normalImpulse = normalRows[p].impulse[i];
+            c->constraint.points[p].tangentImpulse = tangentRows[p].impulse[i];
+        }
+    }
+}
+
+} // namespace muli
@@ -11,8 +11,10 @@ AngleJoint::AngleJoint(RigidBody* _bodyA, RigidBody* _bodyB, float _frequency, f
     angleOffset = bodyB->sweep.a - bodyA->sweep.a;
 }
 
-void AngleJoint::Prepare(const Timestep& step)
+void AngleJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -28,14 +30,14 @@ void AngleJoint::Prepare(const Timestep& step)
 
     float error = bodyB->sweep.a - bodyA->sweep.a - angleOffset;
     bias = error * beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void AngleJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void AngleJoint::SolveVelocityConstraints(const Timestep& step)
+void AngleJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -43,21 +45,21 @@ void AngleJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t · λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    float jv = bodyB->angularVelocity - bodyA->angularVelocity;
+    float jv = bodies.angularVelocity[indexB] - bodies.angularVelocity[indexA];
 
     float lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void AngleJoint::ApplyImpulse(float lambda)
+void AngleJoint::ApplyImpulse(SolverBodies& bodies, float lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
 
-    bodyA->angularVelocity -= lambda * bodyA->invInertia;
-    bodyB->angularVelocity += lambda * bodyB->invInertia;
+    bodies.angularVelocity[indexA] -= lambda * bodies.invInertia[indexA];
+    bodies.angularVelocity[indexB] += lambda * bodies.invInertia[indexB];
 }
 
 } // namespace muli
\ No newline at end of file
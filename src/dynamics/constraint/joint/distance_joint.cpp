@@ -20,8 +20,10 @@ DistanceJoint::DistanceJoint(RigidBody* _bodyA,
     length = _length < 0.0f ? Length(_anchorB - _anchorA) : _length;
 }
 
-void DistanceJoint::Prepare(const Timestep& step)
+void DistanceJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -51,14 +53,14 @@ void DistanceJoint::Prepare(const Timestep& step)
 
     float error = currentLength - length;
     bias = error * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void DistanceJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void DistanceJoint::SolveVelocityConstraints(const Timestep& step)
+void DistanceJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -66,28 +68,28 @@ void DistanceJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t · λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    float jv = Dot((bodyB->linearVelocity + Cross(bodyB->angularVelocity, rb)) -
-                       (bodyA->linearVelocity + Cross(bodyA->angularVelocity, ra)),
+    float jv = Dot((bodies.linearVelocity[indexB] + Cross(bodies.angularVelocity[indexB], rb)) -
+                       (bodies.linearVelocity[indexA] + Cross(bodies.angularVelocity[indexA], ra)),
                    d);
 
     // You don't have to clamp the impulse. It's equality constraint!
     float lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void DistanceJoint::ApplyImpulse(float lambda)
+void DistanceJoint::ApplyImpulse(SolverBodies& bodies, float lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
 
     Vec2 p = d * lambda;
 
-    bodyA->linearVelocity -= p * bodyA->invMass;
-    bodyA->angularVelocity -= Dot(d, Cross(lambda, ra)) * bodyA->invInertia;
-    bodyB->linearVelocity += p * bodyB->invMass;
-    bodyB->angularVelocity += Dot(d, Cross(lambda, rb)) * bodyB->invInertia;
+    bodies.linearVelocity[indexA] -= p * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= Dot(d, Cross(lambda, ra)) * bodies.invInertia[indexA];
+    bodies.linearVelocity[indexB] += p * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += Dot(d, Cross(lambda, rb)) * bodies.invInertia[indexB];
 }
 
 } // namespace muli
\ No newline at end of file
@@ -13,8 +13,10 @@ GrabJoint::GrabJoint(
     target = _target;
 }
 
-void GrabJoint::Prepare(const Timestep& step)
+void GrabJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -38,14 +40,14 @@ void GrabJoint::Prepare(const Timestep& step)
 
     Vec2 error = p - target;
     bias = error * beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void GrabJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void GrabJoint::SolveVelocityConstraints(const Timestep& step)
+void GrabJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -53,18 +55,18 @@ void GrabJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t · λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    Vec2 jv = bodyA->linearVelocity + Cross(bodyA->angularVelocity, r);
+    Vec2 jv = bodies.linearVelocity[indexA] + Cross(bodies.angularVelocity[indexA], r);
 
     Vec2 lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void GrabJoint::ApplyImpulse(const Vec2& lambda)
+void GrabJoint::ApplyImpulse(SolverBodies& bodies, const Vec2& lambda)
 {
-    bodyA->linearVelocity += lambda * bodyA->invMass;
-    bodyA->angularVelocity += bodyA->invInertia * Cross(r, lambda);
+    bodies.linearVelocity[indexA] += lambda * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] += bodies.invInertia[indexA] * Cross(r, lambda);
 }
 
 } // namespace muli
\ No newline at end of file
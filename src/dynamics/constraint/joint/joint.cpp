@@ -10,6 +10,9 @@ Joint::Joint(Joint::Type _type, RigidBody* _bodyA, RigidBody* _bodyB, float _fre
     , OnDestroy{ nullptr }
     , UserData{ nullptr }
     , type{ _type }
+    , island{ nullptr }
+    , islandPrev{ nullptr }
+    , islandNext{ nullptr }
     , flagIsland{ false }
 {
     SetParameters(_frequency, _dampingRatio, _jointMass);
@@ -23,8 +23,10 @@ LineJoint::LineJoint(
     }
 }
 
-void LineJoint::Prepare(const Timestep& step)
+void LineJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -55,14 +57,14 @@ void LineJoint::Prepare(const Timestep& step)
 
     float error = Dot(d, t);
     bias = error * beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void LineJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void LineJoint::SolveVelocityConstraints(const Timestep& step)
+void LineJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -70,25 +72,26 @@ void LineJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t · λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    float jv = Dot(t, bodyB->linearVelocity - bodyA->linearVelocity) + sb * bodyB->angularVelocity - sa * bodyA->angularVelocity;
+    float jv = Dot(t, bodies.linearVelocity[indexB] - bodies.linearVelocity[indexA]) + sb * bodies.angularVelocity[indexB] -
+               sa * bodies.angularVelocity[indexA];
 
     float lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void LineJoint::ApplyImpulse(float lambda)
+void LineJoint::ApplyImpulse(SolverBodies& bodies, float lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
 
     Vec2 p = t * lambda;
 
-    bodyA->linearVelocity -= p * bodyA->invMass;
-    bodyA->angularVelocity -= lambda * sa * bodyA->invInertia;
-    bodyB->linearVelocity += p * bodyB->invMass;
-    bodyB->angularVelocity += lambda * sb * bodyB->invInertia;
+    bodies.linearVelocity[indexA] -= p * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= lambda * sa * bodies.invInertia[indexA];
+    bodies.linearVelocity[indexB] += p * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += lambda * sb * bodies.invInertia[indexB];
 }
 
 } // namespace muli
\ No newline at end of file
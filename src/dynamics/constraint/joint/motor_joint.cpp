@@ -27,8 +27,10 @@ MotorJoint::MotorJoint(RigidBody* _bodyA,
     maxTorque = _maxTorque < 0 ? max_value : Clamp<float>(_maxTorque, 0.0f, max_value);
 }
 
-void MotorJoint::Prepare(const Timestep& step)
+void MotorJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -62,22 +64,22 @@ void MotorJoint::Prepare(const Timestep& step)
 
     bias0 *= beta * step.inv_dt;
     bias1 *= beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(linearImpulseSum, angularImpulseSum);
-    }
+void MotorJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, linearImpulseSum, angularImpulseSum);
 }
 
-void MotorJoint::SolveVelocityConstraints(const Timestep& step)
+void MotorJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     // Compute corrective impulse: Pc
     // Pc = J^t * λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    Vec2 jv0 =
-        (bodyB->linearVelocity + Cross(bodyB->angularVelocity, rb)) - (bodyA->linearVelocity + Cross(bodyA->angularVelocity, ra));
-    float jv1 = bodyB->angularVelocity - bodyA->angularVelocity;
+    Vec2 jv0 = (bodies.linearVelocity[indexB] + Cross(bodies.angularVelocity[indexB], rb)) -
+               (bodies.linearVelocity[indexA] + Cross(bodies.angularVelocity[indexA], ra));
+    float jv1 = bodies.angularVelocity[indexB] - bodies.angularVelocity[indexA];
 
     Vec2 lambda0 = m0 * -(jv0 + bias0 + linearImpulseSum * gamma);
     float lambda1 = m1 * -(jv1 + bias1 + angularImpulseSum * gamma);
@@ -108,29 +110,29 @@ void MotorJoint::SolveVelocityConstraints(const Timestep& step)
         lambda1 = angularImpulseSum - oldAngularImpulse;
     }
 
-    ApplyImpulse(lambda0, lambda1);
+    ApplyImpulse(bodies, lambda0, lambda1);
 }
 
-void MotorJoint::ApplyImpulse(const Vec2& lambda0, float lambda1)
+void MotorJoint::ApplyImpulse(SolverBodies& bodies, const Vec2& lambda0, float lambda1)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
 
 #if 1
-    bodyA->linearVelocity -= bodyA->invMass * lambda0;
-    bodyA->angularVelocity -= bodyA->invInertia * (Cross(ra, lambda0) + lambda1);
-    bodyB->linearVelocity += bodyB->invMass * lambda0;
-    bodyB->angularVelocity += bodyB->invInertia * (Cross(rb, lambda0) + lambda1);
+    bodies.linearVelocity[indexA] -= bodies.invMass[indexA] * lambda0;
+    bodies.angularVelocity[indexA] -= bodies.invInertia[indexA] * (Cross(ra, lambda0) + lambda1);
+    bodies.linearVelocity[indexB] += bodies.invMass[indexB] * lambda0;
+    bodies.angularVelocity[indexB] += bodies.invInertia[indexB] * (Cross(rb, lambda0) + lambda1);
 #else
     // Solve for point-to-point constraint
-    bodyA->linearVelocity -= lambda0 * bodyA->invMass;
-    bodyA->angularVelocity -= bodyA->invInertia * Cross(ra, lambda0);
-    bodyB->linearVelocity += lambda0 * bodyB->invMass;
-    bodyB->angularVelocity += bodyB->invInertia * Cross(rb, lambda0);
+    bodies.linearVelocity[indexA] -= lambda0 * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= bodies.invInertia[indexA] * Cross(ra, lambda0);
+    bodies.linearVelocity[indexB] += lambda0 * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += bodies.invInertia[indexB] * Cross(rb, lambda0);
 
     // Solve for angle constraint
-    bodyA->angularVelocity -= lambda1 * bodyA->invInertia;
-    bodyB->angularVelocity -= lambda1 * bodyB->invInertia;
+    bodies.angularVelocity[indexA] -= lambda1 * bodies.invInertia[indexA];
+    bodies.angularVelocity[indexB] -= lambda1 * bodies.invInertia[indexB];
 #endif
 }
 
@@ -32,8 +32,10 @@ PrismaticJoint::PrismaticJoint(RigidBody* _bodyA,
     angleOffset = bodyB->GetAngle() - bodyA->GetAngle();
 }
 
-void PrismaticJoint::Prepare(const Timestep& step)
+void PrismaticJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -69,14 +71,14 @@ void PrismaticJoint::Prepare(const Timestep& step)
 
     bias.Set(error0, error1);
     bias *= beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void PrismaticJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void PrismaticJoint::SolveVelocityConstraints(const Timestep& step)
+void PrismaticJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -85,26 +87,27 @@ void PrismaticJoint::SolveVelocityConstraints(const Timestep& step)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
     Vec2 jv;
-    jv.x = Dot(t, bodyB->linearVelocity - bodyA->linearVelocity) + sb * bodyB->angularVelocity - sa * bodyA->angularVelocity;
-    jv.y = bodyB->angularVelocity - bodyA->angularVelocity;
+    jv.x = Dot(t, bodies.linearVelocity[indexB] - bodies.linearVelocity[indexA]) + sb * bodies.angularVelocity[indexB] -
+           sa * bodies.angularVelocity[indexA];
+    jv.y = bodies.angularVelocity[indexB] - bodies.angularVelocity[indexA];
 
     Vec2 lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void PrismaticJoint::ApplyImpulse(const Vec2& lambda)
+void PrismaticJoint::ApplyImpulse(SolverBodies& bodies, const Vec2& lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
 
     Vec2 p = t * lambda.x;
 
-    bodyA->linearVelocity -= p * bodyA->invMass;
-    bodyA->angularVelocity -= (lambda.x * sa + lambda.y) * bodyA->invInertia;
-    bodyB->linearVelocity += p * bodyB->invMass;
-    bodyB->angularVelocity += (lambda.x * sb + lambda.y) * bodyB->invInertia;
+    bodies.linearVelocity[indexA] -= p * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= (lambda.x * sa + lambda.y) * bodies.invInertia[indexA];
+    bodies.linearVelocity[indexB] += p * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += (lambda.x * sb + lambda.y) * bodies.invInertia[indexB];
 }
 
 } // namespace muli
\ No newline at end of file
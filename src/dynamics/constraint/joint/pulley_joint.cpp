@@ -26,8 +26,10 @@ PulleyJoint::PulleyJoint(RigidBody* _bodyA,
     length = Dist(_anchorA, _groundAnchorA) + Dist(_anchorB, _groundAnchorB);
 }
 
-void PulleyJoint::Prepare(const Timestep& step)
+void PulleyJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -79,14 +81,14 @@ void PulleyJoint::Prepare(const Timestep& step)
 
     float error = length - (lengthA + lengthB);
     bias = error * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void PulleyJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void PulleyJoint::SolveVelocityConstraints(const Timestep& step)
+void PulleyJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -94,16 +96,16 @@ void PulleyJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t · λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    float jv = -(ratio * (Dot(ub, bodyB->linearVelocity + Cross(bodyB->angularVelocity, rb))) +
-                 Dot(ua, bodyA->linearVelocity + Cross(bodyA->angularVelocity, ra)));
+    float jv = -(ratio * (Dot(ub, bodies.linearVelocity[indexB] + Cross(bodies.angularVelocity[indexB], rb))) +
+                 Dot(ua, bodies.linearVelocity[indexA] + Cross(bodies.angularVelocity[indexA], ra)));
 
     float lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void PulleyJoint::ApplyImpulse(float lambda)
+void PulleyJoint::ApplyImpulse(SolverBodies& bodies, float lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
@@ -111,10 +113,10 @@ void PulleyJoint::ApplyImpulse(float lambda)
     Vec2 pa = -lambda * ua;
     Vec2 pb = -ratio * lambda * ub;
 
-    bodyA->linearVelocity += pa * bodyA->invMass;
-    bodyA->angularVelocity += Cross(ra, pa) * bodyA->invInertia;
-    bodyB->linearVelocity += pb * bodyB->invMass;
-    bodyB->angularVelocity += Cross(rb, pb) * bodyB->invInertia;
+    bodies.linearVelocity[indexA] += pa * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] += Cross(ra, pa) * bodies.invInertia[indexA];
+    bodies.linearVelocity[indexB] += pb * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += Cross(rb, pb) * bodies.invInertia[indexB];
 }
 
 } // namespace muli
\ No newline at end of file
@@ -13,8 +13,10 @@ RevoluteJoint::RevoluteJoint(
     localAnchorB = MulT(bodyB->GetTransform(), _anchor);
 }
 
-void RevoluteJoint::Prepare(const Timestep& step)
+void RevoluteJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -43,14 +45,14 @@ void RevoluteJoint::Prepare(const Timestep& step)
 
     Vec2 error = pb - pa;
     bias = error * beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void RevoluteJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void RevoluteJoint::SolveVelocityConstraints(const Timestep& step)
+void RevoluteJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -58,25 +60,25 @@ void RevoluteJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t * λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    Vec2 jv =
-        (bodyB->linearVelocity + Cross(bodyB->angularVelocity, rb)) - (bodyA->linearVelocity + Cross(bodyA->angularVelocity, ra));
+    Vec2 jv = (bodies.linearVelocity[indexB] + Cross(bodies.angularVelocity[indexB], rb)) -
+              (bodies.linearVelocity[indexA] + Cross(bodies.angularVelocity[indexA], ra));
 
     // You don't have to clamp the impulse. It's equality constraint!
     Vec2 lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void RevoluteJoint::ApplyImpulse(const Vec2& lambda)
+void RevoluteJoint::ApplyImpulse(SolverBodies& bodies, const Vec2& lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
 
-    bodyA->linearVelocity -= lambda * bodyA->invMass;
-    bodyA->angularVelocity -= bodyA->invInertia * Cross(ra, lambda);
-    bodyB->linearVelocity += lambda * bodyB->invMass;
-    bodyB->angularVelocity += bodyB->invInertia * Cross(rb, lambda);
+    bodies.linearVelocity[indexA] -= lambda * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= bodies.invInertia[indexA] * Cross(ra, lambda);
+    bodies.linearVelocity[indexB] += lambda * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += bodies.invInertia[indexB] * Cross(rb, lambda);
 }
 
 } // namespace muli
\ No newline at end of file
@@ -17,8 +17,10 @@ WeldJoint::WeldJoint(
     angleOffset = bodyB->GetAngle() - bodyA->GetAngle();
 }
 
-void WeldJoint::Prepare(const Timestep& step)
+void WeldJoint::Prepare(const Timestep& step, const SolverBodies& bodies)
 {
+    muliNotUsed(bodies);
+
     ComputeBetaAndGamma(step);
 
     // Compute Jacobian J and effective mass M
@@ -60,14 +62,14 @@ void WeldJoint::Prepare(const Timestep& step)
 
     bias.Set(error01.x, error01.y, error2);
     bias *= beta * step.inv_dt;
+}
 
-    if (step.warm_starting)
-    {
-        ApplyImpulse(impulseSum);
-    }
+void WeldJoint::WarmStart(SolverBodies& bodies)
+{
+    ApplyImpulse(bodies, impulseSum);
 }
 
-void WeldJoint::SolveVelocityConstraints(const Timestep& step)
+void WeldJoint::SolveVelocityConstraints(const Timestep& step, SolverBodies& bodies)
 {
     muliNotUsed(step);
 
@@ -75,17 +77,17 @@ void WeldJoint::SolveVelocityConstraints(const Timestep& step)
     // Pc = J^t * λ (λ: lagrangian multiplier)
     // λ = (J · M^-1 · J^t)^-1 ⋅ -(J·v+b)
 
-    Vec3 jv = Vec2{ bodyB->linearVelocity + Cross(bodyB->angularVelocity, rb) -
-                    (bodyA->linearVelocity + Cross(bodyA->angularVelocity, ra)) };
-    jv.z = bodyB->angularVelocity - bodyA->angularVelocity;
+    Vec3 jv = Vec2{ bodies.linearVelocity[indexB] + Cross(bodies.angularVelocity[indexB], rb) -
+                    (bodies.linearVelocity[indexA] + Cross(bodies.angularVelocity[indexA], ra)) };
+    jv.z = bodies.angularVelocity[indexB] - bodies.angularVelocity[indexA];
 
     Vec3 lambda = m * -(jv + bias + impulseSum * gamma);
 
-    ApplyImpulse(lambda);
+    ApplyImpulse(bodies, lambda);
     impulseSum += lambda;
 }
 
-void WeldJoint::ApplyImpulse(const Vec3& lambda)
+void WeldJoint::ApplyImpulse(SolverBodies& bodies, const Vec3& lambda)
 {
     // V2 = V2' + M^-1 ⋅ Pc
     // Pc = J^t ⋅ λ
@@ -94,20 +96,20 @@ void WeldJoint::ApplyImpulse(const Vec3& lambda)
     float lambda2 = lambda.z;
 
 #if 1 // Shortened
-    bodyA->linearVelocity -= lambda01 * bodyA->invMass;
-    bodyA->angularVelocity -= (Cross(ra, lambda01) + lambda2) * bodyA->invInertia;
-    bodyB->linearVelocity += lambda01 * bodyB->invMass;
-    bodyB->angularVelocity += (Cross(rb, lambda01) + lambda2) * bodyB->invInertia;
+    bodies.linearVelocity[indexA] -= lambda01 * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= (Cross(ra, lambda01) + lambda2) * bodies.invInertia[indexA];
+    bodies.linearVelocity[indexB] += lambda01 * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += (Cross(rb, lambda01) + lambda2) * bodies.invInertia[indexB];
 #else
     // Solve for point-to-point constraint
-    bodyA->linearVelocity -= lambda01 * bodyA->invMass;
-    bodyA->angularVelocity -= Cross(ra, lambda01) * bodyA->invInertia;
-    bodyB->linearVelocity += lambda01 * bodyB->invMass;
-    bodyB->angularVelocity += Cross(rb, lambda01) * bodyB->invInertia;
+    bodies.linearVelocity[indexA] -= lambda01 * bodies.invMass[indexA];
+    bodies.angularVelocity[indexA] -= Cross(ra, lambda01) * bodies.invInertia[indexA];
+    bodies.linearVelocity[indexB] += lambda01 * bodies.invMass[indexB];
+    bodies.angularVelocity[indexB] += Cross(rb, lambda01) * bodies.invInertia[indexB];
 
     // Solve for angle constraint
-    bodyA->angularVelocity -= lambda2 * bodyA->invInertia;
-    bodyB->angularVelocity += lambda2 * bodyB->invInertia;
+    bodies.angularVelocity[indexA] -= lambda2 * bodies.invInertia[indexA];
+    bodies.angularVelocity[indexB] += lambda2 * bodies.invInertia[indexB];
 #endif
 }
 
@@ -8,25 +8,53 @@ extern void InitializeDetectionFunctionMap();
 
 ContactManager::ContactManager(World* _world)
     : world{ _world }
-    , broadPhase{ _world, this }
+    , bulkInsert{ false }
+    , bulkRemove{ false }
     , contactList{ nullptr }
     , contactCount{ 0 }
+    , awakeContactCapacity{ 16 }
+    , awakeContactCount{ 0 }
 {
     InitializeDetectionFunctionMap();
+
+    switch (world->settings.broad_phase_type)
+    {
+    case BroadPhaseType::aabb_tree:
+        broadPhase = std::make_unique<TreeBroadPhase>(world, this);
+        break;
+    case BroadPhaseType::sweep_and_prune:
+        broadPhase = std::make_unique<SAPBroadPhase>(world, this);
+        break;
+    case BroadPhaseType::uniform_grid:
+        broadPhase = std::make_unique<GridBroadPhase>(world, this);
+        break;
+    default:
+        muliAssert(false);
+        break;
+    }
+
+    awakeContacts = (Contact**)muli::Alloc(awakeContactCapacity * sizeof(Contact*));
 }
 
 ContactManager::~ContactManager()
 {
     muliAssert(contactList == nullptr);
+    muliAssert(awakeContactCount == 0);
+    muliAssert(pairSet.GetCount() == 0);
+
+    muli::Free(awakeContacts);
 }
 
 void ContactManager::EvaluateContacts()
 {
     // Narrow phase
     // Evaluate contacts, prepare for solving step
-    Contact* c = contactList;
-    while (c)
+    // Walk the awake contacts backward, destroying a contact moves an already visited one into its slot
+    // and contacts woken up during the loop are appended, they will be evaluated in the next step
+    for (int32 i = awakeContactCount - 1; i >= 0; --i)
     {
+        Contact* c = awakeContacts[i];
+
         Collider* colliderA = c->colliderA;
         Collider* colliderB = c->colliderB;
 
@@ -38,24 +66,20 @@ void ContactManager::EvaluateContacts()
 
         if (activeA == false && activeB == false)
         {
-            c = c->next;
             continue;
         }
 
-        bool overlap = broadPhase.TestOverlap(colliderA, colliderB);
+        bool overlap = broadPhase->TestOverlap(colliderA, colliderB);
 
         // This potential contact that is configured by aabb overlap is no longer valid so destroy it
         if (overlap == false)
         {
-            Contact* t = c;
-            c = c->next;
-            Destroy(t);
+            Destroy(c);
             continue;
         }
 
         // Evaluate the contact, prepare the solve step
         c->Update();
-        c = c->next;
     }
 }
 
@@ -77,23 +101,10 @@ void ContactManager::OnNewContact(Collider* colliderA, Collider* colliderB)
         return;
     }
 
-    // TODO: Use hash set to remove potential bottleneck
-    ContactEdge* e = bodyB->contactList;
-    while (e)
+    // This contact already exists
+    if (pairSet.Contains(colliderA, colliderB))
     {
-        if (e->other == bodyA)
-        {
-            Collider* ceA = e->contact->colliderA;
-            Collider* ceB = e->contact->colliderB;
-
-            // This contact already exists
-            if ((colliderA == ceA && colliderB == ceB) || (colliderA == ceB && colliderB == ceA))
-            {
-                return;
-            }
-        }
-
-        e = e->next;
+        return;
     }
 
     // Create new contact
@@ -135,6 +146,13 @@ void ContactManager::OnNewContact(Collider* colliderA, Collider* colliderB)
     }
     bodyB->contactList = &c->nodeB;
 
+    pairSet.Add(colliderA, colliderB);
+
+    if (IsAwake(c))
+    {
+        AddAwakeContact(c);
+    }
+
     ++contactCount;
 }
 
@@ -143,6 +161,14 @@ void ContactManager::Destroy(Contact* c)
     RigidBody* bodyA = c->bodyA;
     RigidBody* bodyB = c->bodyB;
 
+    world->islandManager.RemoveContact(c);
+    pairSet.Remove(c->colliderA, c->colliderB);
+
+    if (c->awakeIndex >= 0)
+    {
+        RemoveAwakeContact(c);
+    }
+
     // Remove from the world
     if (c->prev) c->prev->next = c->next;
     if (c->next) c->next->prev = c->prev;
@@ -163,15 +189,100 @@ void ContactManager::Destroy(Contact* c)
     --contactCount;
 }
 
+bool ContactManager::IsAwake(Contact* c) const
+{
+    PersistentIsland* islandA = c->bodyA->island;
+    PersistentIsland* islandB = c->bodyB->island;
+
+    return (islandA && islandA->sleeping == false) || (islandB && islandB->sleeping == false);
+}
+
+void ContactManager::AddAwakeContact(Contact* c)
+{
+    muliAssert(c->awakeIndex == -1);
+
+    // Grow the array as needed
+    if (awakeContactCount == awakeContactCapacity)
+    {
+        Contact** old = awakeContacts;
+        awakeContactCapacity *= 2;
+        awakeContacts = (Contact**)muli::Alloc(awakeContactCapacity * sizeof(Contact*));
+        memcpy(awakeContacts, old, awakeContactCount * sizeof(Contact*));
+        muli::Free(old);
+    }
+
+    c->awakeIndex = awakeContactCount;
+    awakeContacts[awakeContactCount] = c;
+    ++awakeContactCount;
+}
+
+void ContactManager::RemoveAwakeContact(Contact* c)
+{
+    muliAssert(0 <= c->awakeIndex && c->awakeIndex < awakeContactCount);
+
+    // Swap with the last one
+    Contact* last = awakeContacts[awakeContactCount - 1];
+    awakeContacts[c->awakeIndex] = last;
+    last->awakeIndex = c->awakeIndex;
+    --awakeContactCount;
+
+    c->awakeIndex = -1;
+}
+
+void ContactManager::WakeContacts(RigidBody* body)
+{
+    for (ContactEdge* ce = body->contactList; ce; ce = ce->next)
+    {
+        if (ce->contact->awakeIndex < 0)
+        {
+            AddAwakeContact(ce->contact);
+        }
+    }
+}
+
+void ContactManager::SleepContacts(RigidBody* body)
+{
+    for (ContactEdge* ce = body->contactList; ce; ce = ce->next)
+    {
+        Contact* c = ce->contact;
+
+        if (c->awakeIndex >= 0 && IsAwake(c) == false)
+        {
+            RemoveAwakeContact(c);
+        }
+    }
+}
+
 void ContactManager::AddCollider(Collider* collider)
 {
-    broadPhase.Add(collider, collider->GetAABB());
+    if (bulkInsert)
+    {
+        pendingColliders.push_back(collider);
+        return;
+    }
+
+    broadPhase->Add(collider, collider->GetAABB());
 }
 
 void ContactManager::RemoveCollider(Collider* collider)
 {
-    broadPhase.Remove(collider);
-    collider->node = AABBTree::nullNode;
+    if (bulkRemove)
+    {
+        // Already taken out by BeginBulkRemove()
+        muliAssert(collider->proxy == AABBTree::nullNode);
+    }
+    else if (collider->proxy == AABBTree::nullNode)
+    {
+        // Never made it into the broad phase
+        auto it = std::find(pendingColliders.begin(), pendingColliders.end(), collider);
+        muliAssert(it != pendingColliders.end());
+        pendingColliders.erase(it);
+    }
+    else
+    {
+        broadPhase->Remove(collider);
+        collider->proxy = AABBTree::nullNode;
+    }
 
     RigidBody* body = collider->body;
 
@@ -195,17 +306,88 @@ void ContactManager::RemoveCollider(Collider* collider)
     }
 }
 
+void ContactManager::BeginBulkRemove(std::span<Collider*> colliders)
+{
+    muliAssert(bulkRemove == false);
+    bulkRemove = true;
+
+    std::vector<Collider*> proxyColliders;
+    proxyColliders.reserve(colliders.size());
+
+    bool pending = false;
+    for (Collider* collider : colliders)
+    {
+        if (collider->proxy == AABBTree::nullNode)
+        {
+            pending = true;
+        }
+        else
+        {
+            proxyColliders.push_back(collider);
+        }
+    }
+
+    // Some of the colliders never made it into the broad phase
+    if (pending)
+    {
+        std::unordered_set<Collider*> removed(colliders.begin(), colliders.end());
+        std::erase_if(pendingColliders, [&removed](Collider* collider) -> bool { return removed.contains(collider); });
+    }
+
+    broadPhase->BulkRemove(proxyColliders);
+
+    for (Collider* collider : proxyColliders)
+    {
+        collider->proxy = AABBTree::nullNode;
+    }
+}
+
+void ContactManager::EndBulkRemove()
+{
+    bulkRemove = false;
+}
+
+void ContactManager::InsertPendingColliders()
+{
+    if (pendingColliders.empty())
+    {
+        return;
+    }
+
+    // The bodies may have moved since the colliders were created
+    std::vector<AABB> aabbs(pendingColliders.size());
+    for (size_t i = 0; i < pendingColliders.size(); ++i)
+    {
+        aabbs[i] = pendingColliders[i]->GetAABB();
+    }
+
+    broadPhase->BulkAdd(pendingColliders, aabbs);
+    pendingColliders.clear();
+}
+
 void ContactManager::UpdateCollider(Collider* collider, const Transform& tf)
 {
+    // Waiting for the bulk insertion, which reads the current aabb
+    if (collider->proxy == AABBTree::nullNode)
+    {
+        return;
+    }
+
     const Shape* shape = collider->GetShape();
     AABB aabb;
     shape->ComputeAABB(tf, &aabb);
 
-    broadPhase.Update(collider, aabb, Vec2::zero);
+    broadPhase->Update(collider, aabb, Vec2::zero);
 }
 
 void ContactManager::UpdateCollider(Collider* collider, const Transform& tf0, const Transform& tf1)
 {
+    // Waiting for the bulk insertion, which reads the current aabb
+    if (collider->proxy == AABBTree::nullNode)
+    {
+        return;
+    }
+
     const Shape* shape = collider->GetShape();
 
     AABB aabb0, aabb1;
@@ -216,7 +398,7 @@ void ContactManager::UpdateCollider(Collider* collider, const Transform& tf0, co
     aabb1.min += prediction;
     aabb1.max += prediction;
 
-    broadPhase.Update(collider, AABB::Union(aabb0, aabb1), prediction);
+    broadPhase->Update(collider, AABB::Union(aabb0, aabb1), prediction);
 }
 
 } // namespace muli
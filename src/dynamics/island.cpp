@@ -6,164 +6,602 @@
 namespace muli
 {
 
-Island::Island(World* _world, int32 _bodyCapacity, int32 _contactCapacity, int32 _jointCapacity)
+Island::Island(World* _world, LinearAllocator* _allocator, int32 _bodyCapacity, int32 _contactCapacity, int32 _jointCapacity)
     : world{ _world }
+    , allocator{ _allocator }
     , bodyCapacity{ _bodyCapacity }
     , contactCapacity{ _contactCapacity }
     , jointCapacity{ _jointCapacity }
     , bodyCount{ 0 }
     , contactCount{ 0 }
     , jointCount{ 0 }
+    , coloredContacts{ nullptr }
+    , coloredJoints{ nullptr }
+    , solverBodies{ nullptr, nullptr, nullptr, nullptr }
+    , solverBodyCapacity{ 0 }
+    , wideSolvers{ nullptr }
+    , wideSolverCount{ 0 }
+    , savedLinearVelocity{ nullptr }
+    , savedAngularVelocity{ nullptr }
+    , velocityIterations{ 0 }
+    , positionIterations{ 0 }
     , sleeping{ false }
+    , parallel{ false }
+    , wide{ false }
 {
-    bodies = (RigidBody**)world->linearAllocator.Allocate(bodyCapacity * sizeof(RigidBody*));
-    contacts = (Contact**)world->linearAllocator.Allocate(contactCapacity * sizeof(Contact*));
-    joints = (Joint**)world->linearAllocator.Allocate(jointCapacity * sizeof(Joint*));
+    bodies = (RigidBody**)allocator->Allocate(bodyCapacity * sizeof(RigidBody*));
+    contacts = (Contact**)allocator->Allocate(contactCapacity * sizeof(Contact*));
+    joints = (Joint**)allocator->Allocate(jointCapacity * sizeof(Joint*));
 }
 
 Island::~Island()
 {
-    world->linearAllocator.Free(joints, jointCapacity * sizeof(Joint*));
-    world->linearAllocator.Free(contacts, contactCapacity * sizeof(Contact*));
-    world->linearAllocator.Free(bodies, bodyCapacity * sizeof(RigidBody*));
+    allocator->Free(joints, jointCapacity * sizeof(Joint*));
+    allocator->Free(contacts, contactCapacity * sizeof(Contact*));
+    allocator->Free(bodies, bodyCapacity * sizeof(RigidBody*));
 }
 
-void Island::Solve()
+// Greedy graph coloring. Static bodies are ignored because the solver never modifies them
+template <typename T>
+void Island::ColorConstraints(T** constraints, int32 count, T** colored, int32* colorOffsets)
 {
-    bool awakeIsland = false;
+    int32 wordCount = (bodyCount + 63) / 64;
+    int32 bitsSize = graph_color_count * wordCount * sizeof(uint64);
 
-    const WorldSettings& settings = world->settings;
-    const Timestep& step = settings.step;
+    uint64* bodyBits = (uint64*)allocator->Allocate(bitsSize);
+    int32* colors = (int32*)allocator->Allocate(count * sizeof(int32));
+    memset(bodyBits, 0, bitsSize);
+
+    int32 colorCounts[graph_color_count + 1] = { 0 };
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        RigidBody* bodyA = constraints[i]->bodyA;
+        RigidBody* bodyB = constraints[i]->bodyB;
+
+        int32 indexA = bodyA->type == RigidBody::Type::static_body ? -1 : bodyA->islandIndex;
+        int32 indexB = bodyB->type == RigidBody::Type::static_body ? -1 : bodyB->islandIndex;
+
+        int32 color = graph_color_count;
+        for (int32 c = 0; c < graph_color_count; ++c)
+        {
+            uint64* bits = bodyBits + c * wordCount;
+
+            if (indexA >= 0 && (bits[indexA / 64] & (1ull << (indexA % 64))))
+            {
+                continue;
+            }
+
+            if (indexB >= 0 && (bits[indexB / 64] & (1ull << (indexB % 64))))
+            {
+                continue;
+            }
+
+            if (indexA >= 0) bits[indexA / 64] |= 1ull << (indexA % 64);
+            if (indexB >= 0) bits[indexB / 64] |= 1ull << (indexB % 64);
+
+            color = c;
+            break;
+        }
+
+        colors[i] = color;
+        ++colorCounts[color];
+    }
+
+    colorOffsets[0] = 0;
+    for (int32 c = 0; c <= graph_color_count; ++c)
+    {
+        colorOffsets[c + 1] = colorOffsets[c] + colorCounts[c];
+    }
+
+    // Scatter the constraints keeping the original order within a color
+    int32 cursors[graph_color_count + 1];
+    memcpy(cursors, colorOffsets, sizeof(cursors));
+
+    for (int32 i = 0; i < count; ++i)
+    {
+        colored[cursors[colors[i]]++] = constraints[i];
+    }
+
+    allocator->Free(colors, count * sizeof(int32));
+    allocator->Free(bodyBits, bitsSize);
+}
+
+void Island::BuildColors()
+{
+    coloredContacts = (Contact**)allocator->Allocate(contactCount * sizeof(Contact*));
+    coloredJoints = (Joint**)allocator->Allocate(jointCount * sizeof(Joint*));
+
+    ColorConstraints(contacts, contactCount, coloredContacts, contactColorOffsets);
+    ColorConstraints(joints, jointCount, coloredJoints, jointColorOffsets);
+}
+
+void Island::FreeColors()
+{
+    allocator->Free(coloredJoints, jointCount * sizeof(Joint*));
+    allocator->Free(coloredContacts, contactCount * sizeof(Contact*));
+    coloredJoints = nullptr;
+    coloredContacts = nullptr;
+}
+
+void Island::BuildSolverBodies()
+{
+    solverBodyCapacity = bodyCount + 2 * (contactCount + jointCount);
+
+    solverBodies.linearVelocity = (Vec2*)allocator->Allocate(solverBodyCapacity * sizeof(Vec2));
+    solverBodies.angularVelocity = (float*)allocator->Allocate(solverBodyCapacity * sizeof(float));
+    solverBodies.invMass = (float*)allocator->Allocate(solverBodyCapacity * sizeof(float));
+    solverBodies.invInertia = (float*)allocator->Allocate(solverBodyCapacity * sizeof(float));
+
+    int32 solverBodyCount = 0;
+
+    auto push = [&](RigidBody* b) -> int32 {
+        int32 index = solverBodyCount++;
+        solverBodies.linearVelocity[index] = b->linearVelocity;
+        solverBodies.angularVelocity[index] = b->angularVelocity;
+        solverBodies.invMass[index] = b->invMass;
+        solverBodies.invInertia[index] = b->invInertia;
+        return index;
+    };
 
-    // Integrate velocities, yield tentative velocities that possibly violate the constraint
+    for (int32 i = 0; i < bodyCount; ++i)
+    {
+        push(bodies[i]);
+    }
+
+    // Static bodies are shared between the islands and the colors,
+    // so every reference gets a private slot to keep the writes race free
+    auto getIndex = [&](RigidBody* b) -> int32 {
+        return b->type == RigidBody::Type::static_body ? push(b) : b->islandIndex;
+    };
+
+    for (int32 i = 0; i < contactCount; ++i)
+    {
+        Contact* c = contacts[i];
+        c->indexA = getIndex(c->bodyA);
+        c->indexB = getIndex(c->bodyB);
+    }
+    for (int32 i = 0; i < jointCount; ++i)
+    {
+        Joint* j = joints[i];
+        j->indexA = getIndex(j->bodyA);
+        j->indexB = getIndex(j->bodyB);
+    }
+
+    muliAssert(solverBodyCount <= solverBodyCapacity);
+}
+
+// Scatter the solved velocities back to the bodies
+void Island::StoreSolverBodies()
+{
     for (int32 i = 0; i < bodyCount; ++i)
     {
         RigidBody* b = bodies[i];
+        b->linearVelocity = solverBodies.linearVelocity[i];
+        b->angularVelocity = solverBodies.angularVelocity[i];
+    }
+}
+
+void Island::FreeSolverBodies()
+{
+    allocator->Free(solverBodies.invInertia, solverBodyCapacity * sizeof(float));
+    allocator->Free(solverBodies.invMass, solverBodyCapacity * sizeof(float));
+    allocator->Free(solverBodies.angularVelocity, solverBodyCapacity * sizeof(float));
+    allocator->Free(solverBodies.linearVelocity, solverBodyCapacity * sizeof(Vec2));
+    solverBodies = { nullptr, nullptr, nullptr, nullptr };
+}
+
+template <typename T, typename F>
+void Island::SolveColored(T** constraints, const int32* colorOffsets, F&& function)
+{
+    for (int32 c = 0; c < graph_color_count; ++c)
+    {
+        T** colorConstraints = constraints + colorOffsets[c];
+        int32 count = colorOffsets[c + 1] - colorOffsets[c];
+
+        world->threadPool.ParallelFor(count, parallel_grain_size, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+            muliNotUsed(threadIndex);
+
+            for (int32 i = begin; i < end; ++i)
+            {
+                function(colorConstraints[i]);
+            }
+        });
+    }
+
+    // Overflowed constraints
+    for (int32 i = colorOffsets[graph_color_count]; i < colorOffsets[graph_color_count + 1]; ++i)
+    {
+        function(constraints[i]);
+    }
+}
+
+template <typename F>
+void Island::ParallelFor(int32 count, F&& function)
+{
+    if (parallel)
+    {
+        world->threadPool.ParallelFor(count, parallel_grain_size, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+            muliNotUsed(threadIndex);
+            function(begin, end);
+        });
+    }
+    else
+    {
+        function(0, count);
+    }
+}
+
+void Island::BuildWideSolvers()
+{
+    wideSolverCount = 0;
+    for (int32 c = 0; c < graph_color_count; ++c)
+    {
+        int32 count = contactColorOffsets[c + 1] - contactColorOffsets[c];
+        wideSolverCount += (count + simd_width - 1) / simd_width;
+    }
+
+    wideSolvers = (WideContactSolver*)allocator->Allocate(wideSolverCount * sizeof(WideContactSolver));
+
+    // Contacts of the same color never share a non-static body
+    int32 index = 0;
+    for (int32 c = 0; c < graph_color_count; ++c)
+    {
+        wideColorOffsets[c] = index;
+
+        for (int32 i = contactColorOffsets[c]; i < contactColorOffsets[c + 1]; i += simd_width)
+        {
+            int32 count = Min(simd_width, contactColorOffsets[c + 1] - i);
+            wideSolvers[index++].Prepare(coloredContacts + i, count, solverBodies);
+        }
+    }
+    wideColorOffsets[graph_color_count] = index;
+}
+
+void Island::FreeWideSolvers()
+{
+    for (int32 i = 0; i < wideSolverCount; ++i)
+    {
+        wideSolvers[i].StoreImpulses();
+    }
+
+    allocator->Free(wideSolvers, wideSolverCount * sizeof(WideContactSolver));
+    wideSolvers = nullptr;
+    wideSolverCount = 0;
+}
 
-        // Save positions for continuous collision
-        b->sweep.c0 = b->sweep.c;
-        b->sweep.a0 = b->sweep.a;
+void Island::SolveWideContacts(const Timestep& step)
+{
+    for (int32 c = 0; c < graph_color_count; ++c)
+    {
+        WideContactSolver* colorSolvers = wideSolvers + wideColorOffsets[c];
+        int32 count = wideColorOffsets[c + 1] - wideColorOffsets[c];
 
-        // All bodies on this island are resting more than sleep time, but flags are not set
-        if (sleeping)
+        if (parallel)
         {
-            b->islandID = 0;
-            b->islandIndex = 0;
-            b->linearVelocity.SetZero();
-            b->angularVelocity = 0.0f;
-            b->flag |= RigidBody::flag_sleeping;
+            world->threadPool.ParallelFor(count, parallel_grain_size / simd_width,
+                                          [&](int32 begin, int32 end, int32 threadIndex) -> void {
+                                              muliNotUsed(threadIndex);
+
+                                              for (int32 i = begin; i < end; ++i)
+                                              {
+                                                  colorSolvers[i].Solve(solverBodies);
+                                              }
+                                          });
         }
         else
         {
-            b->flag &= ~RigidBody::flag_sleeping;
+            for (int32 i = 0; i < count; ++i)
+            {
+                colorSolvers[i].Solve(solverBodies);
+            }
         }
+    }
 
-        if ((b->angularVelocity * b->angularVelocity > settings.rest_angular_tolerance) ||
-            (Dot(b->linearVelocity, b->linearVelocity) > settings.rest_linear_tolerance) || (b->torque * b->torque > 0.0f) ||
-            (Dot(b->force, b->force) > 0.0f))
+    // Overflowed contacts
+    for (int32 i = contactColorOffsets[graph_color_count]; i < contactColorOffsets[graph_color_count + 1]; ++i)
+    {
+        coloredContacts[i]->SolveVelocityConstraints(step, solverBodies);
+    }
+}
+
+// The velocity change of a body is the sum of the impulses applied to it scaled by its inverse mass,
+// so it measures the residual of every constraint type without asking the constraints for it
+float Island::MeasureVelocityChange()
+{
+    auto measure = [&](int32 begin, int32 end) -> float {
+        float maxChange2 = 0.0f;
+
+        for (int32 i = begin; i < end; ++i)
         {
-            muliAssert(sleeping == false);
-            awakeIsland = true;
+            float dw = solverBodies.angularVelocity[i] - savedAngularVelocity[i];
+            maxChange2 = Max(maxChange2, Max((solverBodies.linearVelocity[i] - savedLinearVelocity[i]).Length2(), dw * dw));
+
+            savedLinearVelocity[i] = solverBodies.linearVelocity[i];
+            savedAngularVelocity[i] = solverBodies.angularVelocity[i];
         }
-        else
+
+        return maxChange2;
+    };
+
+    float maxChange2 = 0.0f;
+
+    if (parallel)
+    {
+        int32 threadCount = world->threadPool.GetThreadCount();
+        float* threadMaxChange2 = (float*)allocator->Allocate(threadCount * sizeof(float));
+        memset(threadMaxChange2, 0, threadCount * sizeof(float));
+
+        world->threadPool.ParallelFor(bodyCount, parallel_grain_size, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+            threadMaxChange2[threadIndex] = Max(threadMaxChange2[threadIndex], measure(begin, end));
+        });
+
+        for (int32 i = 0; i < threadCount; ++i)
         {
-            b->resting += step.dt;
+            maxChange2 = Max(maxChange2, threadMaxChange2[i]);
         }
 
-        if (b->type == RigidBody::Type::dynamic_body)
+        allocator->Free(threadMaxChange2, threadCount * sizeof(float));
+    }
+    else
+    {
+        maxChange2 = measure(0, bodyCount);
+    }
+
+    return Sqrt(maxChange2);
+}
+
+void Island::Solve()
+{
+    const WorldSettings& settings = world->settings;
+    const Timestep& step = settings.step;
+
+    ParallelFor(bodyCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
         {
-            // Integrate velocites
-            b->linearVelocity += b->invMass * step.dt * (b->force + settings.apply_gravity * settings.gravity * b->mass);
-            b->angularVelocity += b->invInertia * step.dt * b->torque;
+            RigidBody* b = bodies[i];
 
-            /*
-               Apply damping (found in box2d)
-               ODE: dv/dt + c * v = 0
-               dv/dt = -c * v
-               (1/v) dv = -c dt ; integrate both sides
-               ln|v| = -c * t + C ; exponentiate both sides (C is integration constant)
-               v = C * exp(-c * t)
-               v(0) = C
-               Solution: v(t) = v0 * exp(-c * t)
-               Time step: v(t + dt) = v0 * exp(-c * (t + dt))
-                                    = v0 * exp(-c * t) * exp(-c * dt)
-                                    = v * exp(-c * dt)
-               v2 = exp(-c * dt) * v1
-               Pade approximation:
-               v2 = v1 * 1 / (1 + c * dt)
-            */
-            b->linearVelocity *= 1.0f / (1.0f + b->linearDamping * step.dt);
-            b->angularVelocity *= 1.0f / (1.0f + b->angularDamping * step.dt);
+            // Save positions for continuous collision
+            b->sweep.c0 = b->sweep.c;
+            b->sweep.a0 = b->sweep.a;
+
+            // All bodies on this island are resting more than sleep time, but flags are not set
+            if (sleeping)
+            {
+                b->islandID = 0;
+                b->linearVelocity.SetZero();
+                b->angularVelocity = 0.0f;
+                b->flag |= RigidBody::flag_sleeping;
+            }
+            else
+            {
+                b->flag &= ~RigidBody::flag_sleeping;
+            }
+
+            if ((b->angularVelocity * b->angularVelocity > settings.rest_angular_tolerance) ||
+                (Dot(b->linearVelocity, b->linearVelocity) > settings.rest_linear_tolerance) || (b->torque * b->torque > 0.0f) ||
+                (Dot(b->force, b->force) > 0.0f))
+            {
+                // Each body keeps its own resting time, so the island falls asleep once its last moving body has rested long
+                // enough and the resting parts of a disconnected island can be detected for splitting
+                muliAssert(sleeping == false);
+                b->resting = 0.0f;
+            }
+            else
+            {
+                b->resting += step.dt;
+            }
         }
+    });
+
+    if (settings.solver_type == SolverType::soft_step)
+    {
+        SolveSoftStep();
+        return;
     }
 
+    wide = settings.simd_contact_solver && contactCount >= simd_contact_threshold;
+
+    if (parallel || wide)
+    {
+        BuildColors();
+    }
+
+    BuildSolverBodies();
+
+    // Integrate velocities, yield tentative velocities that possibly violate the constraint
+    IntegrateVelocities(step);
+
     // Prepare constraints for solving step
-    for (int32 i = 0; i < contactCount; ++i)
+    // Prepare() only writes to the constraint itself, the shared body velocities are touched by WarmStart()
+    ParallelFor(contactCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            contacts[i]->Prepare(step, solverBodies);
+        }
+    });
+    ParallelFor(jointCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            joints[i]->Prepare(step, solverBodies);
+        }
+    });
+
+    if (step.warm_starting)
     {
-        contacts[i]->Prepare(step);
+        if (parallel)
+        {
+            SolveColored(coloredContacts, contactColorOffsets, [&](Contact* c) { c->WarmStart(solverBodies); });
+            SolveColored(coloredJoints, jointColorOffsets, [&](Joint* j) { j->WarmStart(solverBodies); });
+        }
+        else
+        {
+            for (int32 i = 0; i < contactCount; ++i)
+            {
+                contacts[i]->WarmStart(solverBodies);
+            }
+            for (int32 i = 0; i < jointCount; ++i)
+            {
+                joints[i]->WarmStart(solverBodies);
+            }
+        }
     }
-    for (int32 i = 0; i < jointCount; ++i)
+
+    if (wide)
+    {
+        BuildWideSolvers();
+    }
+
+    bool adaptive = step.velocity_tolerance > 0.0f;
+    if (adaptive)
     {
-        joints[i]->Prepare(step);
+        savedLinearVelocity = (Vec2*)allocator->Allocate(bodyCount * sizeof(Vec2));
+        savedAngularVelocity = (float*)allocator->Allocate(bodyCount * sizeof(float));
+        memcpy(savedLinearVelocity, solverBodies.linearVelocity, bodyCount * sizeof(Vec2));
+        memcpy(savedAngularVelocity, solverBodies.angularVelocity, bodyCount * sizeof(float));
     }
 
     // Iteratively solve the violated velocity constraints
     // Solving contacts backward converge fast
+    velocityIterations = 0;
     for (int32 i = 0; i < step.velocity_iterations; ++i)
     {
+        // Converged if the previous iteration barely changed the velocities
+        if (adaptive && i > 0 && MeasureVelocityChange() < step.velocity_tolerance)
+        {
+            break;
+        }
+
+        ++velocityIterations;
+
+        if (wide)
+        {
+#if SOLVE_CONTACT_CONSTRAINT
+            SolveWideContacts(step);
+#endif
+            if (parallel)
+            {
+                SolveColored(coloredJoints, jointColorOffsets, [&](Joint* j) { j->SolveVelocityConstraints(step, solverBodies); });
+            }
+            else
+            {
+                for (int32 j = jointCount; j > 0; j--)
+                {
+                    joints[j - 1]->SolveVelocityConstraints(step, solverBodies);
+                }
+            }
+            continue;
+        }
+
+        if (parallel)
+        {
+#if SOLVE_CONTACT_CONSTRAINT
+            SolveColored(coloredContacts, contactColorOffsets, [&](Contact* c) { c->SolveVelocityConstraints(step, solverBodies); });
+#endif
+            SolveColored(coloredJoints, jointColorOffsets, [&](Joint* j) { j->SolveVelocityConstraints(step, solverBodies); });
+            continue;
+        }
+
 #if SOLVE_CONTACTS_BACKWARD
 #if SOLVE_CONTACT_CONSTRAINT
         for (int32 j = contactCount; j > 0; j--)
         {
-            contacts[j - 1]->SolveVelocityConstraints(step);
+            contacts[j - 1]->SolveVelocityConstraints(step, solverBodies);
         }
 #endif
         for (int32 j = jointCount; j > 0; j--)
         {
-            joints[j - 1]->SolveVelocityConstraints(step);
+            joints[j - 1]->SolveVelocityConstraints(step, solverBodies);
         }
 #else
 #if SOLVE_CONTACT_CONSTRAINT
         for (int32 j = 0; j < contactCount; ++j)
         {
-            contacts[j]->SolveVelocityConstraints(step);
+            contacts[j]->SolveVelocityConstraints(step, solverBodies);
         }
 #endif
         for (int32 j = 0; j < jointCount; ++j)
         {
-            joints[j]->SolveVelocityConstraints(step);
+            joints[j]->SolveVelocityConstraints(step, solverBodies);
         }
 #endif
     }
 
-    // Update positions using corrected velocities (Semi-implicit euler integration)
-    for (int32 i = 0; i < bodyCount; ++i)
+    if (adaptive)
     {
-        RigidBody* b = bodies[i];
+        allocator->Free(savedAngularVelocity, bodyCount * sizeof(float));
+        allocator->Free(savedLinearVelocity, bodyCount * sizeof(Vec2));
+    }
 
-        if (awakeIsland)
+    if (wide)
+    {
+        FreeWideSolvers();
+    }
+
+    // Update positions using corrected velocities (Semi-implicit euler integration)
+    ParallelFor(bodyCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
         {
-            b->Awake();
-        }
+            RigidBody* b = bodies[i];
 
-        b->force.SetZero();
-        b->torque = 0.0f;
+            b->linearVelocity = solverBodies.linearVelocity[i];
+            b->angularVelocity = solverBodies.angularVelocity[i];
 
-        b->sweep.c += b->linearVelocity * step.dt;
-        b->sweep.a += b->angularVelocity * step.dt;
+            b->sweep.c += b->linearVelocity * step.dt;
+            b->sweep.a += b->angularVelocity * step.dt;
 
-        if (settings.world_bounds.TestPoint(b->GetPosition()) == false)
-        {
-            world->BufferDestroy(b);
+            b->force.SetZero();
+            b->torque = 0.0f;
+
+            if (sleeping)
+            {
+                b->islandIndex = 0;
+            }
         }
-    }
+    });
+
+    FreeSolverBodies();
 
     // Solve position constraints
+    positionIterations = 0;
     for (int32 i = 0; i < settings.step.position_iterations; ++i)
     {
         bool contactSolved = true;
         bool jointSolved = true;
 
+        ++positionIterations;
+
+        if (parallel)
+        {
+            std::atomic<bool> contactSolvedAll = true;
+            std::atomic<bool> jointSolvedAll = true;
+
+#if SOLVE_CONTACT_CONSTRAINT
+            SolveColored(coloredContacts, contactColorOffsets, [&](Contact* c) {
+                bool solved = c->SolvePositionConstraints(step);
+                if (solved == false)
+                {
+                    c->b1->Awake();
+                    c->b2->Awake();
+                    contactSolvedAll.store(false, std::memory_order_relaxed);
+                }
+            });
+#endif
+            SolveColored(coloredJoints, jointColorOffsets, [&](Joint* j) {
+                if (j->SolvePositionConstraints(step) == false)
+                {
+                    jointSolvedAll.store(false, std::memory_order_relaxed);
+                }
+            });
+
+            if (contactSolvedAll && jointSolvedAll)
+            {
+                break;
+            }
+
+            continue;
+        }
+
 #if SOLVE_CONTACTS_BACKWARD
 #if SOLVE_CONTACT_CONSTRAINT
         for (int32 j = contactCount; j > 0; j--)
@@ -211,15 +649,210 @@ void Island::Solve()
         }
     }
 
-    for (int32 i = 0; i < contactCount; ++i)
+    if (parallel || wide)
     {
-        Contact* contact = contacts[i];
+        FreeColors();
+    }
+}
 
-        Collider* colliderA = contact->colliderA;
-        Collider* colliderB = contact->colliderB;
+template <typename F>
+void Island::ForEachContact(F&& function)
+{
+    if (parallel)
+    {
+        SolveColored(coloredContacts, contactColorOffsets, function);
+    }
+    else
+    {
+        for (int32 i = contactCount; i > 0; i--)
+        {
+            function(contacts[i - 1]);
+        }
+    }
+}
 
-        if (colliderA->ContactListener) colliderA->ContactListener->OnPostSolve(colliderA, colliderB, contact);
-        if (colliderB->ContactListener) colliderB->ContactListener->OnPostSolve(colliderB, colliderA, contact);
+template <typename F>
+void Island::ForEachJoint(F&& function)
+{
+    if (parallel)
+    {
+        SolveColored(coloredJoints, jointColorOffsets, function);
+    }
+    else
+    {
+        for (int32 i = jointCount; i > 0; i--)
+        {
+            function(joints[i - 1]);
+        }
+    }
+}
+
+void Island::IntegrateVelocities(const Timestep& subStep)
+{
+    const WorldSettings& settings = world->settings;
+    float h = subStep.dt;
+
+    ParallelFor(bodyCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            RigidBody* b = bodies[i];
+            if (b->type != RigidBody::Type::dynamic_body)
+            {
+                continue;
+            }
+
+            Vec2& v = solverBodies.linearVelocity[i];
+            float& w = solverBodies.angularVelocity[i];
+
+            v += b->invMass * h * (b->force + settings.apply_gravity * settings.gravity * b->mass);
+            w += b->invInertia * h * b->torque;
+
+            /*
+               Apply damping (found in box2d)
+               ODE: dv/dt + c * v = 0
+               dv/dt = -c * v
+               (1/v) dv = -c dt ; integrate both sides
+               ln|v| = -c * t + C ; exponentiate both sides (C is integration constant)
+               v = C * exp(-c * t)
+               v(0) = C
+               Solution: v(t) = v0 * exp(-c * t)
+               Time step: v(t + dt) = v0 * exp(-c * (t + dt))
+                                    = v0 * exp(-c * t) * exp(-c * dt)
+                                    = v * exp(-c * dt)
+               v2 = exp(-c * dt) * v1
+               Pade approximation:
+               v2 = v1 * 1 / (1 + c * dt)
+            */
+            v *= 1.0f / (1.0f + b->linearDamping * h);
+            w *= 1.0f / (1.0f + b->angularDamping * h);
+        }
+    });
+}
+
+void Island::IntegratePositions(const Timestep& subStep)
+{
+    float h = subStep.dt;
+
+    ParallelFor(bodyCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            RigidBody* b = bodies[i];
+
+            b->sweep.c += solverBodies.linearVelocity[i] * h;
+            b->sweep.a += solverBodies.angularVelocity[i] * h;
+
+            // Contacts and joints read the rotation of the body in the next sub step
+            b->SynchronizeTransform();
+        }
+    });
+}
+
+// Soft step solver (Box2D v3)
+// Each sub step integrates the velocities, solves the contacts with soft position bias,
+// integrates the positions and relaxes the contacts without bias to remove the velocity added by the bias
+// Joints are prepared once with the full step and iterated in both passes,
+// they need as many iterations as the sequential impulse solver gives them to stay stable
+void Island::SolveSoftStep()
+{
+    const WorldSettings& settings = world->settings;
+    const Timestep& step = settings.step;
+
+    int32 subStepCount = Max(step.sub_steps, 1);
+
+    // One biased iteration per sub step, the positions are never corrected afterward
+    velocityIterations = subStepCount;
+    positionIterations = 0;
+
+    Timestep subStep = step;
+    subStep.dt = step.dt / subStepCount;
+    subStep.inv_dt = step.inv_dt * subStepCount;
+
+    float hertz = Min(contact_hertz, 0.25f * subStep.inv_dt);
+    Softness softness = MakeSoft(hertz, contact_damping_ratio, subStep.dt);
+    Softness staticSoftness = MakeSoft(2.0f * hertz, contact_damping_ratio, subStep.dt);
+
+    auto getSoftness = [&](Contact* c) -> const Softness& {
+        bool hasStatic = c->bodyA->type == RigidBody::Type::static_body || c->bodyB->type == RigidBody::Type::static_body;
+        return hasStatic ? staticSoftness : softness;
+    };
+
+    if (parallel)
+    {
+        BuildColors();
+    }
+
+    BuildSolverBodies();
+
+    ParallelFor(contactCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            contacts[i]->Prepare(subStep, solverBodies);
+        }
+    });
+    ParallelFor(jointCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            joints[i]->Prepare(step, solverBodies);
+        }
+    });
+
+    // Contacts are warm started every sub step, joints once with the full step
+    if (step.warm_starting)
+    {
+        if (parallel)
+        {
+            SolveColored(coloredJoints, jointColorOffsets, [&](Joint* j) { j->WarmStart(solverBodies); });
+        }
+        else
+        {
+            for (int32 i = 0; i < jointCount; ++i)
+            {
+                joints[i]->WarmStart(solverBodies);
+            }
+        }
+    }
+
+    for (int32 i = 0; i < subStepCount; ++i)
+    {
+        IntegrateVelocities(subStep);
+
+        if (step.warm_starting)
+        {
+            ForEachContact([&](Contact* c) { c->WarmStart(solverBodies); });
+        }
+
+        ForEachJoint([&](Joint* j) { j->SolveVelocityConstraints(step, solverBodies); });
+        ForEachContact([&](Contact* c) { c->SolveSoftConstraints(subStep, solverBodies, getSoftness(c), true); });
+
+        IntegratePositions(subStep);
+
+        ForEachJoint([&](Joint* j) { j->SolveVelocityConstraints(step, solverBodies); });
+        ForEachContact([&](Contact* c) { c->SolveSoftConstraints(subStep, solverBodies, getSoftness(c), false); });
+    }
+
+    ForEachContact([&](Contact* c) { c->ApplyRestitution(solverBodies); });
+
+    StoreSolverBodies();
+    FreeSolverBodies();
+
+    ParallelFor(bodyCount, [&](int32 begin, int32 end) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            RigidBody* b = bodies[i];
+
+            if (sleeping)
+            {
+                b->islandIndex = 0;
+            }
+
+            b->force.SetZero();
+            b->torque = 0.0f;
+        }
+    });
+
+    if (parallel)
+    {
+        FreeColors();
     }
 }
 
@@ -229,16 +862,16 @@ static constexpr int32 toi_index_2 = 1;
 
 void Island::SolveTOI(float dt)
 {
-    Timestep& step = world->settings.step;
-    bool warmStartingEnabled = step.warm_starting;
+    const Timestep& step = world->settings.step;
 
-    step.warm_starting = false;
+    // The contacts are not warm started, the impulses of the discrete solver are restored afterward
+    BuildSolverBodies();
 
     for (int32 i = 0; i < contactCount; ++i)
     {
         // Save the impulses computed by the discrete solver
         contacts[i]->SaveImpulses();
-        contacts[i]->Prepare(step);
+        contacts[i]->Prepare(step, solverBodies);
     }
 
     // Move the TOI contact to a safe position so that the next ComputeTimeOfImpact() returns the separated state
@@ -268,19 +901,22 @@ void Island::SolveTOI(float dt)
 #if SOLVE_CONTACT_CONSTRAINT
         for (int32 j = contactCount; j > 0; j--)
         {
-            contacts[j - 1]->SolveVelocityConstraints(step);
+            contacts[j - 1]->SolveVelocityConstraints(step, solverBodies);
         }
 #endif
 #else
 #if SOLVE_CONTACT_CONSTRAINT
         for (int32 j = 0; j < contactCount; ++j)
         {
-            contacts[j]->SolveVelocityConstraints(step);
+            contacts[j]->SolveVelocityConstraints(step, solverBodies);
         }
 #endif
 #endif
     }
 
+    StoreSolverBodies();
+    FreeSolverBodies();
+
     // We don't need position correction
     // Because we solved velocity constraints in a position that is already safe
 
@@ -293,8 +929,6 @@ void Island::SolveTOI(float dt)
         b->SynchronizeTransform();
     }
 
-    step.warm_starting = warmStartingEnabled;
-
     for (int32 i = 0; i < contactCount; ++i)
     {
         Contact* contact = contacts[i];
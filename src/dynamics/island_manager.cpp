@@ -0,0 +1,554 @@
+#include "muli/island_manager.h"
+#include "muli/world.h"
+
+namespace muli
+{
+
+IslandManager::IslandManager(World* _world)
+    : world{ _world }
+    , awakeList{ nullptr }
+    , sleepingList{ nullptr }
+    , awakeIslandCount{ 0 }
+    , sleepingBodyCount{ 0 }
+{
+}
+
+IslandManager::~IslandManager()
+{
+    muliAssert(awakeList == nullptr);
+    muliAssert(sleepingList == nullptr);
+}
+
+void IslandManager::AddBody(RigidBody* body)
+{
+    muliAssert(body->island == nullptr);
+
+    if (body->type == RigidBody::Type::static_body)
+    {
+        return;
+    }
+
+    // Every non-static body starts on its own island
+    PersistentIsland* island = CreateIsland();
+    InsertAfter(&awakeList, nullptr, island);
+    ++awakeIslandCount;
+
+    LinkBody(island, body);
+
+    // The body may already be touching sleeping bodies, e.g. when it turns from static to dynamic
+    world->contactManager.WakeContacts(body);
+}
+
+void IslandManager::RemoveBody(RigidBody* body)
+{
+    PersistentIsland* island = body->island;
+    if (island == nullptr)
+    {
+        return;
+    }
+
+    if (body->islandPrev) body->islandPrev->islandNext = body->islandNext;
+    if (body->islandNext) body->islandNext->islandPrev = body->islandPrev;
+    if (body == island->bodyList) island->bodyList = body->islandNext;
+    if (body == island->bodyListTail) island->bodyListTail = body->islandPrev;
+
+    body->island = nullptr;
+    body->islandPrev = nullptr;
+    body->islandNext = nullptr;
+
+    world->contactManager.SleepContacts(body);
+
+    --island->bodyCount;
+    ++island->constraintRemoveCount;
+
+    if (island->sleeping)
+    {
+        --sleepingBodyCount;
+    }
+
+    if (island->bodyCount == 0)
+    {
+        DestroyIsland(island);
+    }
+}
+
+void IslandManager::AddContact(Contact* contact)
+{
+    muliAssert(contact->island == nullptr);
+
+    PersistentIsland* island = Merge(contact->bodyA->island, contact->bodyB->island);
+    if (island == nullptr)
+    {
+        return;
+    }
+
+    LinkContact(island, contact);
+}
+
+void IslandManager::RemoveContact(Contact* contact)
+{
+    PersistentIsland* island = contact->island;
+    if (island == nullptr)
+    {
+        return;
+    }
+
+    if (contact->islandPrev) contact->islandPrev->islandNext = contact->islandNext;
+    if (contact->islandNext) contact->islandNext->islandPrev = contact->islandPrev;
+    if (contact == island->contactList) island->contactList = contact->islandNext;
+    if (contact == island->contactListTail) island->contactListTail = contact->islandPrev;
+
+    contact->island = nullptr;
+    contact->islandPrev = nullptr;
+    contact->islandNext = nullptr;
+
+    --island->contactCount;
+    ++island->constraintRemoveCount;
+}
+
+void IslandManager::AddJoint(Joint* joint)
+{
+    PersistentIsland* island = Merge(joint->bodyA->island, joint->bodyB->island);
+    if (island == nullptr)
+    {
+        // Joint between two static bodies
+        return;
+    }
+
+    if (joint->island == nullptr)
+    {
+        LinkJoint(island, joint);
+    }
+
+    muliAssert(joint->island == island);
+}
+
+void IslandManager::RemoveJoint(Joint* joint)
+{
+    PersistentIsland* island = joint->island;
+    if (island == nullptr)
+    {
+        return;
+    }
+
+    if (joint->islandPrev) joint->islandPrev->islandNext = joint->islandNext;
+    if (joint->islandNext) joint->islandNext->islandPrev = joint->islandPrev;
+    if (joint == island->jointList) island->jointList = joint->islandNext;
+    if (joint == island->jointListTail) island->jointListTail = joint->islandPrev;
+
+    joint->island = nullptr;
+    joint->islandPrev = nullptr;
+    joint->islandNext = nullptr;
+
+    --island->jointCount;
+    ++island->constraintRemoveCount;
+}
+
+void IslandManager::Wake(PersistentIsland* island)
+{
+    if (island->sleeping == false)
+    {
+        return;
+    }
+
+    Remove(&sleepingList, island);
+    InsertAfter(&awakeList, nullptr, island);
+    ++awakeIslandCount;
+
+    island->sleeping = false;
+    sleepingBodyCount -= island->bodyCount;
+
+    for (RigidBody* b = island->bodyList; b; b = b->islandNext)
+    {
+        world->contactManager.WakeContacts(b);
+    }
+}
+
+void IslandManager::Sleep(PersistentIsland* island)
+{
+    if (island->sleeping == true)
+    {
+        return;
+    }
+
+    Remove(&awakeList, island);
+    InsertAfter(&sleepingList, nullptr, island);
+    --awakeIslandCount;
+
+    island->sleeping = true;
+    sleepingBodyCount += island->bodyCount;
+
+    for (RigidBody* b = island->bodyList; b; b = b->islandNext)
+    {
+        world->contactManager.SleepContacts(b);
+    }
+}
+
+void IslandManager::Split(PersistentIsland* island)
+{
+    const int32 bodyCount = island->bodyCount;
+    const int32 contactCount = island->contactCount;
+    const int32 jointCount = island->jointCount;
+
+    LinearAllocator& allocator = world->linearAllocator;
+    RigidBody** bodies = (RigidBody**)allocator.Allocate(bodyCount * sizeof(RigidBody*));
+    Contact** contacts = (Contact**)allocator.Allocate(contactCount * sizeof(Contact*));
+    Joint** joints = (Joint**)allocator.Allocate(jointCount * sizeof(Joint*));
+    RigidBody** stack = (RigidBody**)allocator.Allocate(bodyCount * sizeof(RigidBody*));
+
+    int32 i = 0;
+    for (RigidBody* b = island->bodyList; b; b = b->islandNext)
+    {
+        bodies[i++] = b;
+    }
+    i = 0;
+    for (Contact* c = island->contactList; c; c = c->islandNext)
+    {
+        contacts[i++] = c;
+    }
+    i = 0;
+    for (Joint* j = island->jointList; j; j = j->islandNext)
+    {
+        joints[i++] = j;
+    }
+
+    // Empty the island, its constraints keep pointing at it until they are visited
+    island->bodyList = nullptr;
+    island->bodyListTail = nullptr;
+    island->contactList = nullptr;
+    island->contactListTail = nullptr;
+    island->jointList = nullptr;
+    island->jointListTail = nullptr;
+    island->bodyCount = 0;
+    island->contactCount = 0;
+    island->jointCount = 0;
+    island->constraintRemoveCount = 0;
+
+    PersistentIsland** list = island->sleeping ? &sleepingList : &awakeList;
+    PersistentIsland* last = nullptr;
+
+    // Perform a DFS on the constraint graph of the island
+    // The first component takes over the island, the others are inserted after it
+    for (i = 0; i < bodyCount; ++i)
+    {
+        RigidBody* seed = bodies[i];
+
+        if (seed->flag & RigidBody::flag_island)
+        {
+            continue;
+        }
+
+        PersistentIsland* target = island;
+        if (last != nullptr)
+        {
+            target = CreateIsland();
+            target->sleeping = island->sleeping;
+            InsertAfter(list, last, target);
+
+            if (target->sleeping == false)
+            {
+                ++awakeIslandCount;
+            }
+        }
+        last = target;
+
+        int32 stackPointer = 0;
+        stack[stackPointer++] = seed;
+        seed->flag |= RigidBody::flag_island;
+
+        while (stackPointer > 0)
+        {
+            RigidBody* t = stack[--stackPointer];
+            LinkBody(target, t);
+
+            for (ContactEdge* ce = t->contactList; ce; ce = ce->next)
+            {
+                Contact* c = ce->contact;
+
+                if (c->island != island || (c->flag & Contact::flag_island))
+                {
+                    continue;
+                }
+
+                c->flag |= Contact::flag_island;
+                LinkContact(target, c);
+
+                RigidBody* other = ce->other;
+
+                if (other->type == RigidBody::Type::static_body || (other->flag & RigidBody::flag_island))
+                {
+                    continue;
+                }
+
+                muliAssert(stackPointer < bodyCount);
+                stack[stackPointer++] = other;
+                other->flag |= RigidBody::flag_island;
+            }
+
+            for (JointEdge* je = t->jointList; je; je = je->next)
+            {
+                Joint* j = je->joint;
+
+                if (j->island != island || j->flagIsland == true)
+                {
+                    continue;
+                }
+
+                j->flagIsland = true;
+                LinkJoint(target, j);
+
+                RigidBody* other = je->other;
+
+                if (other->type == RigidBody::Type::static_body || (other->flag & RigidBody::flag_island))
+                {
+                    continue;
+                }
+
+                muliAssert(stackPointer < bodyCount);
+                stack[stackPointer++] = other;
+                other->flag |= RigidBody::flag_island;
+            }
+        }
+    }
+
+    // Clear the search flags and detach the constraints that are no longer connected to any body
+    for (i = 0; i < bodyCount; ++i)
+    {
+        bodies[i]->flag &= ~RigidBody::flag_island;
+    }
+    for (i = 0; i < contactCount; ++i)
+    {
+        Contact* c = contacts[i];
+        if ((c->flag & Contact::flag_island) == 0)
+        {
+            c->island = nullptr;
+            c->islandPrev = nullptr;
+            c->islandNext = nullptr;
+        }
+        c->flag &= ~Contact::flag_island;
+    }
+    for (i = 0; i < jointCount; ++i)
+    {
+        Joint* j = joints[i];
+        if (j->flagIsland == false)
+        {
+            j->island = nullptr;
+            j->islandPrev = nullptr;
+            j->islandNext = nullptr;
+        }
+        j->flagIsland = false;
+    }
+
+    allocator.Free(stack, bodyCount * sizeof(RigidBody*));
+    allocator.Free(joints, jointCount * sizeof(Joint*));
+    allocator.Free(contacts, contactCount * sizeof(Contact*));
+    allocator.Free(bodies, bodyCount * sizeof(RigidBody*));
+
+    if (island->bodyCount == 0)
+    {
+        DestroyIsland(island);
+    }
+}
+
+PersistentIsland* IslandManager::CreateIsland()
+{
+    void* mem = world->blockAllocator.Allocate(sizeof(PersistentIsland));
+    PersistentIsland* island = new (mem) PersistentIsland;
+
+    island->prev = nullptr;
+    island->next = nullptr;
+    island->bodyList = nullptr;
+    island->bodyListTail = nullptr;
+    island->contactList = nullptr;
+    island->contactListTail = nullptr;
+    island->jointList = nullptr;
+    island->jointListTail = nullptr;
+    island->bodyCount = 0;
+    island->contactCount = 0;
+    island->jointCount = 0;
+    island->constraintRemoveCount = 0;
+    island->sleeping = false;
+
+    return island;
+}
+
+void IslandManager::DestroyIsland(PersistentIsland* island)
+{
+    muliAssert(island->bodyCount == 0);
+
+    // Constraints left behind only connect static bodies
+    Contact* c = island->contactList;
+    while (c)
+    {
+        Contact* c0 = c;
+        c = c->islandNext;
+        c0->island = nullptr;
+        c0->islandPrev = nullptr;
+        c0->islandNext = nullptr;
+    }
+    Joint* j = island->jointList;
+    while (j)
+    {
+        Joint* j0 = j;
+        j = j->islandNext;
+        j0->island = nullptr;
+        j0->islandPrev = nullptr;
+        j0->islandNext = nullptr;
+    }
+
+    if (island->sleeping)
+    {
+        Remove(&sleepingList, island);
+    }
+    else
+    {
+        Remove(&awakeList, island);
+        --awakeIslandCount;
+    }
+
+    island->~PersistentIsland();
+    world->blockAllocator.Free(island, sizeof(PersistentIsland));
+}
+
+PersistentIsland* IslandManager::Merge(PersistentIsland* islandA, PersistentIsland* islandB)
+{
+    if (islandA == nullptr) return islandB;
+    if (islandB == nullptr) return islandA;
+    if (islandA == islandB) return islandA;
+
+    // Connecting an awake island to a sleeping one wakes up both
+    if (islandA->sleeping != islandB->sleeping)
+    {
+        Wake(islandA);
+        Wake(islandB);
+    }
+
+    // Union by size, relabel the smaller island
+    int32 sizeA = islandA->bodyCount + islandA->contactCount + islandA->jointCount;
+    int32 sizeB = islandB->bodyCount + islandB->contactCount + islandB->jointCount;
+    if (sizeA < sizeB)
+    {
+        std::swap(islandA, islandB);
+    }
+
+    // Relabel the members of the smaller island and append its lists
+    for (RigidBody* b = islandB->bodyList; b; b = b->islandNext)
+    {
+        b->island = islandA;
+    }
+    for (Contact* c = islandB->contactList; c; c = c->islandNext)
+    {
+        c->island = islandA;
+    }
+    for (Joint* j = islandB->jointList; j; j = j->islandNext)
+    {
+        j->island = islandA;
+    }
+
+    if (islandB->bodyList)
+    {
+        islandB->bodyList->islandPrev = islandA->bodyListTail;
+        if (islandA->bodyListTail) islandA->bodyListTail->islandNext = islandB->bodyList;
+        else islandA->bodyList = islandB->bodyList;
+        islandA->bodyListTail = islandB->bodyListTail;
+    }
+    if (islandB->contactList)
+    {
+        islandB->contactList->islandPrev = islandA->contactListTail;
+        if (islandA->contactListTail) islandA->contactListTail->islandNext = islandB->contactList;
+        else islandA->contactList = islandB->contactList;
+        islandA->contactListTail = islandB->contactListTail;
+    }
+    if (islandB->jointList)
+    {
+        islandB->jointList->islandPrev = islandA->jointListTail;
+        if (islandA->jointListTail) islandA->jointListTail->islandNext = islandB->jointList;
+        else islandA->jointList = islandB->jointList;
+        islandA->jointListTail = islandB->jointListTail;
+    }
+
+    islandA->bodyCount += islandB->bodyCount;
+    islandA->contactCount += islandB->contactCount;
+    islandA->jointCount += islandB->jointCount;
+    islandA->constraintRemoveCount += islandB->constraintRemoveCount;
+
+    islandB->bodyList = nullptr;
+    islandB->bodyListTail = nullptr;
+    islandB->contactList = nullptr;
+    islandB->contactListTail = nullptr;
+    islandB->jointList = nullptr;
+    islandB->jointListTail = nullptr;
+    islandB->bodyCount = 0;
+    islandB->contactCount = 0;
+    islandB->jointCount = 0;
+
+    DestroyIsland(islandB);
+
+    return islandA;
+}
+
+void IslandManager::LinkBody(PersistentIsland* island, RigidBody* body)
+{
+    body->island = island;
+    body->islandPrev = island->bodyListTail;
+    body->islandNext = nullptr;
+    if (island->bodyListTail) island->bodyListTail->islandNext = body;
+    else island->bodyList = body;
+    island->bodyListTail = body;
+
+    ++island->bodyCount;
+}
+
+void IslandManager::LinkContact(PersistentIsland* island, Contact* contact)
+{
+    contact->island = island;
+    contact->islandPrev = island->contactListTail;
+    contact->islandNext = nullptr;
+    if (island->contactListTail) island->contactListTail->islandNext = contact;
+    else island->contactList = contact;
+    island->contactListTail = contact;
+
+    ++island->contactCount;
+}
+
+void IslandManager::LinkJoint(PersistentIsland* island, Joint* joint)
+{
+    joint->island = island;
+    joint->islandPrev = island->jointListTail;
+    joint->islandNext = nullptr;
+    if (island->jointListTail) island->jointListTail->islandNext = joint;
+    else island->jointList = joint;
+    island->jointListTail = joint;
+
+    ++island->jointCount;
+}
+
+void IslandManager::InsertAfter(PersistentIsland** list, PersistentIsland* after, PersistentIsland* island)
+{
+    if (after == nullptr)
+    {
+        island->prev = nullptr;
+        island->next = *list;
+        if (*list) (*list)->prev = island;
+        *list = island;
+    }
+    else
+    {
+        island->prev = after;
+        island->next = after->next;
+        if (after->next) after->next->prev = island;
+        after->next = island;
+    }
+}
+
+void IslandManager::Remove(PersistentIsland** list, PersistentIsland* island)
+{
+    if (island->prev) island->prev->next = island->next;
+    if (island->next) island->next->prev = island->prev;
+    if (island == *list) *list = island->next;
+
+    island->prev = nullptr;
+    island->next = nullptr;
+}
+
+} // namespace muli
@@ -34,6 +34,9 @@ RigidBody::RigidBody(RigidBody::Type _type)
     , colliderCount{ 0 }
     , contactList{ nullptr }
     , jointList{ nullptr }
+    , island{ nullptr }
+    , islandPrev{ nullptr }
+    , islandNext{ nullptr }
     , resting{ 0.0f }
 {
 }
@@ -308,6 +311,22 @@ bool RigidBody::RayCastClosest(const Vec2& from, const Vec2& to, RayCastClosestC
     return false;
 }
 
+void RigidBody::Awake()
+{
+    if (type == Type::static_body)
+    {
+        return;
+    }
+
+    resting = 0.0f;
+    flag &= ~flag_sleeping;
+
+    if (island && island->sleeping)
+    {
+        world->islandManager.Wake(island);
+    }
+}
+
 void RigidBody::SetType(RigidBody::Type newType)
 {
     if (type == newType)
@@ -315,6 +334,9 @@ void RigidBody::SetType(RigidBody::Type newType)
         return;
     }
 
+    // The colliders need their proxies to move between the trees
+    world->contactManager.InsertPendingColliders();
+
     type = newType;
 
     ResetMassData();
@@ -344,7 +366,26 @@ void RigidBody::SetType(RigidBody::Type newType)
 
     for (Collider* c = colliderList; c; c = c->next)
     {
-        world->contactManager.broadPhase.Refresh(c);
+        world->contactManager.broadPhase->Refresh(c);
+    }
+
+    // Static bodies don't belong to any island, move the joints to the island of the other body
+    if (type == Type::static_body || island == nullptr)
+    {
+        if (type == Type::static_body)
+        {
+            world->islandManager.RemoveBody(this);
+        }
+        else
+        {
+            world->islandManager.AddBody(this);
+        }
+
+        for (JointEdge* je = jointList; je; je = je->next)
+        {
+            world->islandManager.RemoveJoint(je->joint);
+            world->islandManager.AddJoint(je->joint);
+        }
     }
 
     islandID = 0;
@@ -358,14 +399,19 @@ void RigidBody::SetEnabled(bool enabled)
         return;
     }
 
+    world->contactManager.InsertPendingColliders();
+
     if (enabled)
     {
         flag |= flag_enabled;
 
         for (Collider* c = colliderList; c; c = c->next)
         {
-            world->contactManager.broadPhase.Add(c, c->GetAABB());
+            world->contactManager.broadPhase->Add(c, c->GetAABB());
         }
+
+        // The island may have fallen asleep while this body was disabled
+        Awake();
     }
     else
     {
@@ -382,7 +428,7 @@ void RigidBody::SetEnabled(bool enabled)
 
         for (Collider* c = colliderList; c; c = c->next)
         {
-            world->contactManager.broadPhase.Remove(c);
+            world->contactManager.broadPhase->Remove(c);
         }
 
         islandID = 0;
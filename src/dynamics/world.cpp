@@ -12,15 +12,19 @@ namespace muli
 World::World(const WorldSettings& _settings)
     : settings{ _settings }
     , contactManager{ this }
+    , islandManager{ this }
     , bodyList{ nullptr }
     , bodyListTail{ nullptr }
     , bodyCount{ 0 }
     , jointList{ nullptr }
     , jointCount{ 0 }
     , islandCount{ 0 }
-    , sleepingBodyCount{ 0 }
+    , stats{}
     , stepComplete{ true }
+    , threadPool{ _settings.worker_count }
 {
+    threadAllocators = std::make_unique<LinearAllocator[]>(threadPool.GetThreadCount());
+
     // Assertions for stable CCD
     muliAssert(toi_position_solver_threshold < linear_slop * 2.0f);
     muliAssert(default_radius >= toi_position_solver_threshold);
@@ -55,177 +59,241 @@ void World::Reset()
 
 void World::Solve()
 {
-    // Build the constraint island
-    Island island{ this, bodyCount, contactManager.contactCount, jointCount };
+    // Island range into the flattened constraint graph arrays
+    struct IslandRange
+    {
+        PersistentIsland* island;
+        int32 bodyStart, bodyCount;
+        int32 contactStart, contactCount;
+        int32 jointStart, jointCount;
+        bool sleeping;
 
-    int32 restingBodies = 0;
-    int32 islandID = 0;
-    sleepingBodyCount = 0;
+        int32 velocityIterations, positionIterations;
+    };
+
+    const int32 awakeIslandCount = islandManager.GetAwakeIslandCount();
 
     // Use arena allocator to avoid per-frame allocation
-    RigidBody** stack = (RigidBody**)linearAllocator.Allocate(bodyCount * sizeof(RigidBody*));
-    int32 stackPointer;
+    IslandRange* islands = (IslandRange*)linearAllocator.Allocate(awakeIslandCount * sizeof(IslandRange));
+    RigidBody** islandBodies = (RigidBody**)linearAllocator.Allocate(bodyCount * sizeof(RigidBody*));
+    Contact** islandContacts = (Contact**)linearAllocator.Allocate(contactManager.contactCount * sizeof(Contact*));
+    Joint** islandJoints = (Joint**)linearAllocator.Allocate(jointCount * sizeof(Joint*));
+
+    int32 islandBodyCount = 0;
+    int32 islandContactCount = 0;
+    int32 islandJointCount = 0;
 
-    // Perform a DFS(Depth First Search) on the constraint graph
-    // After building island, each island can be solved in parallel because they are independent of each other
-    for (RigidBody* b = bodyList; b; b = b->next)
+    int32 islandID = 0;
+
+    // The sleepiest island that may have been disconnected by removed constraints
+    PersistentIsland* splitCandidate = nullptr;
+    float splitRestingTime = 0.0f;
+
+    // Flatten the awake islands, they are maintained incrementally so sleeping bodies are never visited
+    for (PersistentIsland* pi = islandManager.GetAwakeIslandList(); pi; pi = pi->next)
     {
-        if (b->flag & RigidBody::flag_island)
-        {
-            continue;
-        }
+        IslandRange& island = islands[islandID];
+        island.island = pi;
+        island.bodyStart = islandBodyCount;
+        island.contactStart = islandContactCount;
+        island.jointStart = islandJointCount;
 
-        if (b->IsSleeping() == true)
+        int32 restingBodies = 0;
+
+        for (RigidBody* b = pi->bodyList; b; b = b->islandNext)
         {
-            ++sleepingBodyCount;
-            continue;
+            if (b->IsEnabled() == false)
+            {
+                continue;
+            }
+
+            islandBodies[islandBodyCount++] = b;
+            b->islandID = islandID + 1;
+
+            if (b->resting > settings.sleeping_time)
+            {
+                restingBodies++;
+
+                if (pi->constraintRemoveCount > 0 && b->resting > splitRestingTime)
+                {
+                    splitCandidate = pi;
+                    splitRestingTime = b->resting;
+                }
+            }
         }
 
-        if (b->type == RigidBody::Type::static_body)
+        island.bodyCount = islandBodyCount - island.bodyStart;
+        if (island.bodyCount == 0)
         {
             continue;
         }
 
-        if (b->IsEnabled() == false)
+        for (Contact* c = pi->contactList; c; c = c->islandNext)
         {
-            continue;
-        }
+            if ((c->flag & Contact::flag_enabled) == 0)
+            {
+                continue;
+            }
 
-        stackPointer = 0;
-        stack[stackPointer++] = b;
-        b->flag |= RigidBody::flag_island;
+            islandContacts[islandContactCount++] = c;
+        }
 
-        ++islandID;
-        while (stackPointer > 0)
+        for (Joint* j = pi->jointList; j; j = j->islandNext)
         {
-            RigidBody* t = stack[--stackPointer];
+            if (j->bodyA->IsEnabled() == false || j->bodyB->IsEnabled() == false)
+            {
+                continue;
+            }
 
-            island.Add(t);
-            t->islandID = islandID;
+            islandJoints[islandJointCount++] = j;
+        }
 
-            for (ContactEdge* ce = t->contactList; ce; ce = ce->next)
-            {
-                Contact* c = ce->contact;
+        island.contactCount = islandContactCount - island.contactStart;
+        island.jointCount = islandJointCount - island.jointStart;
+        island.sleeping = settings.sleeping && (restingBodies == island.bodyCount);
 
-                if (c->flag & Contact::flag_island)
-                {
-                    continue;
-                }
+        ++islandID;
+    }
 
-                if ((c->flag & Contact::flag_touching) == 0)
-                {
-                    continue;
-                }
+    islandCount = islandID;
 
-                if ((c->flag & Contact::flag_enabled) == 0)
-                {
-                    continue;
-                }
+    auto solveIsland = [&](int32 index, int32 threadIndex, bool parallel) -> void {
+        IslandRange& range = islands[index];
 
-                island.Add(c);
-                c->flag |= Contact::flag_island;
+        Island island{ this, &threadAllocators[threadIndex], range.bodyCount, range.contactCount, range.jointCount };
 
-                RigidBody* other = ce->other;
+        for (int32 j = 0; j < range.bodyCount; ++j)
+        {
+            island.Add(islandBodies[range.bodyStart + j]);
+        }
+        for (int32 j = 0; j < range.contactCount; ++j)
+        {
+            island.Add(islandContacts[range.contactStart + j]);
+        }
+        for (int32 j = 0; j < range.jointCount; ++j)
+        {
+            island.Add(islandJoints[range.jointStart + j]);
+        }
 
-                if (other->flag & RigidBody::flag_island)
-                {
-                    continue;
-                }
+        island.sleeping = range.sleeping;
+        island.parallel = parallel;
+        island.Solve();
 
-                if (other->type == RigidBody::Type::static_body)
-                {
-                    continue;
-                }
+        range.velocityIterations = island.velocityIterations;
+        range.positionIterations = island.positionIterations;
+    };
 
-                muliAssert(stackPointer < bodyCount);
-                stack[stackPointer++] = other;
-                other->flag |= RigidBody::flag_island;
-            }
+    // Large islands are solved one by one, spreading their constraints over the threads with graph coloring
+    auto isLarge = [&](int32 index) -> bool {
+        return threadPool.GetThreadCount() > 1 &&
+               islands[index].contactCount + islands[index].jointCount >= graph_coloring_threshold;
+    };
 
-            for (JointEdge* je = t->jointList; je; je = je->next)
+    // Islands are independent of each other, so they can be solved in parallel
+    // Static bodies are shared between islands, the solvers only read them and never write their velocities or sweeps
+    threadPool.ParallelFor(islandCount, 1, [&](int32 begin, int32 end, int32 threadIndex) -> void {
+        for (int32 i = begin; i < end; ++i)
+        {
+            if (isLarge(i) == false)
             {
-                Joint* j = je->joint;
+                solveIsland(i, threadIndex, false);
+            }
+        }
+    });
 
-                if (j->flagIsland == true)
-                {
-                    continue;
-                }
+    for (int32 i = 0; i < islandCount; ++i)
+    {
+        if (isLarge(i))
+        {
+            solveIsland(i, 0, true);
+        }
+    }
 
-                RigidBody* other = je->other;
+    stats = StepStats{};
+    stats.islandCount = islandCount;
 
-                if (other->IsEnabled() == false)
-                {
-                    continue;
-                }
+    for (int32 i = 0; i < islandCount; ++i)
+    {
+        const IslandRange& range = islands[i];
 
-                island.Add(j);
-                j->flagIsland = true;
+        stats.velocityIterations += range.velocityIterations;
+        stats.positionIterations += range.positionIterations;
+        stats.maxVelocityIterations = Max(stats.maxVelocityIterations, range.velocityIterations);
+        stats.maxPositionIterations = Max(stats.maxPositionIterations, range.positionIterations);
+    }
 
-                if (other->flag & RigidBody::flag_island)
-                {
-                    continue;
-                }
+    // Report the solver results in the island order, so the outcome doesn't depend on the thread scheduling
+    for (int32 i = 0; i < islandBodyCount; ++i)
+    {
+        RigidBody* b = islandBodies[i];
 
-                if (other->type == RigidBody::Type::static_body)
-                {
-                    continue;
-                }
+        muliAssert(b->sweep.alpha0 == 0.0f);
+        muliAssert(b->type != RigidBody::Type::static_body);
 
-                muliAssert(stackPointer < bodyCount);
-                stack[stackPointer++] = other;
-                other->flag |= RigidBody::flag_island;
-            }
+        // Synchronize transform and broad-phase collider node
+        b->SynchronizeTransform();
+        b->SynchronizeColliders();
 
-            if (t->resting > settings.sleeping_time)
-            {
-                restingBodies++;
-            }
+        if (settings.world_bounds.TestPoint(b->GetPosition()) == false)
+        {
+            BufferDestroy(b);
         }
-
-        island.sleeping = settings.sleeping && (restingBodies == island.bodyCount);
-        island.Solve();
-        island.Clear();
-        restingBodies = 0;
     }
 
-    linearAllocator.Free(stack, bodyCount * sizeof(RigidBody*));
+    for (int32 i = 0; i < islandContactCount; ++i)
+    {
+        Contact* contact = islandContacts[i];
+
+        Collider* colliderA = contact->colliderA;
+        Collider* colliderB = contact->colliderB;
 
-    islandCount = islandID;
+        if (colliderA->ContactListener) colliderA->ContactListener->OnPostSolve(colliderA, colliderB, contact);
+        if (colliderB->ContactListener) colliderB->ContactListener->OnPostSolve(colliderB, colliderA, contact);
+    }
 
-    for (RigidBody* body = bodyList; body; body = body->next)
+    // Move the islands that fell asleep out of the awake list
+    // The position solver may have woken some of their bodies up again
+    for (int32 i = 0; i < islandCount; ++i)
     {
-        muliAssert(body->sweep.alpha0 == 0.0f);
+        const IslandRange& range = islands[i];
 
-        if ((body->flag & RigidBody::flag_island) == 0)
+        if (range.sleeping == false)
         {
             continue;
         }
 
-        muliAssert(body->type != RigidBody::Type::static_body);
-
-        // Clear island flag
-        body->flag &= ~RigidBody::flag_island;
+        bool sleeping = true;
+        for (int32 j = 0; j < range.bodyCount; ++j)
+        {
+            if (islandBodies[range.bodyStart + j]->IsSleeping() == false)
+            {
+                sleeping = false;
+                break;
+            }
+        }
 
-        // Synchronize transform and broad-phase collider node
-        body->SynchronizeTransform();
-        body->SynchronizeColliders();
+        if (sleeping)
+        {
+            islandManager.Sleep(range.island);
+        }
     }
 
-    for (Contact* contact = contactManager.contactList; contact; contact = contact->next)
-    {
-        contact->flag &= ~Contact::flag_island;
-    }
+    linearAllocator.Free(islandJoints, jointCount * sizeof(Joint*));
+    linearAllocator.Free(islandContacts, contactManager.contactCount * sizeof(Contact*));
+    linearAllocator.Free(islandBodies, bodyCount * sizeof(RigidBody*));
+    linearAllocator.Free(islands, awakeIslandCount * sizeof(IslandRange));
 
-    for (Joint* joint = jointList; joint; joint = joint->next)
+    // Split one island per step, the pieces can fall asleep separately from the next step
+    if (splitCandidate)
     {
-        joint->flagIsland = false;
+        islandManager.Split(splitCandidate);
     }
 }
 
 // Find TOI contacts and solve them
 float World::SolveTOI()
 {
-    Island island{ this, 2 * max_toi_contacts, max_toi_contacts, 0 };
+    Island island{ this, &linearAllocator, 2 * max_toi_contacts, max_toi_contacts, 0 };
 
     while (true)
     {
@@ -235,8 +303,11 @@ float World::SolveTOI()
         Contact* minContact = nullptr;
         float minAlpha = 1.0f;
 
-        for (Contact* c = contactManager.contactList; c; c = c->next)
+        // Contacts between sleeping bodies never have a TOI event
+        for (int32 i = 0; i < contactManager.awakeContactCount; ++i)
         {
+            Contact* c = contactManager.awakeContacts[i];
+
             if (c->IsEnabled() == false)
             {
                 continue;
@@ -526,17 +597,27 @@ float World::SolveTOI()
 
     muliAssert(stepComplete == true);
 
-    for (RigidBody* body = bodyList; body; body = body->next)
+    for (PersistentIsland* pi = islandManager.GetAwakeIslandList(); pi; pi = pi->next)
     {
-        body->sweep.alpha0 = 0.0f;
-        body->flag &= ~RigidBody::flag_island;
+        for (RigidBody* body = pi->bodyList; body; body = body->islandNext)
+        {
+            body->sweep.alpha0 = 0.0f;
+            body->flag &= ~RigidBody::flag_island;
+        }
     }
 
-    for (Contact* contact = contactManager.contactList; contact; contact = contact->next)
+    // Static bodies can also be advanced and flagged through their contacts
+    for (int32 i = 0; i < contactManager.awakeContactCount; ++i)
     {
+        Contact* contact = contactManager.awakeContacts[i];
         contact->flag &= ~(Contact::flag_toi | Contact::flag_island);
         contact->toiCount = 0;
         contact->toi = 1.0f;
+
+        contact->bodyA->sweep.alpha0 = 0.0f;
+        contact->bodyA->flag &= ~RigidBody::flag_island;
+        contact->bodyB->sweep.alpha0 = 0.0f;
+        contact->bodyB->flag &= ~RigidBody::flag_island;
     }
 
     return 1.0f;
@@ -554,6 +635,13 @@ float World::Step(float dt)
 
     // Grow the allocator buffer size if needed
     linearAllocator.GrowMemory();
+    for (int32 i = 0; i < threadPool.GetThreadCount(); ++i)
+    {
+        threadAllocators[i].GrowMemory();
+    }
+
+    // Colliders created while bulk inserting join the broad phase before the step at the latest
+    contactManager.InsertPendingColliders();
 
     if (stepComplete)
     {
@@ -572,10 +660,7 @@ float World::Step(float dt)
         progress = SolveTOI();
     }
 
-    for (RigidBody* b : destroyBodyBuffer)
-    {
-        Destroy(b);
-    }
+    Destroy(destroyBodyBuffer);
     for (Joint* j : destroyJointBuffer)
     {
         Destroy(j);
@@ -609,6 +694,8 @@ void World::Destroy(RigidBody* body)
         Destroy(je0->joint);
     }
 
+    islandManager.RemoveBody(body);
+
     if (body->next) body->next->prev = body->prev;
     if (body->prev) body->prev->next = body->next;
     if (body == bodyList) bodyList = body->next;
@@ -621,17 +708,34 @@ void World::Destroy(RigidBody* body)
 void World::Destroy(std::span<RigidBody*> bodies)
 {
     std::unordered_set<RigidBody*> destroyed;
+    std::vector<RigidBody*> uniqueBodies;
+    std::vector<Collider*> colliders;
 
     for (size_t i = 0; i < bodies.size(); ++i)
     {
         RigidBody* b = bodies[i];
+        muliAssert(b->world == this);
 
-        if (destroyed.find(b) != destroyed.end())
+        if (destroyed.insert(b).second)
         {
-            destroyed.insert(b);
-            Destroy(b);
+            uniqueBodies.push_back(b);
+
+            for (Collider* c = b->colliderList; c; c = c->next)
+            {
+                colliders.push_back(c);
+            }
         }
     }
+
+    // Take all the colliders out of the broad phase at once, then destroy the bodies one by one
+    contactManager.BeginBulkRemove(colliders);
+
+    for (RigidBody* b : uniqueBodies)
+    {
+        Destroy(b);
+    }
+
+    contactManager.EndBulkRemove();
 }
 
 void World::BufferDestroy(RigidBody* body)
@@ -652,6 +756,8 @@ void World::Destroy(Joint* joint)
     RigidBody* bodyA = joint->bodyA;
     RigidBody* bodyB = joint->bodyB;
 
+    islandManager.RemoveJoint(joint);
+
     // Remove from the world
     if (joint->prev) joint->prev->next = joint->next;
     if (joint->next) joint->next->prev = joint->prev;
@@ -682,9 +788,8 @@ void World::Destroy(std::span<Joint*> joints)
     {
         Joint* j = joints[i];
 
-        if (destroyed.find(j) != destroyed.end())
+        if (destroyed.insert(j).second)
         {
-            destroyed.insert(j);
             Destroy(j);
         }
     }
@@ -705,162 +810,172 @@ void World::BufferDestroy(std::span<Joint*> joints)
 
 void World::Query(const Vec2& point, std::function<bool(Collider* collider)> callback) const
 {
-    struct TempCallback
-    {
-        Vec2 point;
-        decltype(callback)& callbackFcn;
-
-        TempCallback(Vec2 point, decltype(callback)& callback)
-            : point{ point }
-            , callbackFcn{ callback }
-        {
-        }
-
-        bool QueryCallback(NodeProxy node, Collider* collider)
-        {
-            muliNotUsed(node);
-
-            // Body was destroyed while querying
-            if (collider->body == nullptr)
-            {
-                return true;
-            }
-
-            if (collider->TestPoint(point))
-            {
-                return callbackFcn(collider);
-            }
+    Query(point, [&](Collider* collider) -> bool { return callback(collider); });
+}
 
-            return true;
-        }
-    } tempCallback(point, callback);
+void World::Query(const AABB& aabb, std::function<bool(Collider* collider)> callback) const
+{
+    Query(aabb, [&](Collider* collider) -> bool { return callback(collider); });
+}
 
-    tempCallback.point = point;
+void World::Query(const Vec2& point, WorldQueryCallback* callback)
+{
+    Query(point, [callback](Collider* collider) -> bool { return callback->OnQuery(collider); });
+}
 
-    contactManager.broadPhase.tree.Query(point, &tempCallback);
+void World::Query(const AABB& aabb, WorldQueryCallback* callback)
+{
+    Query(aabb, [callback](Collider* collider) -> bool { return callback->OnQuery(collider); });
 }
 
-void World::Query(const AABB& aabb, std::function<bool(Collider* collider)> callback) const
+int32 World::Query(std::span<const AABB> aabbs, std::span<QueryHit> hits, bool multithreaded)
 {
-    struct TempCallback
+    int32 queryCount = int32(aabbs.size());
+    if (queryCount == 0)
     {
-        Polygon box;
-        decltype(callback)& callbackFcn;
+        return 0;
+    }
 
-        TempCallback(const AABB& aabb, decltype(callback)& callback)
-            : box{ { aabb.min, { aabb.max.x, aabb.min.y }, aabb.max, { aabb.min.x, aabb.max.y } }, false, 0.0f }
-            , callbackFcn{ callback }
-        {
-        }
+    // Cluster the boxes, so each packet of boxes covers a small part of the trees
+    int32* order = (int32*)muli::Alloc(queryCount * sizeof(int32));
+    AABBTree::SortQueries(aabbs, order);
 
-        bool QueryCallback(NodeProxy node, Collider* collider)
-        {
-            muliNotUsed(node);
+    AABB* sortedAABBs = (AABB*)muli::Alloc(queryCount * sizeof(AABB));
+    for (int32 i = 0; i < queryCount; ++i)
+    {
+        sortedAABBs[i] = aabbs[order[i]];
+    }
 
-            // Body was destroyed while querying
-            if (collider->body == nullptr)
-            {
-                return true;
-            }
+    int32 threadCount = multithreaded ? threadPool.GetThreadCount() : 1;
+    std::unique_ptr<QueryHitBuffer[]> candidateBuffers = std::make_unique<QueryHitBuffer[]>(threadCount);
+    std::unique_ptr<QueryHitBuffer[]> hitBuffers = std::make_unique<QueryHitBuffer[]>(threadCount);
 
-            if (Collide(collider->shape, collider->body->transform, &box, identity))
-            {
-                return callbackFcn(collider);
-            }
+    // The chunks are aligned to the packets, so the hits don't depend on the thread count
+    auto query = [&](int32 begin, int32 end, int32 threadIndex) -> void {
+        QueryHitBuffer& candidates = candidateBuffers[threadIndex];
+        QueryHitBuffer& buffer = hitBuffers[threadIndex];
 
-            return true;
-        }
-    } tempCallback(aabb, callback);
+        candidates.Clear();
+        contactManager.broadPhase->Query(std::span<const AABB>(sortedAABBs + begin, end - begin), candidates);
 
-    contactManager.broadPhase.tree.Query(aabb, &tempCallback);
-}
+        int32 candidateCount = candidates.Count();
+        if (candidateCount == 0)
+        {
+            return;
+        }
 
-void World::Query(const Vec2& point, WorldQueryCallback* callback)
-{
-    struct TempCallback
-    {
-        Vec2 point;
-        WorldQueryCallback* callback;
+        // Group the candidates by box, so the polygon of each box is built once
+        std::stable_sort(&candidates[0], &candidates[0] + candidateCount, [](const QueryHit& a, const QueryHit& b) -> bool {
+            return a.queryIndex < b.queryIndex;
+        });
 
-        bool QueryCallback(NodeProxy node, Collider* collider)
+        for (int32 i = 0; i < candidateCount;)
         {
-            muliNotUsed(node);
+            int32 queryIndex = candidates[i].queryIndex;
 
-            // Body was destroyed while querying
-            if (collider->body == nullptr)
-            {
-                return true;
-            }
+            const AABB& aabb = sortedAABBs[begin + queryIndex];
+            Polygon box{ { aabb.min, { aabb.max.x, aabb.min.y }, aabb.max, { aabb.min.x, aabb.max.y } }, false, 0.0f };
 
-            if (collider->TestPoint(point))
+            for (; i < candidateCount && candidates[i].queryIndex == queryIndex; ++i)
             {
-                return callback->OnQuery(collider);
-            }
+                Collider* collider = candidates[i].collider;
 
-            return true;
+                if (Collide(collider->shape, collider->body->transform, &box, identity))
+                {
+                    buffer.EmplaceBack(order[begin + queryIndex], collider);
+                }
+            }
         }
-    } tempCallback;
+    };
 
-    tempCallback.point = point;
-    tempCallback.callback = callback;
+    if (threadCount > 1)
+    {
+        threadPool.ParallelFor(queryCount, AABBTree::query_packet_size, query);
+    }
+    else
+    {
+        query(0, queryCount, 0);
+    }
 
-    contactManager.broadPhase.tree.Query(point, &tempCallback);
-}
+    muli::Free(sortedAABBs);
 
-void World::Query(const AABB& aabb, WorldQueryCallback* callback)
-{
-    Vec2 vertices[4] = { aabb.min, { aabb.max.x, aabb.min.y }, aabb.max, { aabb.min.x, aabb.max.y } };
-    Polygon box{ vertices, 4, false, 0.0f };
+    // Scatter the hits to the output grouped by box, in place of the order the threads found them
+    int32* offsets = order;
+    memset(offsets, 0, queryCount * sizeof(int32));
 
-    struct TempCallback
+    for (int32 i = 0; i < threadCount; ++i)
     {
-        Polygon region;
-        WorldQueryCallback* callback;
-        Transform t{ identity };
-
-        TempCallback(const Polygon& box)
-            : region{ box }
+        for (int32 j = 0; j < hitBuffers[i].Count(); ++j)
         {
+            ++offsets[hitBuffers[i][j].queryIndex];
         }
+    }
 
-        bool QueryCallback(NodeProxy node, Collider* collider)
-        {
-            muliNotUsed(node);
+    int32 hitCount = 0;
+    for (int32 i = 0; i < queryCount; ++i)
+    {
+        int32 count = offsets[i];
+        offsets[i] = hitCount;
+        hitCount += count;
+    }
 
-            // Body was destroyed while querying
-            if (collider->body == nullptr)
-            {
-                return true;
-            }
+    for (int32 i = 0; i < threadCount; ++i)
+    {
+        for (int32 j = 0; j < hitBuffers[i].Count(); ++j)
+        {
+            const QueryHit& hit = hitBuffers[i][j];
 
-            if (Collide(collider->shape, collider->body->transform, &region, t))
+            int32 index = offsets[hit.queryIndex]++;
+            if (index < int32(hits.size()))
             {
-                return callback->OnQuery(collider);
+                hits[index] = hit;
             }
-
-            return true;
         }
-    } tempCallback(box);
+    }
 
-    tempCallback.callback = callback;
+    muli::Free(order);
 
-    contactManager.broadPhase.tree.Query(aabb, &tempCallback);
+    return hitCount;
 }
 
-void World::RayCastAny(const Vec2& from, const Vec2& to, float radius, RayCastAnyCallback* callback)
+int32 World::RayCastClosest(std::span<const RayCastInput> rays, std::span<RayCastHit> hits, bool multithreaded)
 {
-    AABBCastInput input;
-    input.from = from;
-    input.to = to;
-    input.maxFraction = 1.0f;
-    input.halfExtents.Set(radius);
+    muliAssert(hits.size() >= rays.size());
 
-    struct TempCallback
+    int32 rayCount = int32(rays.size());
+    if (rayCount == 0)
     {
-        RayCastAnyCallback* callback;
+        return 0;
+    }
 
-        float AABBCastCallback(const AABBCastInput& subInput, Collider* collider)
-        {
+    AABBCastInput* inputs = (AABBCastInput*)muli::Alloc(rayCount * sizeof(AABBCastInput));
+    for (int32 i = 0; i < rayCount; ++i)
+    {
+        inputs[i].from = rays[i].from;
+        inputs[i].to = rays[i].to;
+        inputs[i].maxFraction = rays[i].maxFraction;
+        inputs[i].halfExtents.Set(rays[i].radius);
+
+        hits[i].collider = nullptr;
+    }
+
+    // Sort the rays into coherent packets
+    int32* order = (int32*)muli::Alloc(rayCount * sizeof(int32));
+    AABBTree::SortRays(std::span<const AABBCastInput>(inputs, rayCount), order);
+
+    AABBCastInput* sortedInputs = (AABBCastInput*)muli::Alloc(rayCount * sizeof(AABBCastInput));
+    for (int32 i = 0; i < rayCount; ++i)
+    {
+        sortedInputs[i] = inputs[order[i]];
+    }
+
+    muli::Free(inputs);
+
+    // Each ray is cast by one thread, so the hits are written in place
+    auto cast = [&](int32 begin, int32 end, int32 threadIndex) -> void {
+        muliNotUsed(threadIndex);
+
+        auto callback = [&](int32 rayIndex, const AABBCastInput& subInput, Collider* collider) -> float {
             RayCastInput input;
             input.from = subInput.from;
             input.to = subInput.to;
@@ -873,127 +988,75 @@ void World::RayCastAny(const Vec2& from, const Vec2& to, float radius, RayCastAn
             if (hit)
             {
                 float fraction = output.fraction;
-                Vec2 point = (1.0f - fraction) * input.from + fraction * input.to;
 
-                return callback->OnHitAny(collider, point, output.normal, fraction);
+                RayCastHit& closest = hits[order[begin + rayIndex]];
+                closest.collider = collider;
+                closest.point = (1.0f - fraction) * input.from + fraction * input.to;
+                closest.normal = output.normal;
+                closest.fraction = fraction;
+
+                return fraction;
             }
 
             return input.maxFraction;
-        }
-    } tempCallback;
-
-    tempCallback.callback = callback;
+        };
 
-    contactManager.broadPhase.tree.AABBCast(input, &tempCallback);
-}
+        contactManager.broadPhase->AABBCast(std::span<const AABBCastInput>(sortedInputs + begin, end - begin), callback);
+    };
 
-bool World::RayCastClosest(const Vec2& from, const Vec2& to, float radius, RayCastClosestCallback* callback)
-{
-    struct TempCallback : public RayCastAnyCallback
+    // The chunks are aligned to the packets, so the hits don't depend on the thread count
+    if (multithreaded)
     {
-        bool hit = false;
-        Collider* closestCollider;
-        Vec2 closestPoint;
-        Vec2 closestNormal;
-        float closestFraction;
-
-        float OnHitAny(Collider* collider, const Vec2& point, const Vec2& normal, float fraction)
-        {
-            hit = true;
-            closestCollider = collider;
-            closestPoint = point;
-            closestNormal = normal;
-            closestFraction = fraction;
-
-            return fraction;
-        }
-    } tempCallback;
-
-    RayCastAny(from, to, radius, &tempCallback);
-
-    if (tempCallback.hit)
+        threadPool.ParallelFor(rayCount, AABBTree::ray_packet_size, cast);
+    }
+    else
     {
-        callback->OnHitClosest(tempCallback.closestCollider, tempCallback.closestPoint, tempCallback.closestNormal,
-                               tempCallback.closestFraction);
-        return true;
+        cast(0, rayCount, 0);
     }
 
-    return false;
-}
-
-void World::ShapeCastAny(const Shape* shape, const Transform& tf, const Vec2& translation, ShapeCastAnyCallback* callback)
-{
-    AABB aabb;
-    shape->ComputeAABB(tf, &aabb);
-
-    AABBCastInput input;
-    input.from = tf.position;
-    input.to = tf.position + translation;
-    input.maxFraction = 1.0f;
-    input.halfExtents = 0.5f * aabb.GetExtents();
+    muli::Free(sortedInputs);
+    muli::Free(order);
 
-    struct TempCallback
+    int32 hitCount = 0;
+    for (int32 i = 0; i < rayCount; ++i)
     {
-        ShapeCastAnyCallback* callback;
-        const Shape* shape;
-        Transform tf;
-        Vec2 translation;
-
-        float AABBCastCallback(const AABBCastInput& input, Collider* collider)
+        if (hits[i].collider)
         {
-            ShapeCastOutput output;
-
-            bool hit = ShapeCast(shape, tf, collider->GetShape(), collider->GetBody()->GetTransform(),
-                                 translation * input.maxFraction, Vec2::zero, &output);
-            if (hit)
-            {
-                return callback->OnHitAny(collider, output.point, output.normal, output.t * input.maxFraction);
-            }
-
-            return input.maxFraction;
+            ++hitCount;
         }
-    } tempCallback;
-
-    tempCallback.callback = callback;
-    tempCallback.shape = shape;
-    tempCallback.tf = tf;
-    tempCallback.translation = translation;
+    }
 
-    contactManager.broadPhase.tree.AABBCast(input, &tempCallback);
+    return hitCount;
 }
 
-bool World::ShapeCastClosest(const Shape* shape, const Transform& tf, const Vec2& translation, ShapeCastClosestCallback* callback)
+void World::RayCastAny(const Vec2& from, const Vec2& to, float radius, RayCastAnyCallback* callback)
 {
-    struct TempCallback : ShapeCastAnyCallback
-    {
-        bool hit = false;
-        Collider* closestCollider;
-        Vec2 closestPoint;
-        Vec2 closestNormal;
-        float closestT = 1.0f;
-
-        float OnHitAny(Collider* collider, const Vec2& point, const Vec2& normal, float t)
-        {
-            hit = true;
-            closestCollider = collider;
-            closestPoint = point;
-            closestNormal = normal;
-            closestT = t;
-
-            return t;
-        }
-    } tempCallback;
+    RayCastAny(from, to, radius, [callback](Collider* collider, const Vec2& point, const Vec2& normal, float fraction) -> float {
+        return callback->OnHitAny(collider, point, normal, fraction);
+    });
+}
 
-    ShapeCastAny(shape, tf, translation, &tempCallback);
+bool World::RayCastClosest(const Vec2& from, const Vec2& to, float radius, RayCastClosestCallback* callback)
+{
+    return RayCastClosest(from, to, radius,
+                          [callback](Collider* collider, const Vec2& point, const Vec2& normal, float fraction) -> void {
+                              callback->OnHitClosest(collider, point, normal, fraction);
+                          });
+}
 
-    if (tempCallback.hit)
-    {
-        callback->OnHitClosest(tempCallback.closestCollider, tempCallback.closestPoint, tempCallback.closestNormal,
-                               tempCallback.closestT);
-        return true;
-    }
+void World::ShapeCastAny(const Shape* shape, const Transform& tf, const Vec2& translation, ShapeCastAnyCallback* callback)
+{
+    ShapeCastAny(shape, tf, translation, [callback](Collider* collider, const Vec2& point, const Vec2& normal, float t) -> float {
+        return callback->OnHitAny(collider, point, normal, t);
+    });
+}
 
-    return false;
+bool World::ShapeCastClosest(const Shape* shape, const Transform& tf, const Vec2& translation, ShapeCastClosestCallback* callback)
+{
+    return ShapeCastClosest(shape, tf, translation,
+                            [callback](Collider* collider, const Vec2& point, const Vec2& normal, float t) -> void {
+                                callback->OnHitClosest(collider, point, normal, t);
+                            });
 }
 
 void World::RayCastAny(const Vec2& from,
@@ -1001,45 +1064,9 @@ void World::RayCastAny(const Vec2& from,
                        float radius,
                        std::function<float(Collider* collider, const Vec2& point, const Vec2& normal, float fraction)> callback)
 {
-    AABBCastInput input;
-    input.from = from;
-    input.to = to;
-    input.maxFraction = 1.0f;
-    input.halfExtents.Set(radius);
-
-    struct TempCallback
-    {
-        decltype(callback)& callbackFcn;
-
-        TempCallback(decltype(callback)& callback)
-            : callbackFcn{ callback }
-        {
-        }
-
-        float AABBCastCallback(const AABBCastInput& subInput, Collider* collider)
-        {
-            RayCastInput input;
-            input.from = subInput.from;
-            input.to = subInput.to;
-            input.maxFraction = subInput.maxFraction;
-            input.radius = subInput.halfExtents.x;
-
-            RayCastOutput output;
-
-            bool hit = collider->RayCast(input, &output);
-            if (hit)
-            {
-                float fraction = output.fraction;
-                Vec2 point = (1.0f - fraction) * input.from + fraction * input.to;
-
-                return callbackFcn(collider, point, output.normal, fraction);
-            }
-
-            return input.maxFraction;
-        }
-    } tempCallback(callback);
-
-    contactManager.broadPhase.tree.AABBCast(input, &tempCallback);
+    RayCastAny(from, to, radius, [&](Collider* collider, const Vec2& point, const Vec2& normal, float fraction) -> float {
+        return callback(collider, point, normal, fraction);
+    });
 }
 
 bool World::RayCastClosest(
@@ -1048,36 +1075,10 @@ bool World::RayCastClosest(
     float radius,
     std::function<void(Collider* collider, const Vec2& point, const Vec2& normal, float fraction)> callback)
 {
-    struct TempCallback : public RayCastAnyCallback
-    {
-        bool hit = false;
-        Collider* closestCollider;
-        Vec2 closestPoint;
-        Vec2 closestNormal;
-        float closestFraction;
-
-        float OnHitAny(Collider* collider, const Vec2& point, const Vec2& normal, float fraction)
-        {
-            hit = true;
-            closestCollider = collider;
-            closestPoint = point;
-            closestNormal = normal;
-            closestFraction = fraction;
-
-            return fraction;
-        }
-    } tempCallback;
-
-    RayCastAny(from, to, radius, &tempCallback);
-
-    if (tempCallback.hit)
-    {
-        callback(tempCallback.closestCollider, tempCallback.closestPoint, tempCallback.closestNormal,
-                 tempCallback.closestFraction);
-        return true;
-    }
-
-    return false;
+    return RayCastClosest(from, to, radius,
+                          [&](Collider* collider, const Vec2& point, const Vec2& normal, float fraction) -> void {
+                              callback(collider, point, normal, fraction);
+                          });
 }
 
 void World::ShapeCastAny(const Shape* shape,
@@ -1085,46 +1086,9 @@ void World::ShapeCastAny(const Shape* shape,
                          const Vec2& translation,
                          std::function<float(Collider* collider, const Vec2& point, const Vec2& normal, float t)> callback)
 {
-    AABB aabb;
-    shape->ComputeAABB(tf, &aabb);
-
-    AABBCastInput input;
-    input.from = tf.position;
-    input.to = tf.position + translation;
-    input.maxFraction = 1.0f;
-    input.halfExtents = 0.5f * aabb.GetExtents();
-
-    struct TempCallback
-    {
-        decltype(callback)& callbackFcn;
-        const Shape* shape;
-        Transform tf;
-        Vec2 translation;
-
-        TempCallback(decltype(callback)& callback, const Shape* shape, Transform tf, Vec2 translation)
-            : callbackFcn{ callback }
-            , shape{ shape }
-            , tf{ tf }
-            , translation{ translation }
-        {
-        }
-
-        float AABBCastCallback(const AABBCastInput& input, Collider* collider)
-        {
-            ShapeCastOutput output;
-
-            bool hit = ShapeCast(shape, tf, collider->GetShape(), collider->GetBody()->GetTransform(),
-                                 translation * input.maxFraction, Vec2::zero, &output);
-            if (hit)
-            {
-                return callbackFcn(collider, output.point, output.normal, output.t * input.maxFraction);
-            }
-
-            return input.maxFraction;
-        }
-    } tempCallback(callback, shape, tf, translation);
-
-    contactManager.broadPhase.tree.AABBCast(input, &tempCallback);
+    ShapeCastAny(shape, tf, translation, [&](Collider* collider, const Vec2& point, const Vec2& normal, float t) -> float {
+        return callback(collider, point, normal, t);
+    });
 }
 
 bool World::ShapeCastClosest(const Shape* shape,
@@ -1132,35 +1096,10 @@ bool World::ShapeCastClosest(const Shape* shape,
                              const Vec2& translation,
                              std::function<void(Collider* collider, const Vec2& point, const Vec2& normal, float t)> callback)
 {
-    struct TempCallback : ShapeCastAnyCallback
-    {
-        bool hit = false;
-        Collider* closestCollider;
-        Vec2 closestPoint;
-        Vec2 closestNormal;
-        float closestT = 1.0f;
-
-        float OnHitAny(Collider* collider, const Vec2& point, const Vec2& normal, float t)
-        {
-            hit = true;
-            closestCollider = collider;
-            closestPoint = point;
-            closestNormal = normal;
-            closestT = t;
-
-            return t;
-        }
-    } tempCallback;
-
-    ShapeCastAny(shape, tf, translation, &tempCallback);
-
-    if (tempCallback.hit)
-    {
-        callback(tempCallback.closestCollider, tempCallback.closestPoint, tempCallback.closestNormal, tempCallback.closestT);
-        return true;
-    }
-
-    return false;
+    return ShapeCastClosest(shape, tf, translation,
+                            [&](Collider* collider, const Vec2& point, const Vec2& normal, float t) -> void {
+                                callback(collider, point, normal, t);
+                            });
 }
 
 RigidBody* World::DuplicateBody(RigidBody* body)
@@ -1227,6 +1166,8 @@ RigidBody* World::CreateEmptyBody(RigidBody::Type type)
         bodyListTail = body;
     }
 
+    islandManager.AddBody(body);
+
     ++bodyCount;
 
     return body;
@@ -1587,6 +1528,8 @@ void World::AddJoint(Joint* joint)
         joint->bodyB->jointList = &joint->nodeB;
     }
 
+    islandManager.AddJoint(joint);
+
     ++jointCount;
 }
 
@@ -1598,9 +1541,11 @@ void World::FreeBody(RigidBody* body)
 
 void World::FreeJoint(Joint* joint)
 {
+    // The type can't be read once the joint is destroyed
+    Joint::Type type = joint->type;
     joint->~Joint();
 
-    switch (joint->type)
+    switch (type)
     {
     case Joint::Type::grab_joint:
         blockAllocator.Free(joint, sizeof(GrabJoint));
@@ -11,7 +11,7 @@ LinearAllocator::LinearAllocator(int32 initialCapacity)
     , allocation{ 0 }
     , maxAllocation{ 0 }
 {
-    mem = (int8*)malloc(capacity);
+    mem = (int8*)muli::AlignedAlloc(capacity, alignment);
     memset(mem, 0, capacity);
     entries = (MemoryEntry*)malloc(entryCapacity * sizeof(MemoryEntry));
 }
@@ -21,7 +21,7 @@ LinearAllocator::~LinearAllocator()
     assert(index == 0 && entryCount == 0);
 
     free(entries);
-    free(mem);
+    muli::AlignedFree(mem, alignment);
 }
 
 void* LinearAllocator::Allocate(int32 size)
@@ -37,22 +37,26 @@ void* LinearAllocator::Allocate(int32 size)
         free(old);
     }
 
+    // Round up so every block starts on an alignment boundary
+    int32 alignedSize = (size + alignment - 1) & ~(alignment - 1);
+
     MemoryEntry* entry = entries + entryCount;
     entry->size = size;
+    entry->alignedSize = alignedSize;
 
-    if (index + size > capacity)
+    if (index + alignedSize > capacity)
     {
-        entry->data = (int8*)malloc(size);
+        entry->data = (int8*)muli::AlignedAlloc(alignedSize, alignment);
         entry->mallocUsed = true;
     }
     else
     {
         entry->data = mem + index;
         entry->mallocUsed = false;
-        index += size;
+        index += alignedSize;
     }
 
-    allocation += size;
+    allocation += alignedSize;
     if (allocation > maxAllocation)
     {
         maxAllocation = allocation;
@@ -74,14 +78,14 @@ void LinearAllocator::Free(void* p, int32 size)
 
     if (entry->mallocUsed)
     {
-        free(p);
+        muli::AlignedFree(p, alignment);
     }
     else
     {
-        index -= entry->size;
+        index -= entry->alignedSize;
     }
 
-    allocation -= entry->size;
+    allocation -= entry->alignedSize;
     --entryCount;
 
     p = nullptr;
@@ -97,9 +101,9 @@ bool LinearAllocator::GrowMemory()
     }
 
     // Grow memory by half
-    free(mem);
+    muli::AlignedFree(mem, alignment);
     capacity += capacity / 2;
-    mem = (int8*)malloc(capacity);
+    mem = (int8*)muli::AlignedAlloc(capacity, alignment);
     memset(mem, 0, capacity);
 
     return true;
@@ -0,0 +1,128 @@
+#include "muli/pair_set.h"
+
+namespace muli
+{
+
+PairSet::PairSet(int32 initialCapacity)
+    : count{ 0 }
+{
+    // Capacity must be a power of two
+    capacity = 16;
+    while (capacity < initialCapacity)
+    {
+        capacity *= 2;
+    }
+
+    entries = (Entry*)muli::Alloc(capacity * sizeof(Entry));
+    memset(entries, 0, capacity * sizeof(Entry));
+}
+
+PairSet::~PairSet()
+{
+    muli::Free(entries);
+}
+
+// Returns the slot holding the pair, or the empty slot that ends its probe sequence
+int32 PairSet::Find(uint64 key1, uint64 key2) const
+{
+    int32 mask = capacity - 1;
+    int32 index = Hash(key1, key2) & mask;
+
+    while (entries[index].key1 != 0)
+    {
+        if (entries[index].key1 == key1 && entries[index].key2 == key2)
+        {
+            break;
+        }
+
+        index = (index + 1) & mask;
+    }
+
+    return index;
+}
+
+bool PairSet::Add(const void* a, const void* b)
+{
+    muliAssert(a != nullptr && b != nullptr);
+
+    uint64 key1, key2;
+    MakeKey(a, b, &key1, &key2);
+
+    int32 index = Find(key1, key2);
+    if (entries[index].key1 != 0)
+    {
+        return false;
+    }
+
+    // Keep the load factor under 1/2 so the probe sequences stay short
+    if (2 * (count + 1) > capacity)
+    {
+        Grow();
+        index = Find(key1, key2);
+    }
+
+    entries[index].key1 = key1;
+    entries[index].key2 = key2;
+    ++count;
+
+    return true;
+}
+
+bool PairSet::Remove(const void* a, const void* b)
+{
+    uint64 key1, key2;
+    MakeKey(a, b, &key1, &key2);
+
+    int32 index = Find(key1, key2);
+    if (entries[index].key1 == 0)
+    {
+        return false;
+    }
+
+    // Shift the following entries of the cluster back into the hole
+    // An entry moves only if its home slot is not between the hole and itself (cyclically)
+    int32 mask = capacity - 1;
+    int32 hole = index;
+    int32 next = (hole + 1) & mask;
+
+    while (entries[next].key1 != 0)
+    {
+        int32 home = Hash(entries[next].key1, entries[next].key2) & mask;
+
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            entries[hole] = entries[next];
+            hole = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    entries[hole].key1 = 0;
+    entries[hole].key2 = 0;
+    --count;
+
+    return true;
+}
+
+void PairSet::Grow()
+{
+    Entry* oldEntries = entries;
+    int32 oldCapacity = capacity;
+
+    capacity *= 2;
+    entries = (Entry*)muli::Alloc(capacity * sizeof(Entry));
+    memset(entries, 0, capacity * sizeof(Entry));
+
+    for (int32 i = 0; i < oldCapacity; ++i)
+    {
+        if (oldEntries[i].key1 != 0)
+        {
+            entries[Find(oldEntries[i].key1, oldEntries[i].key2)] = oldEntries[i];
+        }
+    }
+
+    muli::Free(oldEntries);
+}
+
+} // namespace muli
@@ -0,0 +1,118 @@
+#include "muli/thread_pool.h"
+
+namespace muli
+{
+
+ThreadPool::ThreadPool(int32 threadCount)
+    : task{ nullptr }
+    , taskCount{ 0 }
+    , taskGrainSize{ 1 }
+    , nextIndex{ 0 }
+    , busyWorkers{ 0 }
+    , generation{ 0 }
+    , terminate{ false }
+{
+    threadCount = Max(threadCount, 1);
+
+    workers.reserve(threadCount - 1);
+    for (int32 i = 1; i < threadCount; ++i)
+    {
+        workers.emplace_back(&ThreadPool::WorkerMain, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        terminate = true;
+    }
+    wakeCondition.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(int32 count, int32 grainSize, const Task& fcn)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    grainSize = Max(grainSize, 1);
+
+    // Not worth waking up the workers
+    if (workers.empty() || count <= grainSize)
+    {
+        fcn(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        task = &fcn;
+        taskCount = count;
+        taskGrainSize = grainSize;
+        nextIndex.store(0, std::memory_order_relaxed);
+        busyWorkers = int32(workers.size());
+        ++generation;
+    }
+    wakeCondition.notify_all();
+
+    Execute(0);
+
+    std::unique_lock<std::mutex> lock{ mutex };
+    doneCondition.wait(lock, [this]() { return busyWorkers == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::WorkerMain(int32 threadIndex)
+{
+    uint64 lastGeneration = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            wakeCondition.wait(lock, [&]() { return terminate || generation != lastGeneration; });
+
+            if (terminate)
+            {
+                return;
+            }
+
+            lastGeneration = generation;
+        }
+
+        Execute(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (--busyWorkers == 0)
+            {
+                doneCondition.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::Execute(int32 threadIndex)
+{
+    while (true)
+    {
+        int32 begin = nextIndex.fetch_add(taskGrainSize, std::memory_order_relaxed);
+        if (begin >= taskCount)
+        {
+            break;
+        }
+
+        int32 end = Min(begin + taskGrainSize, taskCount);
+        (*task)(begin, end, threadIndex);
+    }
+}
+
+} // namespace muli
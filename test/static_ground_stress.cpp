@@ -0,0 +1,72 @@
+#include "muli/muli.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace muli;
+
+// Many islands and one graph colored island resting on the same static ground, solved by several threads
+// Build with -fsanitize=thread to catch writes to the shared ground body
+int main()
+{
+    WorldSettings settings;
+    settings.worker_count = 4;
+
+    World world(settings);
+
+    RigidBody* ground = world.CreateBox(400.0f, 0.4f, RigidBody::Type::static_body);
+    Vec2 groundPosition = ground->GetPosition();
+    float groundAngle = ground->GetAngle();
+
+    // Small stacks, each of them is an island of its own
+    int32 stackCount = 48;
+    for (int32 i = 0; i < stackCount; ++i)
+    {
+        for (int32 j = 0; j < 4; ++j)
+        {
+            RigidBody* b = world.CreateBox(0.5f);
+            b->SetPosition(-190.0f + i * 2.0f, 0.45f + j * 0.55f);
+        }
+    }
+
+    // A pyramid large enough to be solved with graph coloring, its bottom row touches the ground many times
+    int32 rows = 30;
+    for (int32 y = 0; y < rows; ++y)
+    {
+        for (int32 x = 0; x < rows - y; ++x)
+        {
+            RigidBody* b = world.CreateBox(0.5f);
+            b->SetPosition(50.0f + (x - (rows - y) * 0.5f) * 0.55f, 0.45f + y * 0.55f);
+        }
+    }
+
+    float dt = 1.0f / 60.0f;
+    for (int32 i = 0; i < 180; ++i)
+    {
+        world.Step(dt);
+    }
+
+    if (ground->GetPosition() != groundPosition || ground->GetAngle() != groundAngle)
+    {
+        std::printf("static ground moved\n");
+        return EXIT_FAILURE;
+    }
+
+    for (RigidBody* b = world.GetBodyList(); b; b = b->GetNext())
+    {
+        if (b->GetType() != RigidBody::Type::dynamic_body)
+        {
+            continue;
+        }
+
+        const Vec2& p = b->GetPosition();
+        if (std::isfinite(p.x) == false || std::isfinite(p.y) == false || p.y < 0.0f)
+        {
+            std::printf("body fell through the ground or blew up: (%f, %f)\n", p.x, p.y);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}